@@ -2,47 +2,153 @@
  * OPERATION 1: Open Function
  * This function opens the student database file, reads the records,
  * and loads them into memory.
+ * Files written by SAVE COMPRESSED are recognised by their magic and decoded
+ * block by block (compress.c); OPEN reads FILENAME_COMPRESSED instead of the
+ * text file when it was saved more recently (storage_path in db.c).
+ * OPEN remembers where it stopped reading, so REFRESH can pick up rows
+ * appended later (refresh.c).
+ * Text files are read without hashing IDs; when <file>.idx was saved for
+ * exactly this file (SAVE INDEX) the index is read back, otherwise it is rebuilt.
 */
 
 #define _CRT_SECURE_NO_WARNINGS
 #include "student_db.h"
 #include <stdlib.h>
 
-void openDatabase(void) { // open and load database from file
+#define WIDTH_(n) #n
+#define WIDTH(n) WIDTH_(n)
+
+// 1 for a record line, 0 for a header or malformed line; the strings go to pool (NULL: the table's arena)
+int db_parse_row(const char* line, StudentRecord* rec, StrPool* pool) {
+    char name[MAX_TEXT_LEN + 1], programme[MAX_TEXT_LEN + 1];
+    int nameEnd, progEnd;
+    // widths are MAX_TEXT_LEN; a longer field does not end in a tab
+    int readResult = sscanf(line, "%d\t%" WIDTH(MAX_TEXT_LEN) "[^\t]%n\t%" WIDTH(MAX_TEXT_LEN) "[^\t]%n\t%f",
+        &rec->id,
+        name, &nameEnd,
+        programme, &progEnd,
+        &rec->mark); // read ID, name, programme, mark
+    if (readResult != 4 || line[nameEnd] != '\t' || line[progEnd] != '\t') {
+        return 0;
+    }
+    rec_set_name(rec, name, pool);
+    rec_set_programme(rec, programme, pool);
+    return 1;
+}
+
+int db_load_row(const StudentRecord* rec) { // 0 added, 1 duplicate ID skipped, -1 out of memory
+    if (index_get(rec->id, NULL)) {
+        return 1; // duplicate ID, the first row wins
+    }
+    if (db_reserve(recordCount + 1) != 0) {
+        return -1;
+    }
+    records[recordCount] = *rec;
+    index_put(rec->id, recordCount);
+    recordCount = recordCount + 1;
+    return 0;
+}
+
+static void drop_duplicates(void) { // the first row of each ID wins, as the index is rebuilt
+    int kept = 0;
+    index_build(records, 0);
+    for (int i = 0; i < recordCount; i++) {
+        if (index_get(records[i].id, NULL)) continue;
+        records[kept] = records[i];
+        index_put(records[kept].id, kept);
+        kept = kept + 1;
+    }
+    recordCount = kept;
+}
+
+int db_open(const char* path) { // load database from file, returns records loaded or -1
     FILE* fp;
-    char line[256];
-    int readResult;
+    char line[MAX_LINE_LEN];
+    StudentRecord rec;
+    char idxPath[270];
+    unsigned long long sum = 0;
+    STATS_START(t0);
 
-    fp = fopen(FILENAME, "r");
+    fp = fopen(path, "rb"); // binary so a compressed file reads the same everywhere
 
     if (fp == NULL) { // error handling for file open
-        printf("Error opening file!\n");
         audit_log("OPEN", NULL, NULL, "FAIL");
-        return;
+        return -1;
     }
 
     recordCount = 0; 
-    fgets(line, sizeof(line), fp);
+    index_build(records, 0);
+    arena_reset(); // the last snapshot keeps the old strings until the next one is published
 
-    while (recordCount < MAX_RECORDS) { // read records until max records reached
-        if (fgets(line, sizeof(line), fp) == NULL) {
-            break;
+    if (cmsz_is_compressed(fp)) {
+        TRACE_START(t1);
+        int rc = cmsz_read(fp);
+        TRACE_STOP("open.decode", t1);
+        if (rc == 0) refresh_mark(fp, path);
+        else refresh_forget();
+        fclose(fp);
+        if (rc != 0) { // never serve half a decoded file
+            recordCount = 0;
+            index_build(records, 0);
         }
+        index_seal(records, recordCount);
+        snapshot_publish();
+        if (rc != 0) {
+            audit_log("OPEN", NULL, NULL, "FAIL(CORRUPT)");
+            return -1;
+        }
+        STATS_STOP(STAT_IO_OPEN, t0);
+        audit_log("OPEN", NULL, NULL, "SUCCESS(COMPRESSED)");
+        return recordCount;
+    }
+    if (fgets(line, sizeof(line), fp) != NULL) {
+        sum = line_checksum(sum, line);
+    }
 
-        readResult = sscanf(line, "%d\t%[^\t]\t%[^\t]\t%f", // read ID, name, programme, mark
-            &records[recordCount].id,
-            records[recordCount].name,
-            records[recordCount].programme,
-            &records[recordCount].mark);
-
-        if (readResult == 4) {
-            recordCount = recordCount + 1;
+    TRACE_START(t1);
+    while (fgets(line, sizeof(line), fp) != NULL) { // read records until end of file
+        sum = line_checksum(sum, line);
+        if (!db_parse_row(line, &rec, NULL)) {
+            continue; // malformed line
         }
+        if (db_reserve(recordCount + 1) != 0) {
+            break;
+        }
+        records[recordCount] = rec;
+        recordCount = recordCount + 1;
     }
+    TRACE_STOP("open.parse", t1);
 
+    refresh_mark(fp, path); // REFRESH reads on from here
     fclose(fp); // close the file after reading
-    index_build(records, recordCount);
+    snprintf(idxPath, sizeof idxPath, "%s.idx", path);
+    if (index_load_file(idxPath, recordCount, sum) != 0) {
+        drop_duplicates();
+    }
+    index_seal(records, recordCount);
+    snapshot_publish();
+    STATS_STOP(STAT_IO_OPEN, t0);
 
-    printf("Successfully loaded %d records from '%s'\n\n", recordCount, FILENAME);
     audit_log("OPEN", NULL, NULL, "SUCCESS");
+    return recordCount;
+}
+
+void openDatabase(void) { // open and load database from file
+    if (storage_open() < 0) {
+        printf("Error opening file!\n");
+        return;
+    }
+    if (mstore_enabled()) {
+        printf("Successfully mapped %d records (memory-mapped store)\n\n", recordCount);
+        return;
+    }
+    if (lazy_pending() > 0) {
+        printf("Successfully indexed %d records from '%s' (each row is read when first used)\n\n", recordCount, FILENAME);
+        return;
+    }
+    if (shard_count() > 0) {
+        printf("Successfully loaded %d records from %d shard(s) of '%s'\n\n", recordCount, shard_count(), FILENAME);
+        return;
+    }
+    printf("Successfully loaded %d records from '%s'\n\n", recordCount, storage_path());
 }
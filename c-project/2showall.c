@@ -8,11 +8,16 @@
 void showAll(void) { // display all student records
     int i;
 
+    lazy_fetch_all();
     printf("\nID\tName\t\tProgramme\t\tMark\n");
     printf("----------------------------------------\n");
 
     i = 0;
     while (i < recordCount) {
+        if (txn_row_deleted(i)) { // deleted in the open transaction
+            i = i + 1;
+            continue;
+        }
         printf("%d\t%-15s\t%-25s\t%.1f\n",
             records[i].id, records[i].name,
             records[i].programme, records[i].mark);
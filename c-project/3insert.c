@@ -7,69 +7,80 @@
 #include "student_db.h"
 #include <stdlib.h>
 
-void insertRecord(void) {
-    int newId;
-    int i;
-    int duplicate;
-    int pos;
+int db_insert(const StudentRecord* rec) { // returns 0 on success, -1 on duplicate ID, -2 if out of memory
+    if (db_find_pos(rec->id) >= 0) {
+        audit_log("INSERT", NULL, NULL, "FAIL(DUPLICATE)");
+        return -1;
+    }
+    if (db_reserve(recordCount + 1) != 0 || (txn_active() && txn_log_insert(recordCount) != 0)) {
+        audit_log("INSERT", NULL, NULL, "FAIL(NO_MEMORY)");
+        return -2;
+    }
 
-    printf("Enter student ID: ");
-    scanf("%d", &newId);
-    getchar();
+    records[recordCount] = *rec;
+    index_put(rec->id, recordCount);
 
-    duplicate = 0;
+    recordCount = recordCount + 1;
+    shard_touch(rec->id);
+    if (!txn_active()) snapshot_publish_rows(recordCount - 1, recordCount - 1); // COMMIT publishes a transaction's changes
+    audit_log("INSERT", NULL, &records[recordCount - 1], "SUCCESS"); // after publishing, see repl.c
+    return 0;
+}
 
-    if (index_get(newId, &pos)) {
-        duplicate = 1;
-    } else {
-        i = 0;
-        while (i < recordCount) {
-            if (records[i].id == newId) {
-                duplicate = 1;
-                break;
-            }
+void read_field(char* text) { // one line of input into text[MAX_TEXT_LEN + 1], the rest of a longer line is dropped
+    int i = 0;
+    int c = getchar();
+    while (c != EOF && c != '\n') {
+        if (i < MAX_TEXT_LEN) {
+            text[i] = (char)c;
             i = i + 1;
         }
+        c = getchar();
+    }
+    text[i] = '\0';
+}
+
+void insertRecord(void) {
+    StudentRecord rec;
+    char text[MAX_TEXT_LEN + 1];
+
+    printf("Enter student ID: ");
+    read_field(text);
+    if (sscanf(text, "%d", &rec.id) != 1) {
+        printf("Error: Invalid student ID. Insertion cancelled.\n");
+        return;
     }
 
-    if (duplicate == 1) { // error handling for duplicate ID
+    if (db_find_pos(rec.id) >= 0) { // error handling for duplicate ID
         printf("Error: Student ID already exists. Insertion cancelled.\n");
         audit_log("INSERT", NULL, NULL, "FAIL(DUPLICATE)");
         return;
     }
 
-    records[recordCount].id = newId;
     // insert name
     printf("Enter name: ");
-    fgets(records[recordCount].name, MAX_NAME_LEN, stdin);
+    read_field(text);
+    rec_set_name(&rec, text, NULL);
 
-    i = 0;
-    while (records[recordCount].name[i] != '\0') {
-        if (records[recordCount].name[i] == '\n') {
-            records[recordCount].name[i] = '\0';
-            break;
-        }
-        i = i + 1;
-    }
     // insert programme
     printf("Enter programme: ");
-    fgets(records[recordCount].programme, MAX_PROG_LEN, stdin);
+    read_field(text);
+    rec_set_programme(&rec, text, NULL);
 
-    i = 0;
-    while (records[recordCount].programme[i] != '\0') {
-        if (records[recordCount].programme[i] == '\n') {
-            records[recordCount].programme[i] = '\0';
-            break;
-        }
-        i = i + 1;
-    }
     // insert mark
     printf("Enter mark: ");
-    scanf("%f", &records[recordCount].mark);
-
-    index_put(newId, recordCount);
-    audit_log("INSERT", NULL, &records[recordCount], "SUCCESS");
+    read_field(text);
+    if (sscanf(text, "%f", &rec.mark) != 1) {
+        printf("Error: Invalid mark. Insertion cancelled.\n");
+        return;
+    }
 
-    recordCount = recordCount + 1;
+    STATS_START(t0); // the insert itself, not the typing at the prompts
+    int rc = db_insert(&rec);
+    STATS_STOP(STAT_INSERT, t0);
+    if (rc != 0) {
+        printf("Error: Out of memory. Insertion cancelled.\n");
+        return;
+    }
     printf("Record added successfully!\n");
 }
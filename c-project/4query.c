@@ -1,46 +1,123 @@
 /*
  * OPERATION 4: Query Function
  * This function searches for a student record by ID and displays it if found.
+ * The lookup runs against the current snapshot, so it never sees a half-applied change;
+ * inside a transaction it reads records[] instead, so the transaction sees its own writes.
+ * QUERY followed by several IDs looks them all up in one batch.
 */
 
 #define _CRT_SECURE_NO_WARNINGS
 #include "student_db.h"
+#include <stdlib.h>
+
+int db_find_pos(int id) { // position of id in records[], or -1 (writer side lookup)
+    int pos;
+    int i;
+
+    if (index_get(id, &pos)) {
+        return txn_row_deleted(pos) ? -1 : pos;
+    }
+    if (id != 0 && index_complete()) {
+        return -1; // the index holds every other id, a miss needs no scan
+    }
+
+    i = 0;
+    while (i < recordCount) { // ids the index cannot hold, or dropped for lack of memory
+        if (records[i].id == id && !txn_row_deleted(i)) {
+            return i;
+        }
+        i = i + 1;
+    }
+    return -1;
+}
 
 void queryRecord(void) {
     int searchId;
-    int i;
-    int found;
-    int pos;
+    char text[MAX_TEXT_LEN + 1];
+    const StudentRecord* rec;
+    DbSnapshot* snap;
 
     printf("Enter student ID to search: "); // prompt for student ID
-    scanf("%d", &searchId);
+    read_field(text);
+    if (sscanf(text, "%d", &searchId) != 1) {
+        printf("Invalid student ID.\n");
+        return;
+    }
 
-    if (index_get(searchId, &pos)) {
+    STATS_START(t0); // the lookup itself, not the typing at the prompt
+    lazy_fetch(&searchId, 1);
+    snap = snapshot_acquire();
+    rec = txn_active() ? txn_find(searchId) : snapshot_find(snap, searchId);
+    STATS_STOP(STAT_QUERY, t0);
+
+    if (rec != NULL) {
         printf("\nFound Record:\n");
         printf("ID: %d\nName: %s\nProgramme: %s\nMark: %.2f\n",
-            records[pos].id, records[pos].name,
-            records[pos].programme, records[pos].mark);
-        audit_log("QUERY", NULL, &records[pos], "FOUND");
+            rec->id, rec->name,
+            rec->programme, rec->mark);
+        audit_log("QUERY", NULL, rec, "FOUND");
+    }
+    else { // error if record is not found
+        printf("Record not found.\n");
+        audit_log("QUERY", NULL, NULL, "NOT_FOUND");
+    }
+
+    snapshot_release(snap);
+}
+
+void queryMany(const char* text) { // QUERY id id ...: one batch lookup, rows printed in input order
+    int* ids = NULL;
+    int count = 0, capacity = 0;
+    const char* p = text;
+    char* end;
+
+    for (long v = strtol(p, &end, 10); end != p; v = strtol(p, &end, 10)) {
+        if (count == capacity) {
+            int* grown = realloc(ids, (size_t)(capacity ? capacity * 2 : 16) * sizeof *ids);
+            if (!grown) break;
+            ids = grown;
+            capacity = capacity ? capacity * 2 : 16;
+        }
+        ids[count++] = (int)v;
+        p = end;
+    }
+    while (*p == ' ' || *p == '\t') p++;
+    if (*p != '\0' || count == 0) { // something that is not an ID
+        printf("Usage: QUERY <id> [<id> ...]\n");
+        free(ids);
         return;
     }
 
-    found = 0;
-    i = 0;
-    while (i < recordCount) { // search through records
-        if (records[i].id == searchId) {
-            printf("\nFound Record:\n");
-            printf("ID: %d\nName: %s\nProgramme: %s\nMark: %.2f\n",
-                records[i].id, records[i].name,
-                records[i].programme, records[i].mark);
-            found = 1;
-            audit_log("QUERY", NULL, &records[i], "FOUND");
-            break;
+    const StudentRecord** rows = malloc((size_t)(count ? count : 1) * sizeof *rows);
+    if (!rows) {
+        free(ids);
+        return;
+    }
+    lazy_fetch(ids, count);
+    DbSnapshot* snap = snapshot_acquire();
+    int found = 0;
+    if (txn_active()) {
+        for (int i = 0; i < count; i++) {
+            rows[i] = txn_find(ids[i]);
+            found += rows[i] != NULL;
         }
-        i = i + 1;
+    }
+    else {
+        found = snapshot_find_batch(snap, ids, count, rows);
     }
 
-    if (found == 0) { // error if record is not found
-        printf("Record not found.\n");
-        audit_log("QUERY", NULL, NULL, "NOT_FOUND");
+    printf("\nID\tName\t\tProgramme\t\tMark\n");
+    for (int i = 0; i < count; i++) {
+        if (rows[i]) {
+            printf("%d\t%-15s\t%-23s\t%.2f\n", rows[i]->id, rows[i]->name, rows[i]->programme, rows[i]->mark);
+        }
+        else {
+            printf("%d\t(not found)\n", ids[i]);
+        }
     }
+    printf("%d of %d records found.\n", found, count);
+    snapshot_release(snap);
+    audit_log("QUERY", NULL, NULL, found == count ? "FOUND(BATCH)" : "PARTIAL(BATCH)");
+    free(rows);
+    free(ids);
 }
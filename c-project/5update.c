@@ -6,91 +6,75 @@
 #define _CRT_SECURE_NO_WARNINGS
 #include "student_db.h"
 
+// name/programme of NULL or "" and a negative mark leave that field unchanged
+int db_update(int id, const char* name, const char* programme, float mark) {
+    int i = db_find_pos(id);
+
+    if (i < 0) {
+        return -1;
+    }
+    lazy_fetch_row(i); // the old image goes to the audit log and the undo log
+
+    StudentRecord before = records[i];
+    if (txn_active() && txn_log_update(i, &before) != 0) {
+        return -1;
+    }
+    if (name != NULL && name[0] != '\0') {
+        rec_set_name(&records[i], name, NULL);
+    }
+    if (programme != NULL && programme[0] != '\0') {
+        rec_set_programme(&records[i], programme, NULL);
+    }
+    if (mark >= 0) {
+        records[i].mark = mark;
+    }
+
+    shard_touch(id);
+    arena_forget(&before, &records[i]);
+    if (!txn_active()) snapshot_publish_rows(i, i);
+    audit_log("UPDATE", &before, &records[i], "SUCCESS");
+    arena_maybe_compact();
+    return 0;
+}
+
 void updateRecord(void) {
     int searchId;
-    int i;
-    int j;
-    int found;
-    char input[MAX_NAME_LEN];
+    char name[MAX_TEXT_LEN + 1];
+    char programme[MAX_TEXT_LEN + 1];
+    char text[MAX_TEXT_LEN + 1];
     float newMark;
-    int pos;
 
     printf("Enter student ID to update: "); // prompt
-    scanf("%d", &searchId);
-    getchar();
-
-    found = 0;
-    if (index_get(searchId, &pos)) {
-        found = 1;
-        i = pos;
-    } else {
-        i = 0;
-        while (i < recordCount) {
-            if (records[i].id == searchId) {
-                found = 1;
-                break;
-            }
-            i = i + 1;
-        }
+    read_field(text);
+    if (sscanf(text, "%d", &searchId) != 1) {
+        printf("Invalid student ID.\n");
+        return;
     }
 
-    if (found == 0) { // error if record not found
+    if (db_find_pos(searchId) < 0) { // error if record not found
         printf("Record not found.\n");
         return;
     }
 
-    StudentRecord before = records[i];
     // new name
     printf("Enter new name (or press enter to skip): ");
-    fgets(input, MAX_NAME_LEN, stdin);
+    read_field(name);
 
-    if (input[0] != '\n') {
-        j = 0;
-        while (input[j] != '\0') {
-            if (input[j] == '\n') {
-                input[j] = '\0';
-                break;
-            }
-            j = j + 1;
-        }
-
-        j = 0;
-        while (input[j] != '\0') {
-            records[i].name[j] = input[j];
-            j = j + 1;
-        }
-        records[i].name[j] = '\0';
-    }
     // new programme
     printf("Enter new programme (or press enter to skip): ");
-    fgets(input, MAX_PROG_LEN, stdin);
-
-    if (input[0] != '\n') {
-        j = 0;
-        while (input[j] != '\0') {
-            if (input[j] == '\n') {
-                input[j] = '\0';
-                break;
-            }
-            j = j + 1;
-        }
-
-        j = 0;
-        while (input[j] != '\0') {
-            records[i].programme[j] = input[j];
-            j = j + 1;
-        }
-        records[i].programme[j] = '\0';
-    }
+    read_field(programme);
 
     // new mark
     printf("Enter new mark (or -1 to skip): ");
-    scanf("%f", &newMark);
+    read_field(text);
+    if (sscanf(text, "%f", &newMark) != 1) newMark = -1; // an empty line skips it too
 
-    if (newMark >= 0) {
-        records[i].mark = newMark;
+    STATS_START(t0); // the update itself, not the typing at the prompts
+    int rc = db_update(searchId, name, programme, newMark);
+    STATS_STOP(STAT_UPDATE, t0);
+    if (rc != 0) {
+        printf("Error: Out of memory. Update cancelled.\n"); // the undo log could not grow
+        return;
     }
-
     printf("Record updated successfully.\n");
-    audit_log("UPDATE", &before, &records[i], "SUCCESS");
 }
@@ -6,52 +6,69 @@
 #define _CRT_SECURE_NO_WARNINGS
 #include "student_db.h"
 
+int db_delete(int id) { // returns 0 on success, -1 if the ID does not exist
+    int i = db_find_pos(id);
+    int j;
+
+    if (i < 0) {
+        return -1;
+    }
+    lazy_fetch_row(i); // for the audit log
+
+    if (txn_active()) { // marked now, removed at COMMIT with the other deletes
+        if (txn_log_delete(i) != 0) {
+            return -1;
+        }
+        audit_log("DELETE", &records[i], NULL, "SUCCESS");
+        return 0;
+    }
+    StudentRecord gone = records[i];
+    shard_touch(id);
+    arena_forget(&gone, NULL);
+
+    j = i;
+    while (j < recordCount - 1) {
+        records[j] = records[j + 1];
+        j = j + 1;
+    }
+    recordCount = recordCount - 1;
+
+    index_rebuild(records, recordCount);
+    snapshot_publish_rows(i, recordCount - 1); // the rows after i moved up
+    audit_log("DELETE", &gone, NULL, "SUCCESS"); // after publishing, see repl.c
+    arena_maybe_compact();
+    return 0;
+}
+
 void deleteRecord(void) {
     int searchId;
-    int i;
-    int j;
-    int found;
-    char confirm;
-    int pos;
+    char text[MAX_TEXT_LEN + 1];
+    char confirm = 'n';
 
     printf("Enter student ID to delete: "); // prompt for student ID
-    scanf("%d", &searchId);
-
-    found = 0;
-    if (index_get(searchId, &pos)) {
-        found = 1;
-        i = pos;
-    } else {
-        i = 0;
-        while (i < recordCount) {
-            if (records[i].id == searchId) {
-                found = 1;
-                break;
-            }
-            i = i + 1;
-        }
+    read_field(text);
+    if (sscanf(text, "%d", &searchId) != 1) {
+        printf("Invalid student ID.\n");
+        return;
     }
 
-    if (found == 0) {
+    if (db_find_pos(searchId) < 0) {
         printf("Record not found.\n"); // error if record not found
         return;
     }
 
     printf("Are you sure you want to delete this record? (y/n): "); // prompt for confirmation
-    scanf(" %c", &confirm);
+    read_field(text);
+    sscanf(text, " %c", &confirm);
 
     if (confirm == 'y' || confirm == 'Y') { // deletion confirmation
-        audit_log("DELETE", &records[i], NULL, "SUCCESS");
-
-        j = i;
-        while (j < recordCount - 1) {
-            records[j] = records[j + 1];
-            j = j + 1;
+        STATS_START(t0); // the delete itself, not the typing at the prompts
+        int rc = db_delete(searchId);
+        STATS_STOP(STAT_DELETE, t0);
+        if (rc != 0) {
+            printf("Error: Out of memory. Deletion cancelled.\n"); // the undo log could not grow
+            return;
         }
-        recordCount = recordCount - 1;
-
-        index_rebuild(records, recordCount);
-
         printf("Record deleted successfully.\n");
     }
     else {
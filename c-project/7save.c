@@ -1,40 +1,349 @@
 /*
  * OPERATION 7: Save Function
  * This function saves the student database to the .txt file.
+ * SAVE pins the current snapshot and hands it to a background thread, so
+ * commands keep running while the rows are written. The rows go to a temporary
+ * file that is flushed to disk and only then renamed over the database, so a
+ * crash leaves either the old file or the new one, never half a file.
+ * SAVE COMPRESSED writes the same rows in the block format of compress.c to
+ * FILENAME_COMPRESSED next to the text file, which it leaves alone.
+ * SAVE INDEX also writes the snapshot's ID index to <file>.idx, tagged with
+ * the checksum of the lines written, so the next OPEN can skip the rebuild.
+ * With --shards N, SAVE writes only the shards changed since their last save,
+ * each on its own thread (shard.c).
 */
 
 #define _CRT_SECURE_NO_WARNINGS
 #include "student_db.h"
+#include <pthread.h>
+#include <stdatomic.h>
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
 
-void saveDatabase(void) {
+#define PROGRESS_EVERY 1024 // rows between progress updates
+
+typedef struct {
+    pthread_t thread;
+    DbSnapshot* snap;
+    char path[260];
+    SaveFormat format;
+    unsigned long long shards;     // sharded SAVE: the dirty shards being written
+    atomic_int state;              // SAVE_IDLE .. SAVE_FAILED
+    atomic_long rowsWritten;
+    long rowsTotal;
+    unsigned long version;
+    unsigned long long startNs;
+    unsigned long long elapsedNs;
+    int joined;
+} SaveJob;
+
+static SaveJob job = { .joined = 1 };
+
+static const char* fileHeader[] = {
+    "Database Name: Sample-CMS\n",
+    "Authors: Assistant Prof Oran Zane Devilly\n",
+    "\n",
+    "Table Name: StudentRecords\n",
+    "ID\tName\t\tProgramme\t\tMark\n"
+};
+
+typedef struct {
+    pthread_t thread;
+    const char* base;
+    const DbSnapshot* snap;
+    atomic_long* progress;
+    int shard;
+    int rc;
+} ShardSave;
+
+static int sync_file(FILE* file) { // the bytes are on disk, not just in the stdio and OS buffers
+    if (fflush(file) != 0) return -1;
+#ifdef _WIN32
+    return _commit(_fileno(file));
+#else
+    return fsync(fileno(file));
+#endif
+}
+
+// shard -1 writes every row, otherwise only the rows of that shard
+static int write_snapshot(const char* path, const DbSnapshot* snap, SaveFormat format, atomic_long* progress, int shard) {
+    TRACE_START(t0);
+    char tmp[290];
+    char line[MAX_LINE_LEN];
     FILE* file;
+    int count = snapshot_count(snap);
     int i;
+    long written = 0;
+    unsigned long long sum = 0;
 
-    file = fopen(FILENAME, "w");
+    snprintf(tmp, sizeof tmp, "%s.tmp", path);
+    file = fopen(tmp, format == FORMAT_COMPRESSED ? "wb" : "w");
 
     if (file == NULL) {
-        printf("Error saving file!\n");
-        audit_log("SAVE", NULL, NULL, "FAIL");
-        return;
+        return -1;
+    }
+    if (format == FORMAT_COMPRESSED) {
+        if (cmsz_write(file, snap, progress) != 0) {
+            fclose(file);
+            remove(tmp);
+            return -1;
+        }
+        goto finish;
     }
     // write header information
-    fprintf(file, "Database Name: Sample-CMS\n");
-    fprintf(file, "Authors: Assistant Prof Oran Zane Devilly\n");
-    fprintf(file, "\n");
-    fprintf(file, "Table Name: StudentRecords\n");
-    fprintf(file, "ID\tName\t\tProgramme\t\tMark\n");
+    for (i = 0; i < (int)(sizeof fileHeader / sizeof fileHeader[0]); i++) {
+        fputs(fileHeader[i], file);
+        sum = line_checksum(sum, fileHeader[i]);
+    }
 
     i = 0;
-    while (i < recordCount) { // writes each student record
-        fprintf(file, "%d\t%-15s\t%-23s\t%.1f\n",
-            records[i].id,
-            records[i].name,
-            records[i].programme,
-            records[i].mark);
+    while (i < count) { // writes each student record
+        const StudentRecord* r = snapshot_row(snap, i);
         i = i + 1;
+        if (shard >= 0 && shard_of(r->id) != shard) continue;
+        snprintf(line, sizeof line, "%d\t%-15s\t%-23s\t%.1f\n",
+            r->id,
+            r->name,
+            r->programme,
+            r->mark);
+        fputs(line, file);
+        sum = line_checksum(sum, line);
+        written = written + 1;
+        if (progress && written % PROGRESS_EVERY == 0) atomic_fetch_add(progress, PROGRESS_EVERY); // shards share it
+    }
+    if (progress) atomic_fetch_add(progress, written % PROGRESS_EVERY);
+
+finish:;
+    int failed = ferror(file) || sync_file(file) != 0; // before the rename, or a crash can leave the new name on a short file
+    if (fclose(file) != 0 || failed) {
+        remove(tmp);
+        return -1;
+    }
+#ifdef _WIN32
+    remove(path); // rename does not replace an existing file on Windows
+#endif
+    if (rename(tmp, path) != 0) {
+        remove(tmp);
+        return -1;
     }
+    TRACE_STOP("save.write", t0);
+    IdIndex ix = { 0 };
+    if (format == FORMAT_TEXT_INDEX && snapshot_index_copy(snap, &ix) == 0) {
+        // a failed index write only costs a rebuild at the next OPEN: the old tag no longer matches
+        TRACE_START(t1);
+        snprintf(tmp, sizeof tmp, "%s.idx", path);
+        idindex_write(&ix, tmp, count, sum);
+        TRACE_STOP("save.index", t1);
+    }
+    idindex_free(&ix);
+    return 0;
+}
 
-    fclose(file);
-    printf("Database saved successfully.\n");
+static void* shard_thread(void* arg) {
+    ShardSave* s = arg;
+    char path[280];
+    snprintf(path, sizeof path, "save shard %d", s->shard);
+    trace_thread(path);
+    shard_path(path, sizeof path, s->base, s->shard);
+    s->rc = write_snapshot(path, s->snap, FORMAT_TEXT, s->progress, s->shard);
+    return NULL;
+}
+
+static int write_shards(const char* base, const DbSnapshot* snap, unsigned long long mask, atomic_long* progress) {
+    ShardSave save[MAX_SHARDS];
+    int n = 0, rc = 0;
+    for (int k = 0; k < shard_count(); k++) {
+        if (!(mask & (1ull << k))) continue;
+        save[n].base = base;
+        save[n].snap = snap;
+        save[n].progress = progress;
+        save[n].shard = k;
+        if (pthread_create(&save[n].thread, NULL, shard_thread, &save[n]) != 0) {
+            shard_thread(&save[n]); // no thread to spare: write it here
+            save[n].thread = pthread_self();
+        }
+        n++;
+    }
+    for (int i = 0; i < n; i++) {
+        if (!pthread_equal(save[i].thread, pthread_self())) pthread_join(save[i].thread, NULL);
+        if (save[i].rc != 0) rc = -1;
+    }
+    if (rc == 0) rc = shard_write_manifest(base);
+    return rc;
+}
+
+static int write_store(const char* path, const DbSnapshot* snap, SaveFormat format, unsigned long long shards,
+    atomic_long* progress) {
+    if (format == FORMAT_TEXT && shard_count() > 0) return write_shards(path, snap, shards, progress);
+    return write_snapshot(path, snap, format, progress, -1);
+}
+
+static long rows_in_shards(const DbSnapshot* snap, unsigned long long mask) {
+    int count = snapshot_count(snap);
+    long rows = 0;
+    for (int i = 0; i < count; i++) {
+        if (mask & (1ull << shard_of(snapshot_row(snap, i)->id))) rows++;
+    }
+    return rows;
+}
+
+int db_save(const char* path, SaveFormat format) { // returns 0 on success, -1 if the file cannot be written
+    STATS_START(t0);
+    lazy_fetch_all(); // before the file the rows are read from is replaced
+    unsigned long long shards = format == FORMAT_TEXT ? shard_take_dirty() : 0;
+    DbSnapshot* snap = snapshot_acquire();
+    int rc = write_store(path, snap, format, shards, NULL);
+    snapshot_release(snap);
+
+    if (rc != 0) {
+        shard_restore_dirty(shards);
+        audit_log("SAVE", NULL, NULL, "FAIL");
+        return -1;
+    }
+    if (format == FORMAT_TEXT) shard_saved(path);
+    if (!shards) refresh_saved(path);
+    STATS_STOP(STAT_IO_SAVE, t0);
     audit_log("SAVE", NULL, NULL, "SUCCESS");
+    return 0;
+}
+
+static void* save_thread(void* arg) {
+    (void)arg;
+    trace_thread("save");
+    int rc = write_store(job.path, job.snap, job.format, job.shards, &job.rowsWritten);
+    job.elapsedNs = clock_ns() - job.startNs;
+    atomic_store(&job.state, rc == 0 ? SAVE_DONE : SAVE_FAILED);
+    return NULL;
+}
+
+// 0 if started, 1 if a sharded SAVE has nothing to write, -1 if a save is running or cannot start
+int db_save_background(const char* path, SaveFormat format) {
+    db_save_poll();
+    if (!job.joined) {
+        return -1;
+    }
+    lazy_fetch_all(); // before the file the rows are read from is replaced
+    int sharded = format == FORMAT_TEXT && shard_count() > 0;
+    if (sharded && !shard_pending()) {
+        audit_log("SAVE", NULL, NULL, "SUCCESS(UNCHANGED)");
+        return 1;
+    }
+
+    job.snap = snapshot_acquire(); // the point-in-time image, costs one reference
+    snprintf(job.path, sizeof job.path, "%s", path);
+    job.format = format;
+    job.shards = sharded ? shard_take_dirty() : 0;
+    job.rowsTotal = sharded ? rows_in_shards(job.snap, job.shards) : snapshot_count(job.snap);
+    job.version = snapshot_version(job.snap);
+    job.startNs = clock_ns();
+    job.elapsedNs = 0;
+    atomic_store(&job.rowsWritten, 0);
+    atomic_store(&job.state, SAVE_RUNNING);
+
+    if (pthread_create(&job.thread, NULL, save_thread, NULL) != 0) {
+        snapshot_release(job.snap);
+        job.snap = NULL;
+        shard_restore_dirty(job.shards);
+        atomic_store(&job.state, SAVE_FAILED);
+        audit_log("SAVE", NULL, NULL, "FAIL");
+        return -1;
+    }
+    job.joined = 0;
+    return 0;
+}
+
+static void reap_job(void) { // join the writer, then audit its outcome from the command thread
+    pthread_join(job.thread, NULL);
+    job.joined = 1;
+    snapshot_release(job.snap);
+    job.snap = NULL;
+    if (atomic_load(&job.state) == SAVE_DONE) {
+        if (job.shards) shard_saved(job.path);
+        else refresh_saved(job.path); // so REFRESH does not take our own file for a rewrite
+        stats_record(STAT_IO_SAVE, job.elapsedNs);
+        audit_log("SAVE", NULL, NULL, "SUCCESS");
+    }
+    else {
+        shard_restore_dirty(job.shards); // written again by the next SAVE
+        audit_log("SAVE", NULL, NULL, "FAIL");
+    }
+}
+
+void db_save_poll(void) {
+    if (!job.joined && atomic_load(&job.state) != SAVE_RUNNING) reap_job();
+}
+
+void db_save_wait(void) { // used at exit so a running save is never cut short
+    if (!job.joined) reap_job();
+}
+
+void db_save_status(SaveStatus* out) {
+    out->state = atomic_load(&job.state);
+    out->rowsWritten = atomic_load(&job.rowsWritten);
+    out->rowsTotal = job.rowsTotal;
+    out->version = job.version;
+    out->seconds = (out->state == SAVE_RUNNING ? clock_ns() - job.startNs : job.elapsedNs) / 1e9;
+}
+
+void saveDatabase(void) {
+    int rc = storage_save(FORMAT_TEXT);
+    if (rc < 0) {
+        if (mstore_enabled()) printf("Error saving file!\n");
+        else printf("A save is already in progress. Use SAVE STATUS to check on it.\n");
+        return;
+    }
+    if (mstore_enabled()) {
+        printf("Database saved successfully.\n");
+        return;
+    }
+    if (rc == 1) {
+        printf("No shard has changed since the last save.\n");
+        return;
+    }
+    if (job.shards) {
+        int written = 0;
+        for (unsigned long long m = job.shards; m; m &= m - 1) written++;
+        printf("Saving %ld records (%d of %d shards changed) in the background. Use SAVE STATUS to check on it.\n",
+            job.rowsTotal, written, shard_count());
+        return;
+    }
+    printf("Saving %ld records in the background. Use SAVE STATUS to check on it.\n", job.rowsTotal);
+}
+
+void saveCompressed(void) {
+    if (storage_save(FORMAT_COMPRESSED) < 0) {
+        printf("A save is already in progress. Use SAVE STATUS to check on it.\n");
+        return;
+    }
+    printf("Saving %ld records to '%s' in compressed form. Use SAVE STATUS to check on it.\n", job.rowsTotal, FILENAME_COMPRESSED);
+}
+
+void saveWithIndex(void) {
+    if (storage_save(FORMAT_TEXT_INDEX) < 0) {
+        printf("A save is already in progress. Use SAVE STATUS to check on it.\n");
+        return;
+    }
+    printf("Saving %ld records and the ID index to '%s.idx' in the background. Use SAVE STATUS to check on it.\n", job.rowsTotal, FILENAME);
+}
+
+void showSaveStatus(void) {
+    SaveStatus st;
+    db_save_status(&st);
+
+    if (st.state == SAVE_IDLE) {
+        printf("No save has been started in this session.\n");
+    }
+    else if (st.state == SAVE_RUNNING) {
+        printf("Saving: %ld of %ld records written (%.0f%%), %.1f s so far.\n", st.rowsWritten, st.rowsTotal,
+            st.rowsTotal ? 100.0 * st.rowsWritten / st.rowsTotal : 100.0, st.seconds);
+    }
+    else if (st.state == SAVE_DONE) {
+        printf("Last save completed: %ld records (version %lu) in %.3f s.\n", st.rowsTotal, st.version, st.seconds);
+    }
+    else {
+        printf("Last save FAILED after %.3f s; the previous file was left unchanged.\n", st.seconds);
+    }
 }
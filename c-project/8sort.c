@@ -1,6 +1,9 @@
 /*
  * OPERATION 8: Sort Function
- * This function sorts the student records by ID or mark, in ascending order.
+ * This function sorts the student records by one or more columns
+ * (SHOW ALL SORT BY PROGRAMME, MARK DESC, NAME), each ascending or descending.
+ * Each row's sort columns are encoded into one binary key up front, so the
+ * sort compares keys with memcmp instead of calling a comparator per field.
 */
 
 #define _CRT_SECURE_NO_WARNINGS
@@ -9,26 +12,171 @@
 #include <string.h>
 #include <ctype.h>
 
-static int cmp_record_id_asc(const void* a, const void* b) {
-    const StudentRecord* A = a;
-    const StudentRecord* B = b;
-    return (A->id < B->id) ? -1 : (A->id > B->id) ? 1 : 0;
+static const char* fieldNames[] = { "ID", "NAME", "PROGRAMME", "MARK" };
+
+// The sort never compares fields: each row's SORT BY columns are encoded once into a
+// fixed-width key whose byte order is the wanted order, followed by its row number (so
+// keys are unique and equal rows keep their order). The keys are then radix sorted
+// 8 bytes at a time, most significant first; only groups smaller than RADIX_MIN are
+// finished with memcmp. SORT only runs on the command thread, so the keys and the
+// counters are file-scope.
+#define RADIX_MIN 32
+
+typedef struct {
+    unsigned long long head; // the 8 key bytes being sorted on, big-endian
+    unsigned row;
+} SortEntry;
+
+static const unsigned char* sortKeys;
+static size_t sortWidth;
+static unsigned radixCount[8][256];
+
+static unsigned long long get_u64(const unsigned char* p) {
+    unsigned long long v = 0;
+    for (int i = 0; i < 8; i++) v = (v << 8) | p[i];
+    return v;
+}
+
+static const unsigned char* key_of(const SortEntry* e) {
+    return sortKeys + (size_t)e->row * sortWidth;
+}
+
+static void insertion_sort(SortEntry* v, int n, size_t depth) { // head holds bytes depth..depth+7
+    for (int i = 1; i < n; i++) {
+        SortEntry e = v[i];
+        int j = i;
+        while (j > 0 && (v[j - 1].head > e.head || (v[j - 1].head == e.head &&
+            memcmp(key_of(&v[j - 1]) + depth + 8, key_of(&e) + depth + 8, sortWidth - depth - 8) > 0))) {
+            v[j] = v[j - 1];
+            j--;
+        }
+        v[j] = e;
+    }
+}
+
+static void radix_sort(SortEntry* v, SortEntry* tmp, int n, size_t depth) {
+    if (n < RADIX_MIN) {
+        insertion_sort(v, n, depth);
+        return;
+    }
+    memset(radixCount, 0, sizeof radixCount);
+    for (int i = 0; i < n; i++) {
+        for (int b = 0; b < 8; b++) radixCount[b][(v[i].head >> (8 * b)) & 0xFF]++;
+    }
+    SortEntry* from = v;
+    SortEntry* to = tmp;
+    for (int b = 0; b < 8; b++) { // least significant byte first; a byte every key shares is skipped
+        unsigned* count = radixCount[b];
+        if (count[(v[0].head >> (8 * b)) & 0xFF] == (unsigned)n) continue;
+        unsigned at = 0;
+        for (int d = 0; d < 256; d++) {
+            unsigned c = count[d];
+            count[d] = at;
+            at += c;
+        }
+        for (int i = 0; i < n; i++) to[count[(from[i].head >> (8 * b)) & 0xFF]++] = from[i];
+        SortEntry* swap = from;
+        from = to;
+        to = swap;
+    }
+    if (from != v) memcpy(v, from, (size_t)n * sizeof *v);
+    if (depth + 8 >= sortWidth) return;
+
+    for (int i = 0; i < n;) { // groups with the same 8 bytes go on with the next 8
+        int j = i + 1;
+        while (j < n && v[j].head == v[i].head) j++;
+        if (j - i > 1) {
+            for (int k = i; k < j; k++) v[k].head = get_u64(key_of(&v[k]) + depth + 8);
+            radix_sort(v + i, tmp + i, j - i, depth + 8);
+        }
+        i = j;
+    }
+}
+
+static void put_u32(unsigned char* p, unsigned v) { // big-endian, so memcmp orders it as a number
+    p[0] = (unsigned char)(v >> 24);
+    p[1] = (unsigned char)(v >> 16);
+    p[2] = (unsigned char)(v >> 8);
+    p[3] = (unsigned char)v;
 }
 
-static int cmp_record_mark_asc(const void* a, const void* b) {
-    const StudentRecord* A = a;
-    const StudentRecord* B = b;
-    return (A->mark < B->mark) ? -1 : (A->mark > B->mark) ? 1 : 0;
+static size_t column_width(SortField field, const StudentRecord* rows, int n) { // strings: the longest plus its NUL
+    size_t longest = MAX_TEXT_LEN;
+    if (field == SORT_ID || field == SORT_MARK) return 4;
+    if (rows) longest = 0;
+    for (int i = 0; i < n; i++) {
+        size_t len = strlen(field == SORT_NAME ? rows[i].name : rows[i].programme);
+        if (len > longest) longest = len;
+    }
+    return longest + 1;
+}
+
+// rows NULL: strings get room for MAX_TEXT_LEN bytes, so keys of rows not seen yet compare too (extsort.c)
+void sort_layout(SortLayout* l, const SortKey* keys, int count, const StudentRecord* rows, int n) {
+    size_t used = 0;
+    l->count = count;
+    for (int k = 0; k < count; k++) {
+        l->keys[k] = keys[k];
+        l->widths[k] = column_width(keys[k].field, rows, n);
+        used += l->widths[k];
+    }
+    l->width = (used + 8 + 7) / 8 * 8; // the sequence number, and whole 8-byte words for the radix sort
 }
 
-static void reverse_records_inplace(void) {
-    for (int i = 0, j = recordCount - 1; i < j; ++i, --j) {
-        StudentRecord tmp = records[i];
-        records[i] = records[j];
-        records[j] = tmp;
+static void encode_column(unsigned char* p, const StudentRecord* r, SortField field, size_t width) {
+    unsigned u;
+    const char* text;
+    switch (field) {
+    case SORT_ID:
+        put_u32(p, (unsigned)r->id ^ 0x80000000u); // flipping the sign bit puts negatives first
+        return;
+    case SORT_MARK:
+        memcpy(&u, &r->mark, sizeof u);
+        if (r->mark == 0.0f) u = 0; // -0 equals 0
+        put_u32(p, (u & 0x80000000u) ? ~u : u | 0x80000000u); // IEEE bits in numeric order
+        return;
+    default:
+        text = field == SORT_NAME ? r->name : r->programme;
+        size_t n = strlen(text);
+        memcpy(p, text, n);
+        memset(p + n, 0, width - n); // a shorter string sorts first, as with strcmp
+        return;
     }
 }
 
+// seq breaks ties (the row's position), so no two keys are equal
+void sort_encode(const SortLayout* l, unsigned char* key, const StudentRecord* r, unsigned long long seq) {
+    unsigned char* p = key;
+    for (int k = 0; k < l->count; k++) {
+        encode_column(p, r, l->keys[k].field, l->widths[k]);
+        if (l->keys[k].desc) {
+            for (size_t j = 0; j < l->widths[k]; j++) p[j] = (unsigned char)~p[j];
+        }
+        p += l->widths[k];
+    }
+    memset(p, 0, (size_t)(key + l->width - 8 - p));
+    put_u32(key + l->width - 8, (unsigned)(seq >> 32));
+    put_u32(key + l->width - 4, (unsigned)seq);
+}
+
+// order gets 0..n-1 in key order; 0, or -1 when out of memory
+int sort_keys(const unsigned char* keys, size_t width, int n, unsigned* order) {
+    SortEntry* v = malloc((size_t)(n ? n : 1) * 2 * sizeof *v); // and the radix buffer
+    if (!v) return -1;
+    TRACE_START(t0);
+    for (int i = 0; i < n; i++) {
+        v[i].head = get_u64(keys + (size_t)i * width);
+        v[i].row = (unsigned)i;
+    }
+    sortKeys = keys;
+    sortWidth = width;
+    radix_sort(v, v + n, n, 0);
+    for (int i = 0; i < n; i++) order[i] = v[i].row;
+    free(v);
+    TRACE_STOP("sort.keys", t0);
+    return 0;
+}
+
 static void trim_newline(char* s) {
     size_t n = strlen(s);
     while (n && (s[n - 1] == '\n' || s[n - 1] == '\r')) s[--n] = '\0';
@@ -38,8 +186,98 @@ static void strtoupper(char* s) {
     for (; *s; ++s) *s = (char)toupper((unsigned char)*s);
 }
 
+// "PROGRAMME, MARK DESC, NAME": fields separated by commas or blanks, each optionally
+// followed by ASC or DESC. Returns the number of keys, or -1 for an unknown word.
+int db_parse_sort(const char* spec, SortKey* keys) {
+    char word[16];
+    int count = 0;
+    const char* p = spec;
+    while (*p) {
+        size_t n = 0;
+        while (*p && (isspace((unsigned char)*p) || *p == ',' || *p == '[' || *p == ']')) p++;
+        while (*p && !isspace((unsigned char)*p) && *p != ',' && *p != '[' && *p != ']') {
+            if (n < sizeof word - 1) word[n++] = (char)toupper((unsigned char)*p);
+            p++;
+        }
+        word[n] = '\0';
+        if (n == 0) break;
+
+        if (strcmp(word, "ASC") == 0 || strcmp(word, "DESC") == 0) {
+            if (count == 0) return -1;
+            keys[count - 1].desc = word[0] == 'D';
+            continue;
+        }
+        int field = -1;
+        for (int f = 0; f < 4; f++) {
+            if (strcmp(word, fieldNames[f]) == 0) field = f;
+        }
+        if (strcmp(word, "PROGRAM") == 0) field = SORT_PROGRAMME;
+        if (field < 0 || count == MAX_SORT_KEYS) return -1;
+        keys[count].field = (SortField)field;
+        keys[count].desc = 0;
+        count++;
+    }
+    return count;
+}
+
+int db_sort_by(const SortKey* keys, int count) { // returns 0, or -1 when out of memory (order unchanged)
+    SortLayout layout;
+    char status[96];
+    int len = 0;
+
+    for (int k = 0; k < count; k++) {
+        len += snprintf(status + len, sizeof status - (size_t)len, "%s%s %s", k ? ", " : "",
+            fieldNames[keys[k].field], keys[k].desc ? "DESC" : "ASC");
+        if (keys[k].field == SORT_NAME || keys[k].field == SORT_PROGRAMME) lazy_fetch_all();
+    }
+    sort_layout(&layout, keys, count, records, recordCount);
+
+    size_t rows = (size_t)(recordCount ? recordCount : 1);
+    unsigned char* keyBuf = malloc(rows * layout.width);
+    unsigned* order = malloc(rows * sizeof *order);
+    int swap = !mstore_active(); // the sorted copy becomes records[]; a mapping is copied back into
+    StudentRecord* sorted = malloc((swap && recordCapacity ? (size_t)recordCapacity : rows) * sizeof *sorted);
+    TRACE_START(t0);
+    if (keyBuf) {
+        for (int i = 0; i < recordCount; i++) sort_encode(&layout, keyBuf + (size_t)i * layout.width, &records[i], (unsigned long long)i);
+    }
+    TRACE_STOP("sort.encode", t0);
+    if (!keyBuf || !order || !sorted || sort_keys(keyBuf, layout.width, recordCount, order) != 0) {
+        free(keyBuf);
+        free(order);
+        free(sorted);
+        audit_log("SORT", NULL, NULL, "FAIL(NO_MEMORY)");
+        return -1;
+    }
+
+    TRACE_START(t1);
+    for (int i = 0; i < recordCount; i++) sorted[i] = records[order[i]];
+    if (swap) {
+        StudentRecord* old = records;
+        records = sorted;
+        sorted = old;
+    }
+    else {
+        memcpy(records, sorted, (size_t)recordCount * sizeof *records);
+    }
+    TRACE_STOP("sort.permute", t1);
+    free(keyBuf);
+    free(order);
+    free(sorted);
+
+    index_rebuild(records, recordCount);
+    snapshot_publish();
+    audit_log("SORT", NULL, NULL, status);
+    return 0;
+}
+
+void db_sort(int byId, int desc) { // sort by ID (byId != 0) or MARK, ascending unless desc
+    SortKey key = { byId ? SORT_ID : SORT_MARK, desc };
+    db_sort_by(&key, 1);
+}
+
 void sortRecords(void) {
-    if (recordCount == 0) {
+    if (recordCount == 0 && !repl_is_follower()) { // a replica only loads what its primary sends
         printf("No records loaded. Opening database...\n");
         openDatabase();
         if (recordCount == 0) {
@@ -47,7 +285,8 @@ void sortRecords(void) {
         }
     }
     char line[256], up[256];
-    printf("Commands:\n  SHOW ALL SORT BY ID [DESC]\n  SHOW ALL SORT BY MARK [DESC]\n  EXIT\n");
+    printf("Commands:\n  SHOW ALL SORT BY <field> [DESC], ...   fields: ID, NAME, PROGRAMME, MARK\n");
+    printf("  e.g. SHOW ALL SORT BY PROGRAMME, MARK DESC, NAME\n  EXIT\n");
     while (1) {
         printf("> ");
         if (!fgets(line, sizeof line, stdin)) break;
@@ -57,27 +296,18 @@ void sortRecords(void) {
         strtoupper(up);
         if (strcmp(up, "EXIT") == 0 || strcmp(up, "QUIT") == 0) break;
         char* pos = strstr(up, "SORT BY");
-        if (!pos) { puts("Unrecognized command. Use 'SHOW ALL SORT BY ID|MARK [DESC]'."); continue; }
+        if (!pos) { puts("Unrecognized command. Use 'SHOW ALL SORT BY <field> [DESC], ...'."); continue; }
         pos += strlen("SORT BY");
         while (isspace((unsigned char)*pos)) ++pos;
-        char field[16] = { 0 }, order[16] = { 0 };
-        char* tok = strtok(pos, " \t[]"); if (tok) { strncpy(field, tok, sizeof field - 1); field[sizeof field - 1] = '\0'; }
-        tok = strtok(NULL, " \t[]"); if (tok) { strncpy(order, tok, sizeof order - 1); order[sizeof order - 1] = '\0'; }
-        int byId = (strcmp(field, "ID") == 0);
-        int byMark = (strcmp(field, "MARK") == 0);
-        if (!byId && !byMark) { printf("Unknown sort field '%s'. Use ID or MARK.\n", field); continue; }
-        int desc = (strcmp(order, "DESC") == 0);
+        SortKey keys[MAX_SORT_KEYS];
+        int count = db_parse_sort(pos, keys);
+        if (count <= 0) { printf("Unknown sort order '%s'. Use up to %d of ID, NAME, PROGRAMME, MARK, each with ASC or DESC.\n", pos, MAX_SORT_KEYS); continue; }
         if (recordCount == 0) { puts("No records to sort."); continue; }
 
-        qsort(records, recordCount, sizeof records[0], byId ? cmp_record_id_asc : cmp_record_mark_asc);
-        if (desc) reverse_records_inplace();
-
-        index_rebuild(records, recordCount);
-
-        char status[32];
-        snprintf(status, sizeof status, "%s %s", byId ? "ID" : "MARK", desc ? "DESC" : "ASC");
-        audit_log("SORT", NULL, NULL, status);
-
+        STATS_START(t0); // the sort itself, not the typing at the prompt
+        int rc = db_sort_by(keys, count);
+        STATS_STOP(STAT_SORT, t0);
+        if (rc != 0) { puts("Not enough memory to sort."); continue; }
         showAll();
     }
 }
@@ -2,42 +2,111 @@
  * OPERATION 9: Summary Function
  * This function displays summary statistics of the student records.
  * The summary includes total number of students, average mark, highest mark, and lowest mark.
+ * Statistics are computed from the current snapshot, or from records[] for the session
+ * inside a transaction, so it counts its own uncommitted changes.
+ * SUMMARY APPROX (sketch.c) estimates percentiles, distinct counts and top programmes instead.
 */
 
+#define _CRT_SECURE_NO_WARNINGS
 #include "student_db.h"
+#include <string.h>
 
-void showSummary(void) {
-    if (recordCount == 0) {
-        printf("No records loaded. Opening database...\n");
-        openDatabase();
-        if (recordCount == 0) {
-            printf("Still no records found.\n");
-            return;
-        }
+static int summary_txn(SummaryStats* out) { // records[] minus the rows this transaction deleted
+    const StudentRecord* high = NULL;
+    const StudentRecord* low = NULL;
+    float total = 0;
+    int count = 0;
+
+    for (int i = 0; i < recordCount; i++) {
+        if (txn_row_deleted(i)) continue;
+        const StudentRecord* r = &records[i];
+        total += r->mark;
+        if (high == NULL || r->mark > high->mark) high = r;
+        if (low == NULL || r->mark < low->mark) low = r;
+        count++;
+    }
+    if (count == 0) {
+        return -1;
+    }
+
+    out->count = count;
+    out->average = total / count;
+    out->highest = high->mark;
+    out->lowest = low->mark;
+    snprintf(out->highName, sizeof out->highName, "%s", high->name);
+    snprintf(out->lowName, sizeof out->lowName, "%s", low->name);
+    return 0;
+}
+
+int db_summary(SummaryStats* out, int ownTxn) { // returns 0, or -1 when there are no rows to summarise
+    if (ownTxn && txn_active()) { // txn_begin fetched every lazy row already
+        return summary_txn(out);
+    }
+
+    DbSnapshot* snap = snapshot_acquire();
+    int count = snapshot_count(snap);
+    if (count == 0) {
+        snapshot_release(snap);
+        return -1;
     }
 
+    const StudentRecord* first = snapshot_row(snap, 0);
     float total = 0;
-    float highest = records[0].mark;
-    float lowest = records[0].mark;
+    float highest = first->mark;
+    float lowest = first->mark;
     int highIndex = 0, lowIndex = 0;
 
-    for (int i = 0; i < recordCount; i++) {
-        total += records[i].mark;
-        if (records[i].mark > highest) {
-            highest = records[i].mark;
+    for (int i = 0; i < count; i++) {
+        const StudentRecord* r = snapshot_row(snap, i);
+        total += r->mark;
+        if (r->mark > highest) {
+            highest = r->mark;
             highIndex = i;
         }
-        if (records[i].mark < lowest) {
-            lowest = records[i].mark;
+        if (r->mark < lowest) {
+            lowest = r->mark;
             lowIndex = i;
         }
     }
 
+    out->count = count;
+    out->average = total / count;
+    out->highest = highest;
+    out->lowest = lowest;
+    if (lazy_pending() > 0) { // --lazy: only these two names are needed
+        int ids[2] = { snapshot_row(snap, highIndex)->id, snapshot_row(snap, lowIndex)->id };
+        snapshot_release(snap);
+        lazy_fetch(ids, 2);
+        snap = snapshot_acquire(); // the same rows at the same positions, with the two names parsed
+    }
+    snprintf(out->highName, sizeof out->highName, "%s", snapshot_row(snap, highIndex)->name);
+    snprintf(out->lowName, sizeof out->lowName, "%s", snapshot_row(snap, lowIndex)->name);
+    snapshot_release(snap);
+    return 0;
+}
+
+void showSummary(void) {
+    SummaryStats st;
+
+    if (recordCount == 0 && !repl_is_follower()) { // a replica only loads what its primary sends
+        printf("No records loaded. Opening database...\n");
+        openDatabase();
+        if (recordCount == 0) {
+            printf("Still no records found.\n");
+            return;
+        }
+    }
+
+    if (db_summary(&st, txn_active()) != 0) {
+        printf("Still no records found.\n");
+        return;
+    }
+
     printf("\n=== Summary Statistics ===\n");
-    printf("Total students: %d\n", recordCount);
-    printf("Average mark: %.2f\n", total / recordCount);
-    printf("Highest mark: %.2f (%s)\n", highest, records[highIndex].name);
-    printf("Lowest mark: %.2f (%s)\n", lowest, records[lowIndex].name);
+    printf("Total students: %d\n", st.count);
+    printf("Average mark: %.2f\n", st.average);
+    printf("Highest mark: %.2f (%s)\n", st.highest, st.highName);
+    printf("Lowest mark: %.2f (%s)\n", st.lowest, st.lowName);
 
     audit_log("SUMMARY", NULL, NULL, "SUCCESS");
 }
@@ -0,0 +1,279 @@
+/*
+ *This file contains the string storage for names and programmes.
+ *In the default build a record keeps both strings in fixed arrays of
+ *MAX_NAME_LEN / MAX_PROG_LEN bytes. Built with -DCMS_STRING_ARENA, a record only
+ *points at its strings, which are packed end to end in an arena:
+ *  - strings are bump-allocated in large blocks, so a record costs 24 bytes plus
+ *    the bytes its strings really use (up to MAX_TEXT_LEN each, never truncated to 39)
+ *  - the blocks of one table belong to a generation; OPEN starts a new generation
+ *    and the old one is freed in one go once no snapshot still uses it
+ *  - UPDATE and DELETE leave the old strings behind; when they outweigh the live
+ *    ones, the live strings are copied into a fresh generation (compaction)
+ *Snapshots pin the generation their rows point into (snapshot.c), so readers and
+ *a background SAVE never see freed strings. The arena build cannot use --mmap,
+ *whose file holds the records themselves.
+*/
+
+#define _CRT_SECURE_NO_WARNINGS
+#include "student_db.h"
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef CMS_STRING_ARENA
+
+#define ARENA_BLOCK (256 * 1024)        // bytes per block
+#define COMPACT_MIN (1024 * 1024)       // below this much garbage, compaction is not worth a full pass
+
+typedef struct ArenaBlock {
+    struct ArenaBlock* next;
+    size_t size;
+    size_t used;
+    char data[];
+} ArenaBlock;
+
+struct StrPool { // one generation of strings
+    atomic_int refs;          // the table's reference plus one per snapshot
+    ArenaBlock* blocks;       // newest first
+    size_t bytes;             // string bytes stored, NULs included
+    size_t reserved;          // block bytes allocated
+    int nblocks;
+};
+
+static StrPool* table = NULL;   // generation records[] points into
+static size_t garbage = 0;      // bytes of table no longer referenced (approximate)
+static int compactions = 0;
+
+StrPool* pool_new(void) {
+    StrPool* p = calloc(1, sizeof *p);
+    if (p) atomic_init(&p->refs, 1);
+    return p;
+}
+
+static void pool_free(StrPool* p) {
+    while (p->blocks) {
+        ArenaBlock* next = p->blocks->next;
+        free(p->blocks);
+        p->blocks = next;
+    }
+    free(p);
+}
+
+static StrPool* table_pool(void) {
+    if (!table) table = pool_new();
+    return table;
+}
+
+static const char* pool_put(StrPool* p, const char* s) { // NULL when out of memory
+    size_t n = strnlen(s, MAX_TEXT_LEN);
+    ArenaBlock* b = p->blocks;
+    if (!b || b->size - b->used < n + 1) {
+        size_t size = n + 1 > ARENA_BLOCK ? n + 1 : ARENA_BLOCK;
+        b = malloc(sizeof *b + size);
+        if (!b) return NULL;
+        b->size = size;
+        b->used = 0;
+        b->next = p->blocks;
+        p->blocks = b;
+        p->reserved += size;
+        p->nblocks++;
+    }
+    char* out = b->data + b->used;
+    memcpy(out, s, n);
+    out[n] = '\0';
+    b->used += n + 1;
+    p->bytes += n + 1;
+    return out;
+}
+
+static const char* arena_store(StrPool* pool, const char* s) { // NULL pool: the table's generation
+    StrPool* p = pool ? pool : table_pool();
+    const char* out = p ? pool_put(p, s) : NULL;
+    return out ? out : ""; // out of memory: the row keeps an empty field rather than failing the load
+}
+
+void arena_adopt(StrPool* pool) { // a loader thread's strings join the table's generation
+    StrPool* t = table_pool();
+    if (!pool) return;
+    if (!t) { // keep them alive anyway
+        table = pool;
+        return;
+    }
+    ArenaBlock* last = pool->blocks;
+    if (last) {
+        while (last->next) last = last->next;
+        last->next = t->blocks; // t keeps bumping into pool's newest block, which is fine
+        t->blocks = pool->blocks;
+    }
+    t->bytes += pool->bytes;
+    t->reserved += pool->reserved;
+    t->nblocks += pool->nblocks;
+    free(pool);
+}
+
+void* arena_pin(void) {
+    StrPool* t = table_pool();
+    if (t) atomic_fetch_add(&t->refs, 1);
+    return t;
+}
+
+void arena_unpin(void* gen) {
+    StrPool* p = gen;
+    if (p && atomic_fetch_sub(&p->refs, 1) == 1) pool_free(p);
+}
+
+void arena_reset(void) { // OPEN: records[] is about to be refilled
+    arena_unpin(table);  // freed now, or by the last snapshot that still pins it
+    table = NULL;
+    garbage = 0;
+}
+
+void arena_forget(const StudentRecord* old, const StudentRecord* now) { // strings of old that now no longer uses
+    if (!now || old->name != now->name) garbage += strlen(old->name) + 1;
+    if (!now || old->programme != now->programme) garbage += strlen(old->programme) + 1;
+}
+
+int arena_compact(void) { // copy the live strings into a fresh generation; 0 done, -1 out of memory
+    StrPool* fresh = pool_new();
+    const char** moved = malloc((size_t)(recordCount ? recordCount : 1) * 2 * sizeof *moved);
+    if (!fresh || !moved) {
+        free(fresh);
+        free(moved);
+        return -1;
+    }
+    for (int i = 0; i < recordCount; i++) {
+        moved[2 * i] = pool_put(fresh, records[i].name);
+        moved[2 * i + 1] = pool_put(fresh, records[i].programme);
+        if (!moved[2 * i] || !moved[2 * i + 1]) { // keep the old generation
+            pool_free(fresh);
+            free(moved);
+            return -1;
+        }
+    }
+    for (int i = 0; i < recordCount; i++) {
+        records[i].name = moved[2 * i];
+        records[i].programme = moved[2 * i + 1];
+    }
+    free(moved);
+
+    StrPool* old = table;
+    table = fresh;
+    garbage = 0;
+    compactions++;
+    snapshot_publish(); // the next version pins fresh; readers of the last one keep old
+    arena_unpin(old);
+    return 0;
+}
+
+void arena_maybe_compact(void) { // after UPDATE, DELETE and COMMIT
+    if (txn_active() || !table) return; // the undo log still points at the old strings
+    if (garbage < COMPACT_MIN || garbage < table->bytes - garbage) return;
+    arena_compact();
+}
+
+void arena_usage(ArenaUsage* out) {
+    memset(out, 0, sizeof *out);
+    out->arena = 1;
+    out->compactions = compactions;
+    if (!table) return;
+    out->blocks = table->nblocks;
+    out->reserved = (long long)table->reserved;
+    out->used = (long long)table->bytes;
+    out->garbage = (long long)(garbage < table->bytes ? garbage : table->bytes);
+}
+
+void rec_set_name(StudentRecord* rec, const char* s, StrPool* pool) {
+    rec->name = arena_store(pool, s);
+}
+
+void rec_set_programme(StudentRecord* rec, const char* s, StrPool* pool) {
+    rec->programme = arena_store(pool, s);
+}
+
+#else // fixed arrays: the arena calls do nothing
+
+StrPool* pool_new(void) {
+    return NULL;
+}
+
+void arena_adopt(StrPool* pool) {
+    (void)pool;
+}
+
+void* arena_pin(void) {
+    return NULL;
+}
+
+void arena_unpin(void* gen) {
+    (void)gen;
+}
+
+void arena_reset(void) {
+}
+
+void arena_forget(const StudentRecord* old, const StudentRecord* now) {
+    (void)old;
+    (void)now;
+}
+
+int arena_compact(void) {
+    return 0;
+}
+
+void arena_maybe_compact(void) {
+}
+
+void arena_usage(ArenaUsage* out) {
+    memset(out, 0, sizeof *out);
+}
+
+void rec_set_name(StudentRecord* rec, const char* s, StrPool* pool) {
+    (void)pool;
+    snprintf(rec->name, sizeof rec->name, "%s", s);
+}
+
+void rec_set_programme(StudentRecord* rec, const char* s, StrPool* pool) {
+    (void)pool;
+    snprintf(rec->programme, sizeof rec->programme, "%s", s);
+}
+
+#endif
+
+void showMemory(void) { // MEMORY: what the table costs and what the other layout would cost
+    ArenaUsage u;
+    long long hashBytes, staticBytes;
+    long long text = 0;
+    DbSnapshot* snap = snapshot_acquire();
+    int count = snapshot_count(snap);
+
+    for (int i = 0; i < count; i++) { // string bytes the rows use, NULs included
+        const StudentRecord* r = snapshot_row(snap, i);
+        text += (long long)strlen(r->name) + strlen(r->programme) + 2;
+    }
+    snapshot_release(snap);
+    arena_usage(&u);
+    index_memory(&hashBytes, &staticBytes);
+
+    long long fixedRow = (long long)sizeof(int) + MAX_NAME_LEN + MAX_PROG_LEN + (long long)sizeof(float);
+    long long arenaRow = (long long)sizeof(int) + (long long)sizeof(float) + 2 * (long long)sizeof(char*);
+    long long fixedTotal = count * fixedRow;
+    long long arenaTotal = count * arenaRow + text;
+
+    printf("\n=== Memory Footprint (%d rows) ===\n", count);
+    printf("records[]      : %d of %d slots x %d bytes = %.1f KB\n", recordCount, recordCapacity,
+        (int)sizeof(StudentRecord), (double)recordCapacity * sizeof(StudentRecord) / 1024.0);
+    if (u.arena) {
+        printf("string arena   : %.1f KB stored in %d blocks (%.1f KB reserved), %.1f KB garbage, %d compactions\n",
+            u.used / 1024.0, u.blocks, u.reserved / 1024.0, u.garbage / 1024.0, u.compactions);
+    }
+    printf("ID index       : %.1f KB\n", (hashBytes + staticBytes) / 1024.0);
+    if (lazy_pending() > 0) {
+        printf("not parsed yet : %d rows (--lazy), not counted in the text below\n", lazy_pending());
+    }
+    printf("Rows with fixed %d-byte strings: %.1f KB\n", MAX_NAME_LEN, fixedTotal / 1024.0);
+    printf("Rows with arena strings        : %.1f KB (%lld bytes per row + %.1f KB of text)\n",
+        arenaTotal / 1024.0, arenaRow, text / 1024.0);
+    if (fixedTotal > 0) {
+        printf("The arena layout takes %.0f%% of the fixed one.%s\n", 100.0 * arenaTotal / fixedTotal,
+            u.arena ? "" : " Build with -DCMS_STRING_ARENA to use it.");
+    }
+}
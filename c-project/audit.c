@@ -2,15 +2,24 @@
  *This file contains the audit log function.
  *Append-only file with timestamps and before/after snapshots
  *Commands logged will appear in audit_log.txt
+ *Inside a transaction the entries are held in memory and written between
+ *BEGIN and COMMIT/ROLLBACK lines with a single flush (group commit).
+ *Every entry is also handed to repl_record(), which ships the changes to replicas,
+ *and to sketch_record(), which keeps the SUMMARY APPROX sketches current.
 */
 
 
 #define _CRT_SECURE_NO_WARNINGS
 #include "student_db.h"
 #include <time.h>
+#include <stdlib.h>
 #include <string.h>
 
 static FILE* audit_fp = NULL;
+static int grouping = 0;
+static char* group = NULL;
+static size_t groupLen = 0;
+static size_t groupCap = 0;
 
 void audit_open(void) {
     if (!audit_fp) audit_fp = fopen("audit_log.txt", "a");
@@ -38,15 +47,62 @@ static void fmt_rec(const StudentRecord* s, char* out, size_t n) {
              s->id, s->name, s->programme, s->mark);
 }
 
+static int group_append(const char* line) {
+    size_t n = strlen(line);
+    if (groupLen + n > groupCap) {
+        size_t cap = groupCap ? groupCap * 2 : 4096;
+        while (cap < groupLen + n) cap *= 2;
+        char* grown = realloc(group, cap);
+        if (!grown) return -1;
+        group = grown;
+        groupCap = cap;
+    }
+    memcpy(group + groupLen, line, n);
+    groupLen += n;
+    return 0;
+}
+
 void audit_log(const char* op,
                const StudentRecord* before_opt,
                const StudentRecord* after_opt,
                const char* status) {
+    repl_record(op, before_opt, after_opt, status); // the same images go to any replicas
+    sketch_record(op, before_opt, after_opt, status);
     if (!audit_fp) return;
-    char T[32], B[160], A[160];
+    STATS_START(t0);
+    char T[32], B[MAX_LINE_LEN], A[MAX_LINE_LEN], L[2 * MAX_LINE_LEN + 80];
     ts_now(T, sizeof T);
     fmt_rec(before_opt, B, sizeof B);
     fmt_rec(after_opt, A, sizeof A);
-    fprintf(audit_fp, "[%s] %s %s -> %s : %s\n", T, op, B, A, status);
+    snprintf(L, sizeof L, "[%s] %s %s -> %s : %s\n", T, op, B, A, status);
+    if (grouping && group_append(L) == 0) {
+        STATS_STOP(STAT_IO_AUDIT, t0);
+        return; // written at the end of the transaction
+    }
+    TRACE_START(t1);
+    fputs(L, audit_fp);
+    fflush(audit_fp);
+    TRACE_STOP("audit.write", t1);
+    STATS_STOP(STAT_IO_AUDIT, t0);
+}
+
+void audit_begin_group(void) {
+    repl_begin_group();
+    grouping = 1;
+    groupLen = 0;
+    audit_log("BEGIN", NULL, NULL, "TXN");
+}
+
+void audit_end_group(int committed) { // one write and one flush for the whole transaction
+    audit_log(committed ? "COMMIT" : "ROLLBACK", NULL, NULL, "TXN"); // still buffered
+    repl_end_group(committed);
+    grouping = 0;
+    if (!audit_fp || groupLen == 0) return;
+    STATS_START(t0);
+    TRACE_START(t1);
+    fwrite(group, 1, groupLen, audit_fp);
     fflush(audit_fp);
+    groupLen = 0;
+    TRACE_STOP("audit.flush", t1);
+    STATS_STOP(STAT_IO_AUDIT, t0);
 }
@@ -0,0 +1,950 @@
+/*
+ *This file contains the benchmark suite (cms_bench).
+ *It times every operation on synthetic tables of 1K, 100K, 1M and 10M records and
+ *prints one JSON object per line (ns/op, percentiles, throughput), so results from
+ *two builds can be diffed line by line to spot regressions.
+ *
+ *TO BUILD: gcc -O2 -o cms_bench bench.c 1open.c 2showall.c 3insert.c 4query.c 5update.c 6delete.c 7save.c 8sort.c 9summary.c audit.c index.c snapshot.c db.c stats.c mmapstore.c compress.c txn.c repl.c shard.c arena.c lazy.c refresh.c extsort.c sketch.c trace.c shmexport.c shmreader.c join.c -lpthread
+ *TO RUN:   ./cms_bench [-s 1000,100000,...] [-t seconds per case] [-o results.jsonl]
+ *Add -DCMS_SWISS_INDEX to benchmark the Swiss-table index instead of linear probing,
+ *and -DCMS_STRING_ARENA to benchmark arena strings instead of fixed arrays.
+*/
+
+#define _CRT_SECURE_NO_WARNINGS
+#include "student_db.h"
+#include "shmreader.h"
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define GET_BATCH 64          // index_get is too fast to time one call at a time
+#define LOOKUP_BATCH 1024     // IDs per call in the batch lookup cases
+#define TXN_OPS 64            // changes per transaction in the txn cases
+#define REFRESH_ROWS 1000     // rows appended to the file before each REFRESH
+#define MIN_REPS 3
+#define MAX_SAMPLES 200000
+#define READER_THREADS 4
+#define BENCH_FILE "bench-cms.txt"
+#define BENCH_SHM "/cms_bench"
+#define SHM_DELETES 64 // DELETEs timed with the export
+#define BENCH_JOIN_FILE "bench-enrol.txt"
+#define BENCH_STORE "bench-cms.db"
+#define BENCH_FILE_Z "bench-cms.cmsz"
+
+typedef struct {
+    unsigned long long* v;
+    int count;
+} Samples;
+
+static const char* programmes[] = {
+    "Computer Science", "Software Engineering", "Digital Supply Chain", "Applied AI",
+    "Information Security", "Data Science", "Electrical Engineering", "Mechanical Design"
+};
+
+static FILE* out;
+static double budgetSec = 1.0;
+static int failures = 0;// checks that found wrong results; main then exits 1
+static unsigned long long rng = 88172645463325252ull;
+static Samples samples;
+
+static unsigned long long next_rand(void) { // xorshift64, reproducible across runs
+    rng ^= rng << 13;
+    rng ^= rng >> 7;
+    rng ^= rng << 17;
+    return rng;
+}
+
+static int present_id(int i) { return 1000000 + i * 3; }
+static int missing_id(int i) { return 1000000 + i * 3 + 1; }
+
+static void fill_records(int n, unsigned long long seed) { // n rows in shuffled id order
+    char name[MAX_NAME_LEN];
+    rng = seed;
+    db_reserve(n);
+    arena_reset();
+    for (int i = 0; i < n; i++) {
+        records[i].id = present_id(i);
+        snprintf(name, sizeof name, "Student %07d", i);
+        rec_set_name(&records[i], name, NULL);
+        rec_set_programme(&records[i], programmes[next_rand() % 8], NULL);
+        records[i].mark = (float)(next_rand() % 1001) / 10.0f;
+    }
+    for (int i = n - 1; i > 0; i--) {
+        int j = (int)(next_rand() % (unsigned long long)(i + 1));
+        StudentRecord tmp = records[i];
+        records[i] = records[j];
+        records[j] = tmp;
+    }
+    recordCount = n;
+}
+
+static void load_table(int n) {
+    fill_records(n, 42);
+    index_build(records, recordCount);
+    snapshot_publish();
+}
+
+static int keep_going(unsigned long long start) {
+    if (samples.count < MIN_REPS) return 1;
+    if (samples.count >= MAX_SAMPLES) return 0;
+    return (clock_ns() - start) < (unsigned long long)(budgetSec * 1e9);
+}
+
+static void sample(unsigned long long ns) {
+    samples.v[samples.count++] = ns;
+}
+
+static int cmp_ull(const void* a, const void* b) {
+    unsigned long long x = *(const unsigned long long*)a, y = *(const unsigned long long*)b;
+    return (x > y) - (x < y);
+}
+
+static unsigned long long pct(double p) {
+    return samples.v[(int)(p * (samples.count - 1) + 0.5)];
+}
+
+// every sample covers `batch` operations; percentiles are reported per operation
+static void report(const char* op, int n, int batch) {
+    unsigned long long total = 0;
+    for (int i = 0; i < samples.count; i++) total += samples.v[i];
+    qsort(samples.v, (size_t)samples.count, sizeof *samples.v, cmp_ull);
+
+    double nsPerOp = (double)total / ((double)samples.count * batch);
+    fprintf(out, "{\"op\":\"%s\",\"n\":%d,\"reps\":%d,\"batch\":%d,\"ns_per_op\":%.1f,"
+        "\"p50_ns\":%.1f,\"p90_ns\":%.1f,\"p99_ns\":%.1f,\"max_ns\":%.1f,\"ops_per_sec\":%.1f}\n",
+        op, n, samples.count, batch, nsPerOp,
+        (double)pct(0.50) / batch, (double)pct(0.90) / batch, (double)pct(0.99) / batch,
+        (double)samples.v[samples.count - 1] / batch, 1e9 / nsPerOp);
+    fflush(out);
+    samples.count = 0;
+}
+
+static void report_index_stats(const char* op, int n, const IndexStats* st) { // probe-length health next to the timings
+    fprintf(out, "{\"op\":\"%s\",\"n\":%d,\"size\":%d,\"used\":%d,\"load\":%.3f,\"mean_probe\":%.3f,"
+        "\"expected_probe\":%.3f,\"max_probe\":%d,\"probe_hist\":[", op, n, st->size, st->used,
+        st->size ? (double)st->used / st->size : 0.0, st->meanProbe, st->expectedProbe, st->maxProbe);
+    for (int b = 0; b < PROBE_BUCKETS; b++) fprintf(out, "%s%lld", b ? "," : "", st->probes[b]);
+    fprintf(out, "],\"grows\":%d,\"dropped\":%d}\n", st->grows, st->dropped);
+    fflush(out);
+}
+
+static void bench_index_build(int n) {
+    IndexStats st;
+    unsigned long long start = clock_ns();
+    while (keep_going(start)) {
+        unsigned long long t = clock_ns();
+        index_build(records, recordCount);
+        sample(clock_ns() - t);
+    }
+    report("index_build", n, 1);
+    index_stats(&st);
+    report_index_stats("index_stats", n, &st);
+}
+
+static void bench_index_get(int n, int hit, const char* op) {
+    int ids[GET_BATCH];
+    volatile int sink = 0;
+    unsigned long long start = clock_ns();
+    while (keep_going(start)) {
+        for (int k = 0; k < GET_BATCH; k++) {
+            int i = (int)(next_rand() % (unsigned long long)n);
+            ids[k] = hit ? present_id(i) : missing_id(i);
+        }
+        unsigned long long t = clock_ns();
+        for (int k = 0; k < GET_BATCH; k++) {
+            int pos;
+            sink += index_get(ids[k], &pos);
+        }
+        sample(clock_ns() - t);
+    }
+    report(op, n, GET_BATCH);
+}
+
+static void bench_snapshot_find(int n, const char* op) { // what QUERY pays, on the current snapshot
+    int ids[GET_BATCH];
+    volatile float sink = 0;
+    unsigned long long start = clock_ns();
+    while (keep_going(start)) {
+        for (int k = 0; k < GET_BATCH; k++) ids[k] = present_id((int)(next_rand() % (unsigned long long)n));
+        DbSnapshot* snap = snapshot_acquire();
+        unsigned long long t = clock_ns();
+        for (int k = 0; k < GET_BATCH; k++) {
+            const StudentRecord* r = snapshot_find(snap, ids[k]);
+            if (r) sink += r->mark;
+        }
+        sample(clock_ns() - t);
+        snapshot_release(snap);
+    }
+    report(op, n, GET_BATCH);
+}
+
+static void bench_index_static(int n) { // Eytzinger layout against the hash table, then back to HASH
+    long long hashBytes, staticBytes, tableBytes;
+    index_memory(&tableBytes, &staticBytes);
+
+    unsigned long long start = clock_ns();
+    while (keep_going(start)) {
+        unsigned long long t = clock_ns();
+        index_set_static(1, records, recordCount);
+        sample(clock_ns() - t);
+    }
+    report("index_build_static", n, 1);
+    bench_index_get(n, 1, "index_get_static_hit");
+    bench_index_get(n, 0, "index_get_static_miss");
+    snapshot_publish(); // readers search the same layout
+    bench_snapshot_find(n, "snapshot_find_static");
+    index_memory(&hashBytes, &staticBytes);
+    fprintf(out, "{\"op\":\"index_memory\",\"n\":%d,\"hash_bytes\":%lld,\"static_bytes\":%lld}\n",
+        n, tableBytes, staticBytes + hashBytes);
+    fflush(out);
+    index_set_static(0, records, recordCount);
+    snapshot_publish();
+}
+
+static long file_size(const char* path) {
+    FILE* fp = fopen(path, "rb");
+    long size = -1;
+    if (fp && fseek(fp, 0, SEEK_END) == 0) size = ftell(fp);
+    if (fp) fclose(fp);
+    return size;
+}
+
+// ID -> record for LOOKUP_BATCH random IDs: one call at a time against the batch calls,
+// touching each record so the second cache miss (records/snapshot rows) is counted too
+static void bench_batch_lookup(int n) {
+    static int ids[LOOKUP_BATCH], pos[LOOKUP_BATCH];
+    static const StudentRecord* rows[LOOKUP_BATCH];
+    static const char* names[] = { "lookup_single", "lookup_batch", "snapshot_find_single", "snapshot_find_batch" };
+    volatile float sink = 0;
+
+    for (int mode = 0; mode < 4; mode++) {
+        unsigned long long start = clock_ns();
+        while (keep_going(start)) {
+            for (int k = 0; k < LOOKUP_BATCH; k++) ids[k] = present_id((int)(next_rand() % (unsigned long long)n));
+            DbSnapshot* snap = snapshot_acquire();
+            unsigned long long t = clock_ns();
+            if (mode == 0) {
+                for (int k = 0; k < LOOKUP_BATCH; k++) {
+                    if (index_get(ids[k], &pos[k])) sink += records[pos[k]].mark;
+                }
+            }
+            else if (mode == 1) {
+                index_get_batch(ids, LOOKUP_BATCH, pos);
+                for (int k = 0; k < LOOKUP_BATCH; k++) {
+                    if (pos[k] >= 0) sink += records[pos[k]].mark;
+                }
+            }
+            else if (mode == 2) {
+                for (int k = 0; k < LOOKUP_BATCH; k++) {
+                    const StudentRecord* r = snapshot_find(snap, ids[k]);
+                    if (r) sink += r->mark;
+                }
+            }
+            else {
+                snapshot_find_batch(snap, ids, LOOKUP_BATCH, rows);
+                for (int k = 0; k < LOOKUP_BATCH; k++) {
+                    if (rows[k]) sink += rows[k]->mark;
+                }
+            }
+            sample(clock_ns() - t);
+            snapshot_release(snap);
+        }
+        report(names[mode], n, LOOKUP_BATCH);
+    }
+}
+
+// lookups in a table filled exactly to `load` percent, to compare index layouts when they are crowded
+static void bench_index_load(int n, int load) {
+    IdIndex ix = { 0 };
+    volatile int sink = 0;
+    char op[48];
+    int count = n;
+
+    idindex_set_max_load(load);
+    for (int i = 0; i < n; i++) idindex_put(&ix, present_id(i), i);
+    while ((long long)(count + 1) * 100 <= (long long)ix.size * load) {
+        idindex_put(&ix, present_id(count), count);
+        count++;
+    }
+
+    for (int hit = 1; hit >= 0; hit--) {
+        int ids[GET_BATCH];
+        unsigned long long start = clock_ns();
+        while (keep_going(start)) {
+            for (int k = 0; k < GET_BATCH; k++) {
+                int i = (int)(next_rand() % (unsigned long long)count);
+                ids[k] = hit ? present_id(i) : missing_id(i);
+            }
+            unsigned long long t = clock_ns();
+            for (int k = 0; k < GET_BATCH; k++) sink += idindex_get(&ix, ids[k], NULL);
+            sample(clock_ns() - t);
+        }
+        snprintf(op, sizeof op, "index_get_%s_load%d", hit ? "hit" : "miss", load);
+        report(op, count, GET_BATCH);
+    }
+    IndexStats st;
+    idindex_stats(&ix, &st);
+    snprintf(op, sizeof op, "index_stats_load%d", load);
+    report_index_stats(op, count, &st);
+    idindex_free(&ix);
+    idindex_set_max_load(0);
+}
+
+static void bench_save_open(int n, int compressed) {
+    const char* path = compressed ? BENCH_FILE_Z : BENCH_FILE;
+    unsigned long long start = clock_ns();
+    while (keep_going(start)) {
+        unsigned long long t = clock_ns();
+        db_save(path, compressed ? FORMAT_COMPRESSED : FORMAT_TEXT);
+        sample(clock_ns() - t);
+    }
+    report(compressed ? "saveCompressed" : "saveDatabase", n, 1);
+
+    start = clock_ns();
+    while (keep_going(start)) {
+        unsigned long long t = clock_ns();
+        db_open(path);
+        sample(clock_ns() - t);
+    }
+    report(compressed ? "openCompressed" : "openDatabase", n, 1);
+    if (compressed) {
+        remove(path);
+        return;
+    }
+
+    db_save(BENCH_FILE_Z, FORMAT_COMPRESSED); // size of the same rows in both formats
+    long text = file_size(BENCH_FILE), packed = file_size(BENCH_FILE_Z);
+    fprintf(out, "{\"op\":\"file_size\",\"n\":%d,\"text_bytes\":%ld,\"compressed_bytes\":%ld,\"ratio\":%.2f}\n",
+        n, text, packed, packed > 0 ? (double)text / packed : 0.0);
+    fflush(out);
+    remove(BENCH_FILE);
+}
+
+static void bench_lazy(int n) { // --lazy: the ID scan, time to the first QUERY, then parsing the rest
+    db_save(BENCH_FILE, FORMAT_TEXT);
+    unsigned long long start = clock_ns();
+    while (keep_going(start)) {
+        unsigned long long t = clock_ns();
+        lazy_open(BENCH_FILE);
+        sample(clock_ns() - t);
+    }
+    report("openLazy", n, 1);
+
+    start = clock_ns();
+    while (keep_going(start)) {
+        int id = present_id((int)(next_rand() % (unsigned long long)n));
+        unsigned long long t = clock_ns();
+        lazy_open(BENCH_FILE);
+        lazy_fetch(&id, 1);
+        DbSnapshot* snap = snapshot_acquire();
+        snapshot_find(snap, id);
+        snapshot_release(snap);
+        sample(clock_ns() - t);
+    }
+    report("openLazyFirstQuery", n, 1);
+
+    start = clock_ns();
+    while (keep_going(start)) {
+        lazy_open(BENCH_FILE);
+        unsigned long long t = clock_ns();
+        lazy_fetch_all();
+        sample(clock_ns() - t);
+    }
+    report("lazyFetchAll", n, 1);
+    remove(BENCH_FILE);
+}
+
+static void bench_refresh(int n) { // REFRESH after another program appended REFRESH_ROWS rows, per row read
+    int added = 0;
+    db_save(BENCH_FILE, FORMAT_TEXT);
+    db_open(BENCH_FILE);
+    unsigned long long start = clock_ns();
+    while (keep_going(start)) {
+        FILE* fp = fopen(BENCH_FILE, "a");
+        if (fp == NULL) break;
+        for (int j = 0; j < REFRESH_ROWS; j++) {
+            fprintf(fp, "%d\tBench Append\t%s\t%.1f\n", missing_id(added++), programmes[j % 8], 50.0 + j % 50);
+        }
+        fclose(fp);
+        int rows;
+        unsigned long long t = clock_ns();
+        db_refresh(&rows);
+        sample(clock_ns() - t);
+    }
+    report("refreshAppend", n, REFRESH_ROWS);
+    recordCount -= added; // back to n rows
+    index_build(records, recordCount);
+    snapshot_publish();
+    remove(BENCH_FILE);
+}
+
+static void bench_shards(int n, int count) { // full split, parallel OPEN, then a SAVE after one change
+    char path[280];
+    char op[32];
+    shard_configure(count);
+
+    unsigned long long start = clock_ns();
+    while (keep_going(start)) {
+        shard_touch_all();
+        unsigned long long t = clock_ns();
+        db_save(BENCH_FILE, FORMAT_TEXT);
+        sample(clock_ns() - t);
+    }
+    snprintf(op, sizeof op, "saveShards%d", count);
+    report(op, n, 1);
+
+    start = clock_ns();
+    while (keep_going(start)) {
+        unsigned long long t = clock_ns();
+        shard_open(BENCH_FILE);
+        sample(clock_ns() - t);
+    }
+    snprintf(op, sizeof op, "openShards%d", count);
+    report(op, n, 1);
+
+    start = clock_ns();
+    while (keep_going(start)) {
+        db_update(records[next_rand() % (unsigned)recordCount].id, NULL, NULL, 50.0f); // dirties one shard
+        unsigned long long t = clock_ns();
+        db_save(BENCH_FILE, FORMAT_TEXT);
+        sample(clock_ns() - t);
+    }
+    snprintf(op, sizeof op, "saveOneShardOf%d", count);
+    report(op, n, 1);
+
+    for (int k = 0; k < count; k++) {
+        shard_path(path, sizeof path, BENCH_FILE, k);
+        remove(path);
+    }
+    snprintf(path, sizeof path, "%s.shards", BENCH_FILE);
+    remove(path);
+    shard_configure(0);
+}
+
+static void bench_sort(int n, int byId) {
+    unsigned long long start = clock_ns();
+    while (keep_going(start)) {
+        fill_records(n, 42 + (unsigned long long)samples.count); // unsorted input every rep
+        unsigned long long t = clock_ns();
+        db_sort(byId, 0);
+        sample(clock_ns() - t);
+    }
+    report(byId ? "sortRecords_id" : "sortRecords_mark", n, 1);
+    load_table(n);
+}
+
+static const SortKey multiKeys[] = { { SORT_PROGRAMME, 0 }, { SORT_MARK, 1 }, { SORT_NAME, 0 } };
+
+static int cmp_chained(const void* a, const void* b) { // the usual multi-key comparator: one field at a time
+    const StudentRecord* A = a;
+    const StudentRecord* B = b;
+    for (int k = 0; k < 3; k++) {
+        int c = 0;
+        switch (multiKeys[k].field) {
+        case SORT_ID: c = (A->id > B->id) - (A->id < B->id); break;
+        case SORT_NAME: c = strcmp(A->name, B->name); break;
+        case SORT_PROGRAMME: c = strcmp(A->programme, B->programme); break;
+        case SORT_MARK: c = (A->mark > B->mark) - (A->mark < B->mark); break;
+        }
+        if (c) return multiKeys[k].desc ? -c : c;
+    }
+    return 0;
+}
+
+static void bench_sort_multi(int n) { // PROGRAMME, MARK DESC, NAME: memcmp keys against a chained-comparator qsort
+    unsigned long long start = clock_ns();
+    while (keep_going(start)) {
+        fill_records(n, 42 + (unsigned long long)samples.count);
+        unsigned long long t = clock_ns();
+        db_sort_by(multiKeys, 3);
+        sample(clock_ns() - t);
+    }
+    report("sortMultiKey", n, 1);
+
+    start = clock_ns();
+    while (keep_going(start)) {
+        fill_records(n, 42 + (unsigned long long)samples.count);
+        unsigned long long t = clock_ns();
+        qsort(records, (size_t)recordCount, sizeof records[0], cmp_chained);
+        index_rebuild(records, recordCount);
+        snapshot_publish();
+        sample(clock_ns() - t);
+    }
+    report("sortMultiKeyQsort", n, 1);
+    load_table(n);
+}
+
+// --sort-file of the saved table: a budget that forces run files and a merge, then one that fits
+static void bench_sort_file(int n) {
+    SortFileResult res;
+    size_t budgets[] = { (size_t)1 << 20, (size_t)1 << 30 };
+    const char* names[] = { "sortFile1MB", "sortFile1GB" };
+    db_save(BENCH_FILE, FORMAT_TEXT);
+    for (int b = 0; b < 2; b++) {
+        unsigned long long start = clock_ns();
+        while (keep_going(start)) {
+            unsigned long long t = clock_ns();
+            db_sort_file(BENCH_FILE, BENCH_FILE ".sorted", multiKeys, 3, budgets[b], &res);
+            sample(clock_ns() - t);
+        }
+        report(names[b], n, 1);
+    }
+    remove(BENCH_FILE ".sorted");
+    remove(BENCH_FILE);
+}
+
+static void bench_summary(int n) {
+    SummaryStats st;
+    unsigned long long start = clock_ns();
+    while (keep_going(start)) {
+        unsigned long long t = clock_ns();
+        db_summary(&st, 0);
+        sample(clock_ns() - t);
+    }
+    report("showSummary", n, 1);
+}
+
+static int cmp_float(const void* a, const void* b) {
+    float x = *(const float*)a, y = *(const float*)b;
+    return (x > y) - (x < y);
+}
+
+// SUMMARY APPROX: the first call's full build, the sketches afterwards, and an exact median for scale
+static void bench_summary_approx(int n) {
+    ApproxSummary st;
+    unsigned long long start = clock_ns();
+    while (keep_going(start)) {
+        sketch_reset();
+        unsigned long long t = clock_ns();
+        db_summary_approx(&st);
+        sample(clock_ns() - t);
+    }
+    report("summaryApproxBuild", n, 1);
+
+    start = clock_ns();
+    while (keep_going(start)) {
+        unsigned long long t = clock_ns();
+        db_summary_approx(&st);
+        sample(clock_ns() - t);
+    }
+    report("summaryApprox", n, 1);
+    sketch_reset(); // the later cases change records[] directly
+
+    float* marks = malloc((size_t)n * sizeof *marks);
+    start = clock_ns();
+    while (marks && keep_going(start)) {
+        unsigned long long t = clock_ns();
+        for (int i = 0; i < recordCount; i++) marks[i] = records[i].mark;
+        qsort(marks, (size_t)recordCount, sizeof *marks, cmp_float);
+        volatile float median = marks[recordCount / 2];
+        (void)median;
+        sample(clock_ns() - t);
+    }
+    if (marks) report("summaryExactMedian", n, 1);
+    free(marks);
+}
+
+static void bench_insert_delete(int n) {
+    StudentRecord rec;
+    int inserted = 0;
+    unsigned long long start = clock_ns();
+
+    memset(&rec, 0, sizeof rec);
+    rec_set_name(&rec, "Bench Insert", NULL);
+    rec_set_programme(&rec, programmes[0], NULL);
+    while (keep_going(start)) {
+        rec.id = missing_id(inserted++);
+        unsigned long long t = clock_ns();
+        db_insert(&rec);
+        sample(clock_ns() - t);
+    }
+    report("insertRecord", n, 1);
+    recordCount -= inserted;
+    index_build(records, recordCount);
+    snapshot_publish();
+
+    start = clock_ns();
+    while (keep_going(start)) {
+        rec = records[next_rand() % (unsigned long long)recordCount];
+        unsigned long long t = clock_ns();
+        db_delete(rec.id);
+        sample(clock_ns() - t);
+        db_insert(&rec); // keep the table at n rows
+    }
+    report("deleteRecord", n, 1);
+}
+
+// the same changes as insertRecord/deleteRecord, TXN_OPS at a time between BEGIN and COMMIT
+static void bench_txn(int n) {
+    StudentRecord rec, gone[TXN_OPS];
+    int inserted = 0;
+
+    memset(&rec, 0, sizeof rec);
+    rec_set_name(&rec, "Bench Txn", NULL);
+    rec_set_programme(&rec, programmes[1], NULL);
+    unsigned long long start = clock_ns();
+    while (keep_going(start)) {
+        unsigned long long t = clock_ns();
+        txn_begin();
+        for (int k = 0; k < TXN_OPS; k++) {
+            rec.id = missing_id(inserted++);
+            db_insert(&rec);
+        }
+        txn_commit();
+        sample(clock_ns() - t);
+    }
+    report("insert_txn", n, TXN_OPS);
+    recordCount -= inserted;
+    index_build(records, recordCount);
+    snapshot_publish();
+
+    start = clock_ns();
+    while (keep_going(start)) {
+        int count = 0;
+        unsigned long long t = clock_ns();
+        txn_begin();
+        for (int k = 0; k < TXN_OPS; k++) {
+            StudentRecord victim = records[next_rand() % (unsigned long long)recordCount];
+            if (db_delete(victim.id) == 0) gone[count++] = victim;
+        }
+        txn_commit();
+        sample(clock_ns() - t);
+        txn_begin(); // put them back, untimed
+        for (int k = 0; k < count; k++) db_insert(&gone[k]);
+        txn_commit();
+    }
+    report("delete_txn", n, TXN_OPS);
+}
+
+typedef struct {
+    int n;
+    atomic_int* stop;
+    long lookups;
+    long errors;
+} Reader;
+
+static void* reader_main(void* arg) { // the stress half: readers verify every row they find
+    Reader* r = arg;
+    unsigned long long seed = 0x9E3779B97F4A7C15ull ^ (unsigned long long)(size_t)arg;
+    while (!atomic_load(r->stop)) {
+        DbSnapshot* snap = snapshot_acquire();
+        for (int k = 0; k < GET_BATCH; k++) {
+            seed ^= seed << 13; seed ^= seed >> 7; seed ^= seed << 17;
+            int id = present_id((int)(seed % (unsigned long long)r->n));
+            const StudentRecord* rec = snapshot_find(snap, id);
+            if (!rec || rec->id != id || rec->mark < 0) r->errors++;
+        }
+        snapshot_release(snap);
+        r->lookups += GET_BATCH;
+    }
+    return NULL;
+}
+
+static void bench_snapshot_readers(int n) {
+    pthread_t threads[READER_THREADS];
+    Reader readers[READER_THREADS];
+    atomic_int stop = 0;
+    long lookups = 0, errors = 0;
+
+    for (int i = 0; i < READER_THREADS; i++) {
+        readers[i].n = n;
+        readers[i].stop = &stop;
+        readers[i].lookups = 0;
+        readers[i].errors = 0;
+        pthread_create(&threads[i], NULL, reader_main, &readers[i]);
+    }
+
+    unsigned long long start = clock_ns();
+    while (keep_going(start)) { // one writer updating marks while the readers run
+        int id = present_id((int)(next_rand() % (unsigned long long)n));
+        unsigned long long t = clock_ns();
+        db_update(id, NULL, NULL, (float)(next_rand() % 1001) / 10.0f);
+        sample(clock_ns() - t);
+    }
+    double elapsed = (double)(clock_ns() - start) / 1e9;
+    atomic_store(&stop, 1);
+    for (int i = 0; i < READER_THREADS; i++) {
+        pthread_join(threads[i], NULL);
+        lookups += readers[i].lookups;
+        errors += readers[i].errors;
+    }
+
+    report("snapshot_writer_update", n, 1);
+    fprintf(out, "{\"op\":\"snapshot_reader_find\",\"n\":%d,\"threads\":%d,\"lookups\":%ld,"
+        "\"errors\":%ld,\"ops_per_sec\":%.1f}\n",
+        n, READER_THREADS, lookups, errors, lookups / elapsed);
+    fflush(out);
+    if (errors) failures++; // a reader saw a row that was freed or half-copied
+}
+
+// --export-shm: a one-row UPDATE with the export (compare snapshot_writer_update), the first
+// full export, then what another process pays: ID lookups and a scan of every mark
+static void bench_shm(int n) {
+    shm_export_configure(BENCH_SHM);
+    unsigned long long t = clock_ns();
+    if (shm_export_open() != 0) {
+        shm_export_configure(NULL);
+        return;
+    }
+    sample(clock_ns() - t);
+    report("shmExportOpen", n, 1);
+
+    unsigned long long start = clock_ns();
+    while (keep_going(start)) {
+        int id = present_id((int)(next_rand() % (unsigned long long)n));
+        t = clock_ns();
+        db_update(id, NULL, NULL, (float)(next_rand() % 1001) / 10.0f);
+        sample(clock_ns() - t);
+    }
+    report("shmExportUpdate", n, 1);
+
+    // INSERT and DELETE change the segment's index in place; a reader must see exactly the rows left
+    CmsShm* shm = cms_shm_open(BENCH_SHM);
+    CmsShmRow row;
+    StudentRecord rec;
+    int added = 0, wrong = 0;
+    memset(&rec, 0, sizeof rec);
+    rec_set_name(&rec, "Bench Insert", NULL);
+    rec_set_programme(&rec, programmes[0], NULL);
+    start = clock_ns();
+    while (keep_going(start)) {
+        rec.id = missing_id(added++);
+        t = clock_ns();
+        db_insert(&rec);
+        sample(clock_ns() - t);
+    }
+    report("shmExportInsert", n, 1);
+    for (int i = 0; shm && i < added; i++) wrong += cms_shm_get(shm, missing_id(i), &row) != 1;
+    int dropped = added < 2 * SHM_DELETES ? added : 2 * SHM_DELETES; // DELETE itself rebuilds the command loop's index
+    for (int i = 0; i < dropped; i += 2) { // every other one, so the rows after each move up
+        t = clock_ns();
+        db_delete(missing_id(i));
+        sample(clock_ns() - t);
+    }
+    report("shmExportDelete", n, 1);
+    for (int i = 0; shm && i < dropped; i++) wrong += cms_shm_get(shm, missing_id(i), &row) != i % 2;
+    txn_begin(); // the rest in one COMMIT, which takes them out of the segment's index together
+    for (int i = 0; i < added; i++) {
+        if (i >= dropped || i % 2) db_delete(missing_id(i));
+    }
+    txn_commit();
+    for (int i = 0; shm && i < added; i++) wrong += cms_shm_get(shm, missing_id(i), &row) != 0;
+    if (wrong) {
+        fprintf(out, "{\"op\":\"shmExport_WRONG_ROWS\",\"n\":%d,\"rows\":%d}\n", n, wrong);
+        failures++;
+    }
+
+    int ids[GET_BATCH], misses = 0;
+    start = clock_ns();
+    while (shm && keep_going(start)) {
+        for (int k = 0; k < GET_BATCH; k++) ids[k] = present_id((int)(next_rand() % (unsigned long long)n));
+        t = clock_ns();
+        for (int k = 0; k < GET_BATCH; k++) misses += cms_shm_get(shm, ids[k], &row) != 1;
+        sample(clock_ns() - t);
+    }
+    if (shm) report(misses ? "shmGet_MISSING_ROWS" : "shmGet", n, GET_BATCH);
+
+    start = clock_ns();
+    while (shm && keep_going(start)) {
+        CmsShmView view;
+        volatile double sum;
+        t = clock_ns();
+        do {
+            if (cms_shm_begin(shm, &view) != 0) break;
+            double s = 0;
+            for (int i = 0; i < view.count; i++) s += view.rows[i].mark;
+            sum = s;
+        } while (!cms_shm_end(shm, &view));
+        (void)sum;
+        sample(clock_ns() - t);
+    }
+    if (shm) report("shmScanMarks", n, n);
+    cms_shm_close(shm);
+    shm_export_close();
+    shm_export_configure(NULL);
+}
+
+static int mmap_rows_ok(int n) { // exactly the n rows load_table made, each once
+    if (recordCount != n) return 0;
+    char* seen = calloc((size_t)n, 1);
+    int ok = seen != NULL;
+    for (int i = 0; ok && i < recordCount; i++) {
+        int k = (records[i].id - 1000000) / 3;
+        ok = records[i].id >= 1000000 && present_id(k) == records[i].id && k < n && !seen[k]++;
+    }
+    free(seen);
+    return ok;
+}
+
+// --mmap: SAVE of the whole table, then re-OPEN after an unsaved DELETE, which must bring back
+// the saved rows unchanged (no row lost, none twice); a saved DELETE must survive the re-OPEN
+static void bench_mmap(int n) {
+    int ok = 1;
+    remove(BENCH_STORE);
+    mstore_configure(BENCH_STORE);
+    if (mstore_open() < 0) {
+        mstore_configure(NULL);
+        load_table(n);
+        return;
+    }
+    load_table(n); // into the mapping, replacing whatever the first OPEN imported
+
+    unsigned long long start = clock_ns();
+    while (keep_going(start)) {
+        unsigned long long t = clock_ns();
+        if (mstore_sync() != 0) ok = 0;
+        sample(clock_ns() - t);
+    }
+    report("mmapSave", n, 1);
+
+    start = clock_ns();
+    while (ok && keep_going(start)) {
+        db_delete(present_id((int)(next_rand() % (unsigned long long)n)));
+        unsigned long long t = clock_ns();
+        if (mstore_open() != n) ok = 0;
+        sample(clock_ns() - t);
+        ok = ok && mmap_rows_ok(n);
+    }
+    if (samples.count) report(ok ? "mmapReopen" : "mmapReopen_WRONG_ROWS", n, 1);
+    samples.count = 0;
+
+    int victim = present_id(n / 2), pos;
+    if (ok && (db_delete(victim) != 0 || mstore_sync() != 0 || mstore_open() != n - 1 || index_get(victim, &pos))) ok = 0;
+    if (!ok) {
+        fprintf(out, "{\"op\":\"mmapReopen\",\"n\":%d,\"error\":\"rows after re-OPEN differ from the last SAVE\"}\n", n);
+        failures++;
+    }
+    mstore_close();
+    mstore_configure(NULL);
+    remove(BENCH_STORE);
+    load_table(n);
+}
+
+static void count_join_row(void* ctx, int id, JoinCols left, JoinCols right) {
+    (void)left;
+    (void)right;
+    *(long long*)ctx += id;
+}
+
+static void bench_join_case(const char* op, int n, const char* left, const char* right) { // per row of the result
+    long long rows = 0, sum = 0;
+    unsigned long long start = clock_ns();
+    while (keep_going(start)) {
+        unsigned long long t = clock_ns();
+        rows = db_join(left, right, count_join_row, &sum);
+        sample(clock_ns() - t);
+    }
+    report(op, n, rows > 0 ? (int)rows : 1);
+}
+
+// An enrolment table of n rows: three in four for random students (so some have several), the rest
+// for IDs STUDENTS does not have. ATTACH per row, then each way round and a join of two such tables.
+static void bench_join(int n) {
+    TableInfo info;
+    FILE* fp = fopen(BENCH_JOIN_FILE, "w");
+    if (!fp) return;
+    fprintf(fp, "ID\tCourse\tTerm\n");
+    for (int i = 0; i < n; i++) {
+        int k = (int)(next_rand() % (unsigned long long)n);
+        fprintf(fp, "%d\tCSC%04d\tT%d\n", i % 4 == 3 ? missing_id(k) : present_id(k), (int)(next_rand() % 2000), i % 3 + 1);
+    }
+    fclose(fp);
+
+    unsigned long long start = clock_ns();
+    while (keep_going(start)) {
+        db_detach("ENROL");
+        unsigned long long t = clock_ns();
+        if (db_attach(BENCH_JOIN_FILE, "ENROL", &info) != 0) break;
+        sample(clock_ns() - t);
+    }
+    report("joinAttach", n, n);
+    if (db_attach(BENCH_JOIN_FILE, "ENROL2", &info) == 0) {
+        bench_join_case("joinStudentsEnrol", n, "STUDENTS", "ENROL");
+        bench_join_case("joinEnrolStudents", n, "ENROL", "STUDENTS");
+        bench_join_case("joinEnrolEnrol", n, "ENROL", "ENROL2");
+    }
+    db_detach("ENROL");
+    db_detach("ENROL2");
+    remove(BENCH_JOIN_FILE);
+}
+
+// -DCMS_STRING_ARENA: copying every live string into a fresh arena, per row
+static void bench_compact(int n) {
+    unsigned long long start = clock_ns();
+    while (keep_going(start)) {
+        unsigned long long t = clock_ns();
+        arena_compact();
+        sample(clock_ns() - t);
+    }
+    report("arenaCompact", n, n);
+}
+
+int main(int argc, char* argv[]) {
+    int sizes[16] = { 1000, 100000, 1000000, 10000000 };
+    int sizeCount = 4;
+
+    out = stdout;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        if (strcmp(argv[i], "-s") == 0) {
+            sizeCount = 0;
+            for (char* tok = strtok(argv[i + 1], ","); tok && sizeCount < 16; tok = strtok(NULL, ",")) {
+                sizes[sizeCount++] = atoi(tok);
+            }
+        }
+        else if (strcmp(argv[i], "-t") == 0) {
+            budgetSec = atof(argv[i + 1]);
+        }
+        else if (strcmp(argv[i], "-o") == 0) {
+            out = fopen(argv[i + 1], "w");
+            if (!out) {
+                printf("Cannot write %s\n", argv[i + 1]);
+                return 1;
+            }
+        }
+    }
+
+    samples.v = malloc(MAX_SAMPLES * sizeof *samples.v);
+    ArenaUsage u;
+    arena_usage(&u);
+    fprintf(out, "{\"op\":\"config\",\"index\":\"%s\",\"record_bytes\":%d,\"strings\":\"%s\"}\n", idindex_kind(),
+        (int)sizeof(StudentRecord), u.arena ? "arena" : "fixed");
+    for (int s = 0; s < sizeCount; s++) {
+        int n = sizes[s];
+        if (n < 1) continue;
+        fprintf(stderr, "benchmarking %d records...\n", n);
+
+        load_table(n);
+        bench_index_build(n);
+        bench_index_get(n, 1, "index_get_hit");
+        bench_index_get(n, 0, "index_get_miss");
+        bench_index_static(n);
+        bench_batch_lookup(n);
+        bench_index_load(n, 50);
+        bench_index_load(n, 75);
+        bench_index_load(n, 87);
+        bench_index_load(n, 95);
+        bench_save_open(n, 0);
+        bench_save_open(n, 1);
+        bench_lazy(n);
+        bench_refresh(n);
+        bench_shards(n, 8);
+        bench_sort(n, 1);
+        bench_sort(n, 0);
+        bench_sort_multi(n);
+        bench_sort_file(n);
+        bench_summary(n);
+        bench_summary_approx(n);
+        bench_join(n);
+        bench_insert_delete(n);
+        bench_txn(n);
+        bench_snapshot_readers(n);
+        bench_shm(n);
+        if (!u.arena) bench_mmap(n); // fixed-size rows only
+        if (u.arena) bench_compact(n);
+    }
+
+    free(samples.v);
+    if (out != stdout) fclose(out);
+    return failures ? 1 : 0;
+}
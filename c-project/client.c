@@ -0,0 +1,278 @@
+/*
+ *This file contains the client for server mode (see server.c for the protocol).
+ *It is a separate program: gcc -o cms_client client.c -lpthread
+ *
+ *  ./cms_client [socket]                    send each line typed (fields separated by tabs)
+ *                                           and print the reply
+ *  ./cms_client [socket] --load [-c conns] [-n requests] [-p depth] [-w write%]
+ *                                           load generator: each connection keeps up to
+ *                                           depth requests in flight, then prints ops/sec
+ *                                           and latency percentiles
+*/
+
+#define _CRT_SECURE_NO_WARNINGS
+#define _GNU_SOURCE
+
+#include <stdio.h>
+
+#ifdef __linux__
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+#define DEFAULT_SOCKET "student_db.sock"
+
+typedef struct {
+    const char* socketPath;
+    const int* ids;
+    int idCount;
+    int requests;
+    int depth;
+    int writePct;
+    unsigned seed;
+    uint64_t* latencies;   // one entry per request, in ns
+    int errors;
+} LoadWorker;
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+static int connect_to(const char* path) {
+    struct sockaddr_un addr;
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) return -1;
+    memset(&addr, 0, sizeof addr);
+    addr.sun_family = AF_UNIX;
+    snprintf(addr.sun_path, sizeof addr.sun_path, "%s", path);
+    if (connect(fd, (struct sockaddr*)&addr, sizeof addr) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static int send_all(int fd, const char* buf, size_t len) {
+    while (len > 0) {
+        ssize_t w = send(fd, buf, len, MSG_NOSIGNAL);
+        if (w <= 0) return -1;
+        buf += w;
+        len -= (size_t)w;
+    }
+    return 0;
+}
+
+// reads one reply; prints it when echo is set. Returns 1 for OK, 0 for ERR, -1 on disconnect
+static int read_reply(FILE* in, int echo) {
+    char line[512];
+    int rows = 0;
+
+    if (!fgets(line, sizeof line, in)) return -1;
+    if (echo) fputs(line, stdout);
+    if (strncmp(line, "OK", 2) != 0) return 0;
+    if (strcmp(line, "OK *\n") == 0) { // rows up to a line "."
+        while (fgets(line, sizeof line, in)) {
+            if (echo) fputs(line, stdout);
+            if (strcmp(line, ".\n") == 0) return 1;
+        }
+        return -1;
+    }
+    sscanf(line + 2, "%d", &rows);
+    for (int i = 0; i < rows; i++) {
+        if (!fgets(line, sizeof line, in)) return -1;
+        if (echo) fputs(line, stdout);
+    }
+    return 1;
+}
+
+static int run_interactive(const char* path) {
+    char line[512];
+    int fd = connect_to(path);
+    if (fd < 0) {
+        printf("Cannot connect to %s\n", path);
+        return 1;
+    }
+    FILE* in = fdopen(fd, "r");
+
+    while (fgets(line, sizeof line - 1, stdin)) { // room for the newline added below
+        size_t n = strlen(line);
+        if (n == 0 || line[n - 1] != '\n') {
+            line[n++] = '\n';
+            line[n] = '\0';
+        }
+        if (line[0] == '\n') continue;
+        if (send_all(fd, line, n) != 0 || read_reply(in, 1) < 0) {
+            printf("Server closed the connection.\n");
+            break;
+        }
+    }
+    fclose(in);
+    return 0;
+}
+
+static void* load_worker(void* arg) {
+    LoadWorker* w = arg;
+    int fd = connect_to(w->socketPath);
+    if (fd < 0) {
+        w->errors = w->requests;
+        return NULL;
+    }
+    FILE* in = fdopen(fd, "r");
+    uint64_t* sentAt = malloc((size_t)w->depth * sizeof *sentAt); // ring of in-flight send times
+    char* batch = malloc((size_t)w->depth * 96);
+    int sent = 0, done = 0;
+
+    while (done < w->requests) {
+        size_t len = 0;
+        uint64_t t = now_ns();
+        while (sent < w->requests && sent - done < w->depth) { // top the pipeline up in one write
+            int id = w->ids[rand_r(&w->seed) % w->idCount];
+            if ((int)(rand_r(&w->seed) % 100) < w->writePct) {
+                len += (size_t)sprintf(batch + len, "UPDATE\t%d\t\t\t%.1f\n", id, (rand_r(&w->seed) % 1000) / 10.0);
+            }
+            else {
+                len += (size_t)sprintf(batch + len, "QUERY\t%d\n", id);
+            }
+            sentAt[sent % w->depth] = t;
+            sent++;
+        }
+        if (len > 0 && send_all(fd, batch, len) != 0) break;
+
+        int rc = read_reply(in, 0);
+        if (rc < 0) break;
+        if (rc == 0) w->errors++;
+        w->latencies[done] = now_ns() - sentAt[done % w->depth];
+        done++;
+    }
+    w->errors += w->requests - done;
+    w->requests = done;
+
+    free(batch);
+    free(sentAt);
+    fclose(in);
+    return NULL;
+}
+
+static int cmp_u64(const void* a, const void* b) {
+    uint64_t x = *(const uint64_t*)a, y = *(const uint64_t*)b;
+    return (x > y) - (x < y);
+}
+
+static double percentile_us(const uint64_t* sorted, long n, double p) {
+    long i = (long)(p * (double)(n - 1) + 0.5);
+    return sorted[i] / 1000.0;
+}
+
+static int fetch_ids(const char* path, int** ids) { // the load uses ids that really exist
+    char line[512];
+    int rows = 0, n = 0;
+    int fd = connect_to(path);
+    if (fd < 0) return -1;
+    FILE* in = fdopen(fd, "r");
+    send_all(fd, "SHOWALL\n", 8);
+    if (fgets(line, sizeof line, in) && sscanf(line, "OK %d", &rows) == 1 && rows > 0) {
+        *ids = malloc((size_t)rows * sizeof **ids);
+        while (n < rows && fgets(line, sizeof line, in)) {
+            (*ids)[n++] = atoi(line);
+        }
+    }
+    fclose(in);
+    return n;
+}
+
+static int run_load(const char* path, int conns, int requests, int depth, int writePct) {
+    int* ids = NULL;
+    int idCount = fetch_ids(path, &ids);
+    if (idCount < 0) {
+        printf("Cannot connect to %s\n", path);
+        return 1;
+    }
+    if (idCount == 0) {
+        printf("Server has no records to query; run OPEN or INSERT first.\n");
+        return 1;
+    }
+
+    LoadWorker* workers = calloc((size_t)conns, sizeof *workers);
+    pthread_t* threads = malloc((size_t)conns * sizeof *threads);
+    for (int i = 0; i < conns; i++) {
+        workers[i].socketPath = path;
+        workers[i].ids = ids;
+        workers[i].idCount = idCount;
+        workers[i].requests = requests;
+        workers[i].depth = depth;
+        workers[i].writePct = writePct;
+        workers[i].seed = 12345u + (unsigned)i;
+        workers[i].latencies = malloc((size_t)requests * sizeof(uint64_t));
+    }
+
+    uint64_t start = now_ns();
+    for (int i = 0; i < conns; i++) pthread_create(&threads[i], NULL, load_worker, &workers[i]);
+    for (int i = 0; i < conns; i++) pthread_join(threads[i], NULL);
+    double elapsed = (now_ns() - start) / 1e9;
+
+    long total = 0, errors = 0;
+    for (int i = 0; i < conns; i++) total += workers[i].requests;
+    uint64_t* all = malloc((size_t)(total ? total : 1) * sizeof *all);
+    long k = 0;
+    for (int i = 0; i < conns; i++) {
+        memcpy(all + k, workers[i].latencies, (size_t)workers[i].requests * sizeof *all);
+        k += workers[i].requests;
+        errors += workers[i].errors;
+        free(workers[i].latencies);
+    }
+    qsort(all, (size_t)total, sizeof *all, cmp_u64);
+
+    printf("conns=%d depth=%d write%%=%d requests=%ld errors=%ld elapsed=%.3fs ops/sec=%.0f\n",
+        conns, depth, writePct, total, errors, elapsed, total / elapsed);
+    if (total > 0) {
+        printf("latency_us p50=%.1f p90=%.1f p99=%.1f p999=%.1f max=%.1f\n",
+            percentile_us(all, total, 0.50), percentile_us(all, total, 0.90),
+            percentile_us(all, total, 0.99), percentile_us(all, total, 0.999),
+            all[total - 1] / 1000.0);
+    }
+
+    free(all);
+    free(threads);
+    free(workers);
+    free(ids);
+    return errors == 0 ? 0 : 1;
+}
+
+int main(int argc, char* argv[]) {
+    const char* path = DEFAULT_SOCKET;
+    int argi = 1;
+
+    if (argi < argc && argv[argi][0] != '-') path = argv[argi++];
+    if (argi < argc && strcmp(argv[argi], "--load") == 0) {
+        int conns = 4, requests = 100000, depth = 16, writePct = 0;
+        for (argi++; argi + 1 < argc; argi += 2) {
+            if (strcmp(argv[argi], "-c") == 0) conns = atoi(argv[argi + 1]);
+            else if (strcmp(argv[argi], "-n") == 0) requests = atoi(argv[argi + 1]);
+            else if (strcmp(argv[argi], "-p") == 0) depth = atoi(argv[argi + 1]);
+            else if (strcmp(argv[argi], "-w") == 0) writePct = atoi(argv[argi + 1]);
+        }
+        if (conns < 1 || requests < 1 || depth < 1) {
+            printf("Connections, requests and depth must be positive.\n");
+            return 1;
+        }
+        return run_load(path, conns, requests, depth, writePct);
+    }
+    return run_interactive(path);
+}
+
+#else
+
+int main(void) {
+    printf("cms_client needs Unix domain sockets (Linux only).\n");
+    return 1;
+}
+
+#endif
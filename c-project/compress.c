@@ -0,0 +1,369 @@
+/*
+ *This file contains the compressed snapshot format (SAVE COMPRESSED).
+ *Rows are grouped into blocks of CMSZ_BLOCK_ROWS and stored column by column:
+ *  IDs        zigzag varint deltas from the previous row (tiny when the table is sorted by ID)
+ *  programmes varint index into a dictionary stored once in the file header
+ *  marks      fixed-point hundredths as zigzag varints
+ *  names      varint length + bytes, no padding
+ *Each block is then packed with a small LZ77 block compressor (LZ4-style sequences).
+ *OPEN recognises the magic and decodes one block at a time, so memory stays bounded.
+*/
+
+#define _CRT_SECURE_NO_WARNINGS
+#include "student_db.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define CMSZ_MAGIC "CMSZ1\0\0\0"
+#define CMSZ_BLOCK_ROWS 4096
+#define RAW_ROW_MAX (5 + 5 + 5 + 5 + MAX_TEXT_LEN)   // worst case encoded row
+#define LZ_HASH_BITS 14
+#define LZ_MIN_MATCH 4
+#define LZ_MAX_OFFSET 65535
+
+typedef struct { // programme dictionary, open addressing over an array of names
+    char (*names)[MAX_TEXT_LEN + 1];
+    int count;
+    int cap;
+    int* slots;      // index + 1, 0 = empty
+    int slotMask;
+} ProgDict;
+
+/* ---------- LZ block codec ---------- */
+
+static unsigned read32(const unsigned char* p) {
+    unsigned v;
+    memcpy(&v, p, sizeof v);
+    return v;
+}
+
+static int lz_bound(int n) {
+    return n + n / 255 + 16;
+}
+
+static unsigned char* put_length(unsigned char* op, int len) { // extra length bytes after a nibble of 15
+    while (len >= 255) {
+        *op++ = 255;
+        len -= 255;
+    }
+    *op++ = (unsigned char)len;
+    return op;
+}
+
+static int lz_compress(const unsigned char* src, int n, unsigned char* dst) {
+    static int table[1 << LZ_HASH_BITS];
+    unsigned char* op = dst;
+    int anchor = 0, ip = 0;
+
+    for (int i = 0; i < (1 << LZ_HASH_BITS); i++) table[i] = -1;
+
+    while (ip + LZ_MIN_MATCH <= n) {
+        unsigned seq = read32(src + ip);
+        unsigned h = (seq * 2654435761u) >> (32 - LZ_HASH_BITS);
+        int ref = table[h];
+        table[h] = ip;
+        if (ref < 0 || ip - ref > LZ_MAX_OFFSET || read32(src + ref) != seq) {
+            ip++;
+            continue;
+        }
+
+        int len = LZ_MIN_MATCH;
+        while (ip + len < n && src[ref + len] == src[ip + len]) len++;
+
+        int lit = ip - anchor;
+        int m = len - LZ_MIN_MATCH;
+        unsigned char* token = op++;
+        *token = (unsigned char)(((lit < 15 ? lit : 15) << 4) | (m < 15 ? m : 15));
+        if (lit >= 15) op = put_length(op, lit - 15);
+        memcpy(op, src + anchor, (size_t)lit);
+        op += lit;
+        *op++ = (unsigned char)((ip - ref) & 0xFF);
+        *op++ = (unsigned char)((ip - ref) >> 8);
+        if (m >= 15) op = put_length(op, m - 15);
+
+        ip += len;
+        anchor = ip;
+    }
+
+    int lit = n - anchor; // last sequence: literals only
+    *op++ = (unsigned char)((lit < 15 ? lit : 15) << 4);
+    if (lit >= 15) op = put_length(op, lit - 15);
+    memcpy(op, src + anchor, (size_t)lit);
+    op += lit;
+    return (int)(op - dst);
+}
+
+static int lz_decompress(const unsigned char* src, int n, unsigned char* dst, int cap) { // -1 if corrupt
+    int ip = 0, op = 0;
+    while (ip < n) {
+        int token = src[ip++];
+        int lit = token >> 4;
+        if (lit == 15) {
+            int b;
+            do {
+                if (ip >= n) return -1;
+                b = src[ip++];
+                lit += b;
+            } while (b == 255);
+        }
+        if (ip + lit > n || op + lit > cap) return -1;
+        memcpy(dst + op, src + ip, (size_t)lit);
+        ip += lit;
+        op += lit;
+        if (ip == n) break; // the last sequence has no match
+
+        if (ip + 2 > n) return -1;
+        int offset = src[ip] | (src[ip + 1] << 8);
+        ip += 2;
+        int len = (token & 15);
+        if (len == 15) {
+            int b;
+            do {
+                if (ip >= n) return -1;
+                b = src[ip++];
+                len += b;
+            } while (b == 255);
+        }
+        len += LZ_MIN_MATCH;
+        if (offset == 0 || offset > op || op + len > cap) return -1;
+        for (int k = 0; k < len; k++, op++) dst[op] = dst[op - offset]; // may overlap
+    }
+    return op;
+}
+
+/* ---------- varints ---------- */
+
+static unsigned char* put_varint(unsigned char* p, unsigned v) {
+    while (v >= 0x80) {
+        *p++ = (unsigned char)(v | 0x80);
+        v >>= 7;
+    }
+    *p++ = (unsigned char)v;
+    return p;
+}
+
+static const unsigned char* get_varint(const unsigned char* p, const unsigned char* end, unsigned* out) {
+    unsigned v = 0;
+    for (int shift = 0; shift < 35 && p < end; shift += 7) {
+        unsigned char b = *p++;
+        v |= (unsigned)(b & 0x7F) << shift;
+        if (!(b & 0x80)) {
+            *out = v;
+            return p;
+        }
+    }
+    return NULL;
+}
+
+static unsigned zigzag(int v) {
+    return ((unsigned)v << 1) ^ (unsigned)(v >> 31);
+}
+
+static int unzigzag(unsigned v) {
+    return (int)(v >> 1) ^ -(int)(v & 1);
+}
+
+static void put_u32(FILE* fp, unsigned v) {
+    unsigned char b[4] = { (unsigned char)v, (unsigned char)(v >> 8), (unsigned char)(v >> 16), (unsigned char)(v >> 24) };
+    fwrite(b, 1, 4, fp);
+}
+
+static int get_u32(FILE* fp, unsigned* v) {
+    unsigned char b[4];
+    if (fread(b, 1, 4, fp) != 4) return 0;
+    *v = b[0] | (b[1] << 8) | (b[2] << 16) | ((unsigned)b[3] << 24);
+    return 1;
+}
+
+/* ---------- programme dictionary ---------- */
+
+static unsigned hash_str(const char* s) { // FNV-1a
+    unsigned h = 2166136261u;
+    while (*s) h = (h ^ (unsigned char)*s++) * 16777619u;
+    return h;
+}
+
+static int dict_grow(ProgDict* d) {
+    int cap = d->cap ? d->cap * 2 : 64;
+    char (*names)[MAX_TEXT_LEN + 1] = realloc(d->names, (size_t)cap * sizeof *names);
+    int* slots = calloc((size_t)cap * 2, sizeof *slots);
+    if (!names || !slots) {
+        if (names) d->names = names;
+        free(slots);
+        return -1;
+    }
+    d->names = names;
+    d->cap = cap;
+    free(d->slots);
+    d->slots = slots;
+    d->slotMask = cap * 2 - 1;
+    for (int i = 0; i < d->count; i++) { // rehash
+        unsigned h = hash_str(d->names[i]) & (unsigned)d->slotMask;
+        while (d->slots[h]) h = (h + 1) & (unsigned)d->slotMask;
+        d->slots[h] = i + 1;
+    }
+    return 0;
+}
+
+static int dict_intern(ProgDict* d, const char* prog) { // index of prog, added if new, -1 when out of memory
+    if (d->count == d->cap && dict_grow(d) != 0) return -1;
+    unsigned h = hash_str(prog) & (unsigned)d->slotMask;
+    while (d->slots[h]) {
+        int i = d->slots[h] - 1;
+        if (strcmp(d->names[i], prog) == 0) return i;
+        h = (h + 1) & (unsigned)d->slotMask;
+    }
+    strcpy(d->names[d->count], prog);
+    d->slots[h] = d->count + 1;
+    return d->count++;
+}
+
+/* ---------- snapshot encoding ---------- */
+
+int cmsz_write(FILE* fp, const DbSnapshot* snap, atomic_long* progress) {
+    int count = snapshot_count(snap);
+    ProgDict dict = { 0 };
+    int* progOf = malloc((size_t)(count ? count : 1) * sizeof *progOf);
+    unsigned char* raw = malloc((size_t)CMSZ_BLOCK_ROWS * RAW_ROW_MAX);
+    unsigned char* packed = malloc((size_t)lz_bound(CMSZ_BLOCK_ROWS * RAW_ROW_MAX));
+    int rc = -1;
+
+    if (!progOf || !raw || !packed) goto done;
+    for (int i = 0; i < count; i++) {
+        progOf[i] = dict_intern(&dict, snapshot_row(snap, i)->programme);
+        if (progOf[i] < 0) goto done;
+    }
+
+    fwrite(CMSZ_MAGIC, 1, 8, fp);
+    put_u32(fp, (unsigned)count);
+    put_u32(fp, (unsigned)dict.count);
+    put_u32(fp, CMSZ_BLOCK_ROWS);
+    for (int k = 0; k < dict.count; k++) {
+        unsigned char len = (unsigned char)strlen(dict.names[k]);
+        fputc(len, fp);
+        fwrite(dict.names[k], 1, len, fp);
+    }
+
+    for (int start = 0; start < count; start += CMSZ_BLOCK_ROWS) {
+        int rows = count - start < CMSZ_BLOCK_ROWS ? count - start : CMSZ_BLOCK_ROWS;
+        unsigned char* p = raw;
+        int prevId = 0;
+
+        for (int i = start; i < start + rows; i++) { // column 1: ID deltas
+            int id = snapshot_row(snap, i)->id;
+            p = put_varint(p, zigzag((int)((unsigned)id - (unsigned)prevId)));
+            prevId = id;
+        }
+        for (int i = start; i < start + rows; i++) { // column 2: programme codes
+            p = put_varint(p, (unsigned)progOf[i]);
+        }
+        for (int i = start; i < start + rows; i++) { // column 3: marks in hundredths
+            float mark = snapshot_row(snap, i)->mark;
+            p = put_varint(p, zigzag((int)(mark * 100.0 + (mark < 0 ? -0.5 : 0.5))));
+        }
+        for (int i = start; i < start + rows; i++) { // column 4: names
+            const char* name = snapshot_row(snap, i)->name;
+            unsigned len = (unsigned)strlen(name);
+            p = put_varint(p, len);
+            memcpy(p, name, len);
+            p += len;
+        }
+
+        int rawLen = (int)(p - raw);
+        int packedLen = lz_compress(raw, rawLen, packed);
+        put_u32(fp, (unsigned)rows);
+        put_u32(fp, (unsigned)rawLen);
+        put_u32(fp, (unsigned)packedLen);
+        fwrite(packed, 1, (size_t)packedLen, fp);
+        if (progress) atomic_store(progress, start + rows);
+    }
+    rc = ferror(fp) ? -1 : 0;
+
+done:
+    free(progOf);
+    free(raw);
+    free(packed);
+    free(dict.names);
+    free(dict.slots);
+    return rc;
+}
+
+int cmsz_is_compressed(FILE* fp) { // checks the magic and leaves fp after it if it matches
+    char magic[8];
+    if (fread(magic, 1, 8, fp) == 8 && memcmp(magic, CMSZ_MAGIC, 8) == 0) return 1;
+    rewind(fp);
+    return 0;
+}
+
+int cmsz_read(FILE* fp) { // decodes rows into records[] through db_load_row, -1 if corrupt
+    unsigned total, dictCount, blockRows;
+    char (*dict)[MAX_TEXT_LEN + 1] = NULL;
+    unsigned char* raw = NULL;
+    unsigned char* packed = NULL;
+    int rc = -1;
+
+    if (!get_u32(fp, &total) || !get_u32(fp, &dictCount) || !get_u32(fp, &blockRows)) return -1;
+    if (blockRows == 0 || blockRows > 1u << 20) return -1;
+
+    int rawCap = (int)blockRows * RAW_ROW_MAX;
+    dict = malloc((size_t)(dictCount ? dictCount : 1) * sizeof *dict);
+    raw = malloc((size_t)rawCap);
+    packed = malloc((size_t)lz_bound(rawCap));
+    if (!dict || !raw || !packed) goto done;
+
+    for (unsigned k = 0; k < dictCount; k++) {
+        int len = fgetc(fp);
+        if (len == EOF || len > MAX_TEXT_LEN || fread(dict[k], 1, (size_t)len, fp) != (size_t)len) goto done;
+        dict[k][len] = '\0';
+    }
+
+    for (unsigned done = 0; done < total;) {
+        unsigned rows, rawLen, packedLen;
+        if (!get_u32(fp, &rows) || !get_u32(fp, &rawLen) || !get_u32(fp, &packedLen)) goto done;
+        if (rows == 0 || rows > blockRows || rawLen > (unsigned)rawCap || packedLen > (unsigned)lz_bound(rawCap)) goto done;
+        if (fread(packed, 1, packedLen, fp) != packedLen) goto done;
+        if (lz_decompress(packed, (int)packedLen, raw, (int)rawLen) != (int)rawLen) goto done;
+
+        // walk the four columns in parallel; offsets of columns 2-4 are found first
+        const unsigned char* end = raw + rawLen;
+        const unsigned char* col[4];
+        unsigned v;
+        col[0] = raw;
+        for (int c = 1; c < 4; c++) {
+            const unsigned char* p = col[c - 1];
+            for (unsigned i = 0; i < rows && p; i++) p = get_varint(p, end, &v);
+            if (!p) goto done;
+            col[c] = p;
+        }
+
+        int id = 0;
+        for (unsigned i = 0; i < rows; i++) {
+            StudentRecord rec;
+            char name[MAX_TEXT_LEN + 1];
+            unsigned delta, prog, mark, len;
+            if (!(col[0] = get_varint(col[0], end, &delta)) ||
+                !(col[1] = get_varint(col[1], end, &prog)) ||
+                !(col[2] = get_varint(col[2], end, &mark)) ||
+                !(col[3] = get_varint(col[3], end, &len))) goto done;
+            if (prog >= dictCount || len > MAX_TEXT_LEN || col[3] + len > end) goto done;
+
+            id = (int)((unsigned)id + (unsigned)unzigzag(delta));
+            rec.id = id;
+            memcpy(name, col[3], len);
+            name[len] = '\0';
+            col[3] += len;
+            rec_set_name(&rec, name, NULL);
+            rec_set_programme(&rec, dict[prog], NULL);
+            rec.mark = (float)(unzigzag(mark) / 100.0);
+            if (db_load_row(&rec) < 0) goto done;
+        }
+        done += rows;
+    }
+    rc = 0;
+
+done:
+    free(dict);
+    free(raw);
+    free(packed);
+    return rc;
+}
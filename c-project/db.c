@@ -0,0 +1,84 @@
+/*
+ *This file contains the in-memory table shared by every operation.
+ *records[] starts with room for INITIAL_RECORDS rows and doubles as needed,
+ *so the same code handles the three-row sample file and multi-million row cohorts.
+ *With the memory-mapped engine records[] points into the mapping instead (mmapstore.c).
+*/
+
+#define _CRT_SECURE_NO_WARNINGS
+#include "student_db.h"
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+
+StudentRecord* records = NULL;
+int recordCount = 0;
+int recordCapacity = 0;
+
+int db_reserve(int count) { // make room for count rows, returns 0 or -1 when out of memory
+    if (count <= recordCapacity) return 0;
+    if (mstore_active()) return mstore_reserve(count);
+
+    int capacity = recordCapacity ? recordCapacity : INITIAL_RECORDS;
+    while (capacity < count) capacity *= 2;
+
+    StudentRecord* grown = realloc(records, (size_t)capacity * sizeof *grown);
+    if (!grown) return -1;
+    records = grown;
+    recordCapacity = capacity;
+    return 0;
+}
+
+static long long mtime_ns(const struct stat* st) {
+#ifdef __linux__
+    return (long long)st->st_mtim.tv_sec * 1000000000ll + st->st_mtim.tv_nsec; // two SAVEs can share a second
+#else
+    return (long long)st->st_mtime * 1000000000ll;
+#endif
+}
+
+const char* storage_path(void) { // the file OPEN reads: the compressed copy only when it was saved after the text file
+    struct stat text, packed;
+    if (stat(FILENAME_COMPRESSED, &packed) != 0) return FILENAME;
+    if (stat(FILENAME, &text) != 0) return FILENAME_COMPRESSED;
+    return mtime_ns(&packed) > mtime_ns(&text) ? FILENAME_COMPRESSED : FILENAME;
+}
+
+int storage_open(void) { // OPEN through the configured engine: text file (maybe lazily), shard files or memory-mapped store
+    if (mstore_enabled()) return mstore_open();
+    if (lazy_enabled()) return lazy_open(storage_path());
+    return shard_count() > 0 ? shard_open(FILENAME) : db_open(storage_path());
+}
+
+int storage_save(SaveFormat format) { // the text engine writes in the background (only dirty shards), see 7save.c
+    if (format == FORMAT_COMPRESSED) return db_save_background(FILENAME_COMPRESSED, format); // also from the mmap engine
+    if (format != FORMAT_TEXT) return db_save_background(FILENAME, format);
+    return mstore_enabled() ? mstore_sync() : db_save_background(FILENAME, FORMAT_TEXT);
+}
+
+unsigned long long clock_ns(void) { // monotonic time for measurements
+    struct timespec ts;
+#ifdef CLOCK_MONOTONIC
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+#else
+    timespec_get(&ts, TIME_UTC);
+#endif
+    return (unsigned long long)ts.tv_sec * 1000000000ull + (unsigned long long)ts.tv_nsec;
+}
+
+// Checksum of one line of a text database, chained over the file. Line endings are
+// left out so CRLF and LF copies agree. SAVE and OPEN both feed every line to it,
+// which is how OPEN knows a saved index (<file>.idx) belongs to the file it read.
+unsigned long long line_checksum(unsigned long long sum, const char* line) {
+    size_t n = strcspn(line, "\r\n");
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) { // a word at a time
+        unsigned long long w;
+        memcpy(&w, line + i, 8);
+        sum = (sum ^ w) * 0x100000001b3ull;
+        sum ^= sum >> 29;
+    }
+    for (; i < n; i++) sum = (sum ^ (unsigned char)line[i]) * 0x100000001b3ull;
+    return (sum ^ n) * 0x9E3779B97F4A7C15ull; // line boundary
+}
@@ -0,0 +1,275 @@
+/*
+ *This file contains the external merge sort (student_db --sort-file <output>).
+ *It writes the rows of the text file sorted by SORT BY columns without loading the
+ *table, so cohort files larger than memory can be exported on small machines:
+ *  - the file is read in runs that fit the memory budget (--sort-memory MB)
+ *  - each run is sorted in memory with the binary keys of 8sort.c and written to a
+ *    run file next to the output, every line preceded by its key
+ *  - the run files are merged with a heap on those keys, MERGE_FANIN at a time
+ *    (more runs take another pass); the last pass writes just the lines
+ *Lines are copied as they are, so the output is the input reordered: the header
+ *before the first row is kept, malformed lines are dropped and, unlike OPEN, rows
+ *with the same ID are all kept. Rows with equal columns keep their order in the file.
+*/
+
+#define _CRT_SECURE_NO_WARNINGS
+#include "student_db.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define MERGE_FANIN 64          // run files merged at once
+#define MIN_BUDGET (1 << 20)
+
+typedef struct {
+    FILE* fp;
+    unsigned char* key;
+    char line[MAX_LINE_LEN + 1];
+} RunReader;
+
+typedef struct {
+    const char* out;
+    SortLayout layout;
+    size_t budget;
+    int* ids;           // run files still to merge, <out>.run<id>
+    int runs;
+    int nextId;
+    int passes;
+} ExtSort;
+
+static void run_path(char* path, size_t n, const ExtSort* s, int id) {
+    snprintf(path, n, "%s.run%d", s->out, id);
+}
+
+static void remove_runs(const ExtSort* s) {
+    char path[300];
+    for (int i = 0; i < s->runs; i++) {
+        run_path(path, sizeof path, s, s->ids[i]);
+        remove(path);
+    }
+}
+
+static int add_run(ExtSort* s) { // the id for a new run file, or -1 when out of memory
+    int* grown = realloc(s->ids, (size_t)(s->runs + 1) * sizeof *grown);
+    if (!grown) return -1;
+    s->ids = grown;
+    s->ids[s->runs++] = s->nextId;
+    return s->nextId++;
+}
+
+// Writes one sorted run: to dst directly when it is the whole file, otherwise to a run file with keys
+static int write_run(ExtSort* s, FILE* dst, const char* text, const size_t* lineAt, const unsigned char* keys,
+    unsigned* order, int rows) {
+    char path[300];
+    size_t width = s->layout.width;
+    FILE* fp = dst;
+    TRACE_START(t0);
+    if (sort_keys(keys, width, rows, order) != 0) return -1;
+    if (!dst) {
+        int id = add_run(s);
+        if (id < 0) return -1;
+        run_path(path, sizeof path, s, id);
+        fp = fopen(path, "wb");
+        if (fp == NULL) return -1;
+    }
+    for (int i = 0; i < rows; i++) {
+        if (!dst) fwrite(keys + (size_t)order[i] * width, 1, width, fp);
+        fputs(text + lineAt[order[i]], fp);
+    }
+    TRACE_STOP("extsort.run", t0);
+    if (dst) return ferror(dst) ? -1 : 0;
+    int failed = ferror(fp);
+    return fclose(fp) != 0 || failed ? -1 : 0;
+}
+
+static int next_row(RunReader* r, size_t width) { // 1 if r holds the run's next key and line
+    return fread(r->key, 1, width, r->fp) == width && fgets(r->line, sizeof r->line, r->fp) != NULL;
+}
+
+static void sift_down(RunReader** heap, int n, int i, size_t width) {
+    while (1) {
+        int least = i, l = 2 * i + 1, r = l + 1;
+        if (l < n && memcmp(heap[l]->key, heap[least]->key, width) < 0) least = l;
+        if (r < n && memcmp(heap[r]->key, heap[least]->key, width) < 0) least = r;
+        if (least == i) return;
+        RunReader* t = heap[i];
+        heap[i] = heap[least];
+        heap[least] = t;
+        i = least;
+    }
+}
+
+// k-way merge of run files ids[0..k) into out; keys are written too unless out is the final file
+static int merge_runs(ExtSort* s, const int* ids, int k, FILE* out, int keepKeys) {
+    char path[300];
+    size_t width = s->layout.width;
+    size_t buffer = s->budget / (size_t)(k + 1); // each input and the output read ahead / write behind
+    RunReader* readers = calloc((size_t)k, sizeof *readers);
+    RunReader** heap = malloc((size_t)k * sizeof *heap);
+    unsigned char* keys = malloc((size_t)k * width);
+    int n = 0, rc = 0;
+    if (!readers || !heap || !keys) rc = -1;
+
+    for (int i = 0; rc == 0 && i < k; i++) {
+        run_path(path, sizeof path, s, ids[i]);
+        readers[i].fp = fopen(path, "rb");
+        readers[i].key = keys + (size_t)i * width;
+        if (readers[i].fp == NULL) {
+            rc = -1;
+            break;
+        }
+        setvbuf(readers[i].fp, NULL, _IOFBF, buffer);
+        if (next_row(&readers[i], width)) heap[n++] = &readers[i];
+    }
+    TRACE_START(t0);
+    if (rc == 0) {
+        for (int i = n / 2 - 1; i >= 0; i--) sift_down(heap, n, i, width);
+        while (n > 0) {
+            RunReader* top = heap[0];
+            if (keepKeys) fwrite(top->key, 1, width, out);
+            fputs(top->line, out);
+            if (!next_row(top, width)) heap[0] = heap[--n];
+            sift_down(heap, n, 0, width);
+        }
+        if (ferror(out)) rc = -1;
+    }
+    TRACE_STOP("extsort.merge", t0);
+    for (int i = 0; readers && i < k; i++) {
+        if (readers[i].fp) fclose(readers[i].fp);
+    }
+    free(readers);
+    free(heap);
+    free(keys);
+    return rc;
+}
+
+static int merge_pass(ExtSort* s) { // MERGE_FANIN runs at a time into new runs
+    char path[300];
+    int* ids = s->ids;
+    int runs = s->runs;
+    s->ids = NULL;
+    s->runs = 0;
+    int rc = 0;
+
+    for (int first = 0; first < runs; first += MERGE_FANIN) {
+        int k = runs - first < MERGE_FANIN ? runs - first : MERGE_FANIN;
+        int id = rc == 0 ? add_run(s) : -1;
+        FILE* fp = NULL;
+        if (id >= 0) {
+            run_path(path, sizeof path, s, id);
+            fp = fopen(path, "wb");
+        }
+        if (fp == NULL || merge_runs(s, ids + first, k, fp, 1) != 0) rc = -1;
+        if (fp && fclose(fp) != 0) rc = -1;
+        for (int i = first; i < first + k; i++) { // merged, or given up on
+            run_path(path, sizeof path, s, ids[i]);
+            remove(path);
+        }
+    }
+    free(ids);
+    s->passes++;
+    return rc;
+}
+
+// Reads the text file in and writes it sorted to out: 0, -1 if in cannot be read or is
+// compressed, -2 if out of memory or the output or run files cannot be written
+int db_sort_file(const char* in, const char* out, const SortKey* keys, int count, size_t budget, SortFileResult* res) {
+    ExtSort s = { 0 };
+    ArenaUsage u;
+    char line[MAX_LINE_LEN + 1];
+    char tmp[290];
+    StudentRecord rec;
+    long long total = 0;
+    int lineStart = 1, header = 1, rc = 0;
+
+    s.out = out;
+    s.budget = budget < MIN_BUDGET ? MIN_BUDGET : budget;
+    sort_layout(&s.layout, keys, count, NULL, 0);
+
+    // half the budget holds the run's lines (a third with arena strings, which copy the
+    // names once more), the rest its keys, line offsets and the sort's work arrays
+    arena_usage(&u);
+    size_t textCap = s.budget / (u.arena ? 3 : 2);
+    size_t perRow = s.layout.width + sizeof(size_t) + sizeof(unsigned) + 32;
+    int rowCap = (int)((s.budget - textCap * (u.arena ? 2 : 1)) / perRow);
+
+    FILE* src = fopen(in, "rb");
+    if (src == NULL) return -1;
+    if (cmsz_is_compressed(src)) {
+        fclose(src);
+        return -1;
+    }
+    snprintf(tmp, sizeof tmp, "%s.tmp", out);
+    FILE* dst = fopen(tmp, "wb");
+    char* text = malloc(textCap);
+    size_t* lineAt = malloc((size_t)rowCap * sizeof *lineAt);
+    unsigned char* keyBuf = malloc((size_t)rowCap * s.layout.width);
+    unsigned* order = malloc((size_t)rowCap * sizeof *order);
+    StrPool* strings = pool_new(); // NULL in fixed-array builds
+    size_t used = 0;
+    int rows = 0;
+    if (!dst || !text || !lineAt || !keyBuf || !order) rc = -1;
+
+    while (rc == 0 && fgets(line, MAX_LINE_LEN, src) != NULL) {
+        size_t len = strlen(line);
+        int wasStart = lineStart;
+        lineStart = len > 0 && line[len - 1] == '\n';
+        if (!lineStart && !feof(src)) { // longer than a row can be: skip it, as OPEN does
+            continue;
+        }
+        if (!wasStart) continue; // the tail of such a line
+        if (rows == rowCap || used + len + 2 > textCap) { // the run is full: write it before parsing into a new pool
+            rc = write_run(&s, NULL, text, lineAt, keyBuf, order, rows);
+            rows = 0;
+            used = 0;
+            arena_unpin(strings);
+            strings = pool_new();
+        }
+        if (!db_parse_row(line, &rec, strings)) {
+            if (header) fputs(line, dst); // text before the first row stays on top
+            continue;
+        }
+        header = 0;
+        if (!lineStart) { // the last line has no newline
+            line[len++] = '\n';
+            line[len] = '\0';
+        }
+        memcpy(text + used, line, len + 1);
+        lineAt[rows] = used;
+        used += len + 1;
+        sort_encode(&s.layout, keyBuf + (size_t)rows * s.layout.width, &rec, (unsigned long long)total);
+        rows++;
+        total++;
+    }
+    fclose(src);
+
+    if (rc == 0) { // the last run: straight to the output when it is the only one
+        rc = write_run(&s, s.runs == 0 ? dst : NULL, text, lineAt, keyBuf, order, rows);
+    }
+    arena_unpin(strings);
+    free(text);
+    free(lineAt);
+    free(keyBuf);
+    free(order);
+
+    int spilled = s.runs;
+    while (rc == 0 && s.runs > MERGE_FANIN) rc = merge_pass(&s);
+    if (rc == 0 && s.runs > 0) {
+        rc = merge_runs(&s, s.ids, s.runs, dst, 0);
+        s.passes++;
+    }
+    remove_runs(&s);
+    free(s.ids);
+
+    if (dst && (fclose(dst) != 0 || rc != 0)) rc = -1;
+#ifdef _WIN32
+    if (rc == 0) remove(out); // rename does not replace an existing file on Windows
+#endif
+    if (rc != 0 || rename(tmp, out) != 0) {
+        remove(tmp);
+        return -2;
+    }
+    res->rows = total;
+    res->runs = spilled;
+    res->passes = s.passes;
+    return 0;
+}
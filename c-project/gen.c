@@ -0,0 +1,238 @@
+/*
+ *This file contains the synthetic dataset generator (cms_gen).
+ *It writes files in the same header-plus-TSV layout as Sample-CMS.txt, so OPEN,
+ *the index and the benchmark can be exercised at any scale. The same seed always
+ *produces the same file.
+ *
+ *TO BUILD: gcc -O2 -o cms_gen gen.c -lm
+ *TO RUN:   ./cms_gen [-n rows] [-o file] [-seed S] [-ids seq|clustered|sparse] [-start id]
+ *                    [-zipf s] [-marks normal|uniform|bimodal] [-bad pct] [-dup pct]
+ *  -ids   seq: consecutive IDs from -start; clustered: intake cohorts of consecutive IDs
+ *         scattered over the ID space; sparse: random IDs anywhere above -start
+ *  -zipf  skew of the programme distribution (0 = uniform, default 1.1)
+ *  -bad   percentage of deliberately malformed lines (OPEN must skip them)
+ *  -dup   percentage of rows that repeat an earlier ID (OPEN keeps the first)
+*/
+
+#define _CRT_SECURE_NO_WARNINGS
+#include "student_db.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define COHORT_SIZE 250       // consecutive IDs per intake cohort in clustered mode
+#define MAX_ID 2147483647
+
+static const char* firstNames[] = {
+    "Joshua", "Isaac", "John", "Wei Ling", "Muhammad", "Siti Nur", "Priya", "Aloysius",
+    "Bartholomew", "Chen", "Emmanuelle", "Hui Qi", "Kavitha", "Nicholas", "Xiao Ming", "Zainab"
+};
+static const char* lastNames[] = {
+    "Chen", "Teo", "Levoy", "Tan", "Abdullah", "Ramasamy", "Fernandez", "Ong",
+    "Wijayakusuma", "Goh", "Balakrishnan", "Lim", "Sitinjak", "Krishnamoorthy", "Ng", "Foo"
+};
+static const char* programmes[] = {
+    "Computer Science", "Software Engineering", "Digital Supply Chain", "Applied Artificial Intelligence",
+    "Information Security", "Applied Computing in Fintech", "Electrical Power Engineering",
+    "Mechanical Design and Manufacturing", "Chemical Engineering", "Civil Engineering",
+    "Accountancy", "Hospitality Business", "Digital Communication and Media",
+    "Food Technology", "Nursing", "Physiotherapy", "Occupational Therapy", "Diagnostic Radiography",
+    "Aircraft Systems Engineering", "Sustainable Infrastructure Engineering",
+    "Telematics (Intelligent Transportation)", "Pharmaceutical Engineering",
+    "Robotics Systems", "Interactive Media Arts"
+};
+
+#define N_FIRST (int)(sizeof firstNames / sizeof firstNames[0])
+#define N_LAST (int)(sizeof lastNames / sizeof lastNames[0])
+#define N_PROG (int)(sizeof programmes / sizeof programmes[0])
+
+typedef struct { // set of IDs already generated
+    int* keys;
+    unsigned mask;
+} IdSet;
+
+static unsigned long long rng;
+
+static unsigned long long next_rand(void) { // splitmix64
+    unsigned long long z = (rng += 0x9E3779B97F4A7C15ull);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    return z ^ (z >> 31);
+}
+
+static double uniform01(void) {
+    return (double)(next_rand() >> 11) / 9007199254740992.0;
+}
+
+static int idset_add(IdSet* s, int id) { // returns 0 if id was already present
+    unsigned h = ((unsigned)id * 2654435761u) & s->mask;
+    while (s->keys[h] != 0) {
+        if (s->keys[h] == id) return 0;
+        h = (h + 1) & s->mask;
+    }
+    s->keys[h] = id;
+    return 1;
+}
+
+static int next_id(const char* mode, int start, long i, long rows, int* cohortNext, int* cohortLeft) {
+    if (strcmp(mode, "seq") == 0) {
+        return start + (int)i;
+    }
+    if (strcmp(mode, "clustered") == 0) {
+        if (*cohortLeft == 0) { // start a new cohort somewhere in a space 4x the table size
+            long cohorts = rows / COHORT_SIZE * 4 + 16;
+            *cohortNext = start + (int)(next_rand() % (unsigned long long)cohorts) * COHORT_SIZE;
+            *cohortLeft = COHORT_SIZE;
+        }
+        (*cohortLeft)--;
+        return (*cohortNext)++;
+    }
+    return start + (int)(next_rand() % (unsigned long long)(MAX_ID - start)); // sparse
+}
+
+static void make_name(char* out) { // mostly short names, a long tail up to MAX_NAME_LEN - 1
+    int len = snprintf(out, MAX_NAME_LEN, "%s %s", firstNames[next_rand() % N_FIRST],
+        lastNames[next_rand() % N_LAST]);
+    int target = (next_rand() % 4 == 0) ? MAX_NAME_LEN - 1 - (int)(next_rand() % 6) : len;
+    while (len < target) {
+        const char* extra = lastNames[next_rand() % N_LAST];
+        int room = target - len - 1;
+        if (room <= 0) break;
+        len += snprintf(out + len, MAX_NAME_LEN - len, " %.*s", room, extra);
+    }
+}
+
+static float make_mark(const char* dist) {
+    double m;
+    if (strcmp(dist, "uniform") == 0) {
+        m = uniform01() * 100.0;
+    }
+    else {
+        double mean = 65.0, sd = 12.0;
+        if (strcmp(dist, "bimodal") == 0) { // a failing group and a passing group
+            mean = (next_rand() % 3 == 0) ? 38.0 : 74.0;
+            sd = 8.0;
+        }
+        double u1 = uniform01(), u2 = uniform01(); // Box-Muller
+        if (u1 < 1e-12) u1 = 1e-12;
+        m = mean + sd * sqrt(-2.0 * log(u1)) * cos(6.283185307179586 * u2);
+    }
+    if (m < 0) m = 0;
+    if (m > 100) m = 100;
+    return (float)m;
+}
+
+static int pick_programme(const double* cdf) {
+    double u = uniform01();
+    int lo = 0, hi = N_PROG - 1;
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (cdf[mid] < u) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo;
+}
+
+static void write_malformed(FILE* fp, int id, const char* name) {
+    switch (next_rand() % 6) {
+    case 0: fprintf(fp, "%d\t%s\t%.1f\n", id, name, 50.0); break;                    // missing field
+    case 1: fprintf(fp, "S%d\t%s\tComputer Science\t60.0\n", id, name); break;         // bad ID
+    case 2: fprintf(fp, "%d\t%s\tComputer Science\tabsent\n", id, name); break;        // bad mark
+    case 3: fprintf(fp, "%d\t%s %s %s\tNursing\t55.5\n", id, name, name, name); break; // name too long
+    case 4: fprintf(fp, "\n"); break;                                                  // blank line
+    default: fprintf(fp, "%d %s Software Engineering 70.0\n", id, name); break;        // spaces, not tabs
+    }
+}
+
+int main(int argc, char* argv[]) {
+    long rows = 1000;
+    const char* outPath = NULL;
+    const char* idMode = "seq";
+    const char* markDist = "normal";
+    unsigned long long seed = 1;
+    int start = 2300000;
+    double zipf = 1.1, badPct = 0, dupPct = 0;
+
+    for (int i = 1; i + 1 < argc; i += 2) {
+        if (strcmp(argv[i], "-n") == 0) rows = atol(argv[i + 1]);
+        else if (strcmp(argv[i], "-o") == 0) outPath = argv[i + 1];
+        else if (strcmp(argv[i], "-seed") == 0) seed = strtoull(argv[i + 1], NULL, 10);
+        else if (strcmp(argv[i], "-ids") == 0) idMode = argv[i + 1];
+        else if (strcmp(argv[i], "-start") == 0) start = atoi(argv[i + 1]);
+        else if (strcmp(argv[i], "-zipf") == 0) zipf = atof(argv[i + 1]);
+        else if (strcmp(argv[i], "-marks") == 0) markDist = argv[i + 1];
+        else if (strcmp(argv[i], "-bad") == 0) badPct = atof(argv[i + 1]);
+        else if (strcmp(argv[i], "-dup") == 0) dupPct = atof(argv[i + 1]);
+        else {
+            printf("Unknown option %s\n", argv[i]);
+            return 1;
+        }
+    }
+    if (rows < 1 || start < 1 ||
+        (strcmp(idMode, "seq") != 0 && strcmp(idMode, "clustered") != 0 && strcmp(idMode, "sparse") != 0)) {
+        printf("Usage: cms_gen [-n rows] [-o file] [-seed S] [-ids seq|clustered|sparse] [-start id]\n"
+               "               [-zipf s] [-marks normal|uniform|bimodal] [-bad pct] [-dup pct]\n");
+        return 1;
+    }
+    if (strcmp(idMode, "seq") == 0 && rows > MAX_ID - start) {
+        printf("Too many rows for sequential IDs starting at %d.\n", start);
+        return 1;
+    }
+
+    FILE* fp = outPath ? fopen(outPath, "w") : stdout;
+    if (!fp) {
+        printf("Error opening %s for writing!\n", outPath);
+        return 1;
+    }
+
+    double cdf[N_PROG], total = 0;
+    for (int k = 0; k < N_PROG; k++) {
+        total += 1.0 / pow(k + 1, zipf);
+        cdf[k] = total;
+    }
+    for (int k = 0; k < N_PROG; k++) cdf[k] /= total;
+
+    IdSet seen;
+    unsigned tableSize = 1024;
+    while (tableSize < (unsigned long)rows * 2) tableSize *= 2;
+    seen.keys = calloc(tableSize, sizeof *seen.keys);
+    seen.mask = tableSize - 1;
+    if (!seen.keys) {
+        printf("Out of memory.\n");
+        return 1;
+    }
+
+    rng = seed;
+    fprintf(fp, "Database Name: Sample-CMS\n"); // same header saveDatabase() writes
+    fprintf(fp, "Authors: Assistant Prof Oran Zane Devilly\n");
+    fprintf(fp, "\n");
+    fprintf(fp, "Table Name: StudentRecords\n");
+    fprintf(fp, "ID\tName\t\tProgramme\t\tMark\n");
+
+    char name[MAX_NAME_LEN];
+    int cohortNext = 0, cohortLeft = 0, lastId = start;
+    for (long i = 0; i < rows; i++) {
+        int id;
+        double roll = uniform01() * 100.0;
+
+        make_name(name);
+        if (roll < badPct) {
+            write_malformed(fp, start + (int)(next_rand() % 1000), name);
+            continue;
+        }
+        if (roll < badPct + dupPct && i > 0) {
+            id = lastId; // an ID that is already in the file
+        }
+        else {
+            do {
+                id = next_id(idMode, start, i, rows, &cohortNext, &cohortLeft);
+            } while (!idset_add(&seen, id) && strcmp(idMode, "seq") != 0);
+            lastId = id;
+        }
+        fprintf(fp, "%d\t%s\t%s\t%.1f\n", id, name, programmes[pick_programme(cdf)], make_mark(markDist));
+    }
+
+    free(seen.keys);
+    if (fp != stdout) fclose(fp);
+    return 0;
+}
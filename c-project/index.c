@@ -1,19 +1,61 @@
 /*
  *This file contains the fast lookup functionality.
  *It includes Fast Lookup: open-addressing hash index (ID -> array index)
+ *Each IdIndex is an independent table so snapshots can own a private copy;
+ *the index_* functions operate on the index used by the command loop.
+ *Two layouts share the idindex_* API and are chosen when building:
+ *  default            linear probing, kept at most half full
+ *  -DCMS_SWISS_INDEX  Swiss table: power-of-two capacity, a control byte per slot
+ *                     holding 7 bits of the hash, probed 16 slots at a time (SSE2)
+ *SAVE INDEX writes the table to <file>.idx tagged with the data file's checksum;
+ *OPEN reads it back instead of rebuilding when the tag still matches and every
+ *slot checks out against the rows just read (a damaged file means a rebuild).
+ *INDEX STATIC switches to a read-optimised index: after OPEN, SORT or DELETE the IDs
+ *are laid out as a sorted array in Eytzinger (BFS) order, and rows inserted afterwards
+ *go to the hash table until the next rebuild. The layout is never changed once built,
+ *so snapshots share it (index_static_share) and their readers search it too.
+ *INDEX STATS reports the load factor, a histogram of probe lengths and the
+ *resizes, rebuilds and dropped keys, so IDs that defeat hmix() show up as long probes.
 */
 
 
 #include "student_db.h"
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
 
-#define HSIZE 257
+#ifdef CMS_SWISS_INDEX
+#define DEFAULT_MAX_LOAD 87 // percent; group probing stays short up to ~7/8 full
+#else
+#define DEFAULT_MAX_LOAD 50
+#endif
+
+#define INDEX_MAGIC "CMSIDX1"
 
 typedef struct {
-    int key;
-    int pos;
-} Slot;
+    char magic[8];
+    char kind[8];                 // idindex_kind() of the writer
+    unsigned int slotBytes;
+    int size;
+    int used;
+    int rows;                     // rows in the data file
+    unsigned long long checksum;  // line_checksum() over the data file
+} IndexFileHeader;
+
+static IdIndex mainIndex;   // the whole index, or only post-load inserts in static mode
+static int maxLoad = DEFAULT_MAX_LOAD;
+
+static int rebuilds = 0;
+static int staticMode = 0;
 
-static Slot indexTable[HSIZE];
+struct StaticIndex {
+    atomic_int refs;
+    int count;
+    int* keys; // 1-based, node k has children 2k and 2k+1
+    int* pos;
+};
+
+static StaticIndex* layout = NULL; // the Eytzinger layout in static mode
 
 static unsigned hmix(unsigned x) {
     x ^= x >> 16; x *= 0x7feb352d;
@@ -22,50 +64,765 @@ static unsigned hmix(unsigned x) {
     return x;
 }
 
-static void index_clear(void) {
-    for (int i = 0; i < HSIZE; i++) {
-        indexTable[i].key = 0;
-        indexTable[i].pos = -1;
+static int over_load(int used, int size) {
+    return (long long)used * 100 > (long long)size * maxLoad;
+}
+
+void idindex_set_max_load(int percent) { // for benchmarks, 0 restores the default; affects later growth
+    if (percent == 0) percent = DEFAULT_MAX_LOAD;
+    maxLoad = percent < 10 ? 10 : percent > 97 ? 97 : percent;
+}
+
+#ifndef CMS_SWISS_INDEX
+
+#define HSIZE 257
+
+const char* idindex_kind(void) {
+    return "linear";
+}
+
+static int table_size_for(int count) { // smallest size that keeps the table within maxLoad
+    int size = HSIZE;
+    while (over_load(count, size)) size = size * 2 + 1;
+    return size;
+}
+
+static void idindex_clear(IdIndex* ix) {
+    for (int i = 0; i < ix->size; i++) {
+        ix->slots[i].key = 0;
+        ix->slots[i].pos = -1;
     }
+    ix->used = 0;
+    ix->dropped = 0;
 }
 
-void index_build(const StudentRecord* recs, int count) {
-    index_clear();
+static int slot_for(const IdIndex* ix, int id) { // slot holding id, else the empty slot ending its chain
+    unsigned h = hmix((unsigned)id) % ix->size;
+    for (int step = 0; step < ix->size; step++, h = (h + 1) % ix->size) {
+        if (ix->slots[h].key == 0 || ix->slots[h].key == id) return (int)h;
+    }
+    return -1;
+}
+
+static int idindex_resize(IdIndex* ix, int size) {
+    IdIndex bigger = { 0 };
+    bigger.slots = malloc((size_t)size * sizeof *bigger.slots);
+    if (!bigger.slots) return -1;
+    bigger.size = size;
+    idindex_clear(&bigger);
+    bigger.grows = ix->grows + 1;
+    bigger.dropped = ix->dropped;
+
+    for (int i = 0; i < ix->size; i++) {
+        if (ix->slots[i].key != 0) {
+            bigger.slots[slot_for(&bigger, ix->slots[i].key)] = ix->slots[i];
+            bigger.used++;
+        }
+    }
+    free(ix->slots);
+    *ix = bigger;
+    return 0;
+}
+
+void idindex_build(IdIndex* ix, const StudentRecord* recs, int count) {
+    int size = table_size_for(count);
+    if (ix->size != size) {
+        IndexSlot* slots = realloc(ix->slots, (size_t)size * sizeof *slots);
+        if (!slots) { // keep the old table, empty, and let lookups scan
+            idindex_clear(ix);
+            ix->dropped = count;
+            return;
+        }
+        ix->slots = slots;
+        ix->size = size;
+    }
+    idindex_clear(ix);
     for (int i = 0; i < count; i++) {
-        unsigned h = hmix((unsigned)recs[i].id) % HSIZE;
-        for (int step = 0; step < HSIZE; step++, h = (h + 1) % HSIZE) {
-            if (indexTable[h].key == 0 || indexTable[h].key == recs[i].id) {
-                indexTable[h].key = recs[i].id;
-                indexTable[h].pos = i;
-                break;
+        idindex_put(ix, recs[i].id, i);
+    }
+}
+
+static unsigned home_of(const IdIndex* ix, int id) {
+    return hmix((unsigned)id) % ix->size;
+}
+
+static void prefetch_home(const IdIndex* ix, unsigned h) {
+    CMS_PREFETCH(&ix->slots[h]);
+}
+
+static int probe_from(const IdIndex* ix, int id, unsigned h) { // position of id, or -1
+    for (int step = 0; step < ix->size; step++, h = (h + 1) % ix->size) {
+        if (ix->slots[h].key == 0) return -1;
+        if (ix->slots[h].key == id) return ix->slots[h].pos;
+    }
+    return -1;
+}
+
+static int probes_to(const IdIndex* ix, int i) { // slots a lookup of the key in slot i reads
+    unsigned h = home_of(ix, ix->slots[i].key);
+    return (int)(((unsigned)i + (unsigned)ix->size - h) % (unsigned)ix->size) + 1;
+}
+
+static int slot_used(const IdIndex* ix, int i) {
+    return ix->slots[i].key != 0;
+}
+
+static const char* ix_unit(void) {
+    return "slots";
+}
+
+static double expected_probes(double load) { // Knuth: a successful search reads (1 + 1/(1-a))/2 slots
+    return load < 1 ? (1 + 1 / (1 - load)) / 2 : 0;
+}
+
+int idindex_get(const IdIndex* ix, int id, int* out_pos) {
+    if (ix->size == 0) return 0;
+    int pos = probe_from(ix, id, home_of(ix, id));
+    if (pos < 0) return 0;
+    if (out_pos) *out_pos = pos;
+    return 1;
+}
+
+void idindex_put(IdIndex* ix, int id, int pos) {
+    if (id == 0) return; // key 0 marks an empty slot, callers fall back to a scan
+    if (over_load(ix->used + 1, ix->size)) { // grow before the table passes maxLoad
+        if (idindex_resize(ix, table_size_for(ix->used + 1)) != 0) {
+            ix->dropped++; // db_find_pos() scans while any key is missing
+            return;
+        }
+    }
+    int h = slot_for(ix, id);
+    if (h < 0) {
+        ix->dropped++;
+        return;
+    }
+    if (ix->slots[h].key == 0) ix->used++;
+    ix->slots[h].key = id;
+    ix->slots[h].pos = pos;
+}
+
+#else
+
+#define GROUP 16
+#define CTRL_EMPTY ((signed char)-128) // full slots hold the low 7 bits of the hash (0..127)
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+
+static unsigned group_match(const signed char* g, signed char tag) { // bit i set when g[i] == tag
+    __m128i ctrl = _mm_loadu_si128((const __m128i*)g);
+    return (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(ctrl, _mm_set1_epi8(tag)));
+}
+#else
+static unsigned group_match(const signed char* g, signed char tag) { // portable fallback
+    unsigned mask = 0;
+    for (int i = 0; i < GROUP; i++) mask |= (unsigned)(g[i] == tag) << i;
+    return mask;
+}
+#endif
+
+static int lowest_bit(unsigned mask) {
+#if defined(__GNUC__)
+    return __builtin_ctz(mask);
+#else
+    int i = 0;
+    while (!(mask & 1u)) {
+        mask >>= 1;
+        i++;
+    }
+    return i;
+#endif
+}
+
+const char* idindex_kind(void) {
+    return "swiss";
+}
+
+static int table_size_for(int count) { // power of two, a multiple of GROUP, within maxLoad
+    int size = GROUP * 16;
+    while (over_load(count, size)) size *= 2;
+    return size;
+}
+
+static void idindex_clear(IdIndex* ix) {
+    for (int i = 0; i < ix->size; i++) ix->ctrl[i] = CTRL_EMPTY;
+    ix->used = 0;
+    ix->dropped = 0;
+}
+
+// Groups are probed triangularly (1, 2, 3... groups apart), which visits every
+// group once because the group count is a power of two. Nothing is ever deleted
+// from a table, so an empty byte in a group ends the search.
+static int slot_from(const IdIndex* ix, int id, unsigned h, int* found) { // h = hmix(id)
+    signed char tag = (signed char)(h & 0x7F);
+    unsigned groups = (unsigned)ix->size / GROUP;
+    unsigned g = (h >> 7) & (groups - 1);
+
+    for (unsigned step = 1; step <= groups; g = (g + step++) & (groups - 1)) {
+        const signed char* ctrl = ix->ctrl + g * GROUP;
+        for (unsigned m = group_match(ctrl, tag); m; m &= m - 1) {
+            int i = (int)(g * GROUP) + lowest_bit(m);
+            if (ix->slots[i].key == id) {
+                *found = 1;
+                return i;
             }
         }
+        unsigned empty = group_match(ctrl, CTRL_EMPTY);
+        if (empty) {
+            *found = 0;
+            return (int)(g * GROUP) + lowest_bit(empty);
+        }
     }
+    return -1;
 }
 
-int index_get(int id, int* out_pos) {
-    unsigned h = hmix((unsigned)id) % HSIZE;
-    for (int step = 0; step < HSIZE; step++, h = (h + 1) % HSIZE) {
-        if (indexTable[h].key == 0) return 0;
-        if (indexTable[h].key == id) {
-            if (out_pos) *out_pos = indexTable[h].pos;
-            return 1;
+static int slot_for(const IdIndex* ix, int id, int* found) {
+    return slot_from(ix, id, hmix((unsigned)id), found);
+}
+
+static unsigned home_of(const IdIndex* ix, int id) {
+    (void)ix;
+    return hmix((unsigned)id);
+}
+
+static void prefetch_home(const IdIndex* ix, unsigned h) { // control bytes and slots of the first group
+    unsigned g = (h >> 7) & ((unsigned)ix->size / GROUP - 1);
+    CMS_PREFETCH(ix->ctrl + g * GROUP);
+    CMS_PREFETCH(ix->slots + g * GROUP);
+}
+
+static int probe_from(const IdIndex* ix, int id, unsigned h) {
+    int found;
+    int i = slot_from(ix, id, h, &found);
+    return (i >= 0 && found) ? ix->slots[i].pos : -1;
+}
+
+static int probes_to(const IdIndex* ix, int i) { // groups a lookup of the key in slot i reads
+    unsigned groups = (unsigned)ix->size / GROUP;
+    unsigned g = (hmix((unsigned)ix->slots[i].key) >> 7) & (groups - 1);
+    int n = 1;
+    for (unsigned step = 1; g != (unsigned)i / GROUP && step <= groups; g = (g + step++) & (groups - 1)) n++;
+    return n;
+}
+
+static int slot_used(const IdIndex* ix, int i) {
+    return ix->ctrl[i] != CTRL_EMPTY;
+}
+
+static const char* ix_unit(void) {
+    return "groups of 16 slots";
+}
+
+static double expected_probes(double load) { // no simple formula for group probing
+    (void)load;
+    return 0;
+}
+
+static int alloc_table(IdIndex* ix, int size) {
+    IndexSlot* slots = malloc((size_t)size * sizeof *slots);
+    signed char* ctrl = malloc((size_t)size);
+    if (!slots || !ctrl) {
+        free(slots);
+        free(ctrl);
+        return -1;
+    }
+    free(ix->slots);
+    free(ix->ctrl);
+    ix->slots = slots;
+    ix->ctrl = ctrl;
+    ix->size = size;
+    return 0;
+}
+
+static void insert_new(IdIndex* ix, int i, int id, int pos) {
+    ix->ctrl[i] = (signed char)(hmix((unsigned)id) & 0x7F);
+    ix->slots[i].key = id;
+    ix->slots[i].pos = pos;
+    ix->used++;
+}
+
+static int idindex_resize(IdIndex* ix, int size) {
+    IdIndex bigger = { 0 };
+    int found;
+    if (alloc_table(&bigger, size) != 0) return -1;
+    idindex_clear(&bigger);
+    bigger.grows = ix->grows + 1;
+    bigger.dropped = ix->dropped;
+
+    for (int i = 0; i < ix->size; i++) {
+        if (ix->ctrl[i] != CTRL_EMPTY) {
+            insert_new(&bigger, slot_for(&bigger, ix->slots[i].key, &found), ix->slots[i].key, ix->slots[i].pos);
         }
     }
+    free(ix->slots);
+    free(ix->ctrl);
+    *ix = bigger;
     return 0;
 }
 
-void index_put(int id, int pos) {
-    unsigned h = hmix((unsigned)id) % HSIZE;
-    for (int step = 0; step < HSIZE; step++, h = (h + 1) % HSIZE) {
-        if (indexTable[h].key == 0 || indexTable[h].key == id) {
-            indexTable[h].key = id;
-            indexTable[h].pos = pos;
+void idindex_build(IdIndex* ix, const StudentRecord* recs, int count) {
+    int size = table_size_for(count);
+    if (ix->size != size && alloc_table(ix, size) != 0) { // keep the old table, empty, and let lookups scan
+        idindex_clear(ix);
+        ix->dropped = count;
+        return;
+    }
+    idindex_clear(ix);
+    for (int i = 0; i < count; i++) {
+        idindex_put(ix, recs[i].id, i);
+    }
+}
+
+int idindex_get(const IdIndex* ix, int id, int* out_pos) {
+    int found;
+    if (ix->size == 0 || id == 0) return 0;
+    int i = slot_for(ix, id, &found);
+    if (i < 0 || !found) return 0;
+    if (out_pos) *out_pos = ix->slots[i].pos;
+    return 1;
+}
+
+void idindex_put(IdIndex* ix, int id, int pos) {
+    int found;
+    if (id == 0) return; // kept out like in the linear table, callers fall back to a scan
+    if (ix->size == 0 || over_load(ix->used + 1, ix->size)) {
+        if (idindex_resize(ix, table_size_for(ix->used + 1)) != 0) {
+            ix->dropped++;
             return;
         }
     }
+    int i = slot_for(ix, id, &found);
+    if (i < 0) {
+        ix->dropped++;
+        return;
+    }
+    if (found) ix->slots[i].pos = pos;
+    else insert_new(ix, i, id, pos);
+}
+
+#endif
+
+void idindex_free(IdIndex* ix) {
+    free(ix->slots);
+    free(ix->ctrl);
+    ix->slots = NULL;
+    ix->ctrl = NULL;
+    ix->size = 0;
+    ix->used = 0;
 }
 
-void index_rebuild(const StudentRecord* recs, int count) {
+// One pass over the slots: how far each key sits from where its hash sends it
+void idindex_stats(const IdIndex* ix, IndexStats* out) {
+    long long total = 0;
+    memset(out, 0, sizeof *out);
+    out->size = ix->size;
+    out->used = ix->used;
+    out->grows = ix->grows;
+    out->dropped = ix->dropped;
+    for (int i = 0; i < ix->size; i++) {
+        if (!slot_used(ix, i)) continue;
+        int p = probes_to(ix, i);
+        int b = 0;
+        while (b < PROBE_BUCKETS - 1 && (1 << b) < p) b++; // 1, 2, 3-4, 5-8, ...
+        out->probes[b]++;
+        total += p;
+        if (p > out->maxProbe) out->maxProbe = p;
+    }
+    out->meanProbe = ix->used ? (double)total / ix->used : 0;
+    out->expectedProbe = ix->size ? expected_probes((double)ix->used / ix->size) : 0;
+}
+
+// Looks up n IDs, out_pos[i] = position or -1. Each key is hashed and its slot
+// prefetched BATCH_AHEAD keys before it is probed, so the cache misses of
+// several lookups overlap instead of being paid one after another.
+#define BATCH_AHEAD 8
+
+void idindex_get_batch(const IdIndex* ix, const int* ids, int n, int* out_pos) {
+    unsigned home[BATCH_AHEAD];
+    if (ix->size == 0) {
+        for (int i = 0; i < n; i++) out_pos[i] = -1;
+        return;
+    }
+    for (int i = 0; i < n + BATCH_AHEAD; i++) {
+        int j = i - BATCH_AHEAD;
+        if (j >= 0) { // probe first: home[j] is reused by key i
+            out_pos[j] = ids[j] == 0 ? -1 : probe_from(ix, ids[j], home[j % BATCH_AHEAD]);
+        }
+        if (i < n) {
+            home[i % BATCH_AHEAD] = home_of(ix, ids[i]);
+            prefetch_home(ix, home[i % BATCH_AHEAD]);
+        }
+    }
+}
+
+int idindex_copy(IdIndex* dst, const IdIndex* src) { // dst becomes an independent copy, -1 if out of memory
+    IdIndex copy = { 0 };
+    if (src->size > 0) {
+        copy.slots = malloc((size_t)src->size * sizeof *copy.slots);
+        copy.ctrl = src->ctrl ? malloc((size_t)src->size) : NULL;
+        if (!copy.slots || (src->ctrl && !copy.ctrl)) {
+            free(copy.slots);
+            free(copy.ctrl);
+            return -1;
+        }
+        memcpy(copy.slots, src->slots, (size_t)src->size * sizeof *copy.slots);
+        if (src->ctrl) memcpy(copy.ctrl, src->ctrl, (size_t)src->size);
+    }
+    copy.size = src->size;
+    copy.used = src->used;
+    copy.grows = src->grows;
+    copy.dropped = src->dropped;
+    idindex_free(dst);
+    *dst = copy;
+    return 0;
+}
+
+int idindex_write(const IdIndex* ix, const char* path, int rows, unsigned long long checksum) {
+    IndexFileHeader h;
+    char tmp[270];
+    FILE* fp;
+
+    memset(&h, 0, sizeof h);
+    memcpy(h.magic, INDEX_MAGIC, sizeof INDEX_MAGIC);
+    snprintf(h.kind, sizeof h.kind, "%s", idindex_kind());
+    h.slotBytes = sizeof(IndexSlot);
+    h.size = ix->size;
+    h.used = ix->used;
+    h.rows = rows;
+    h.checksum = checksum;
+
+    snprintf(tmp, sizeof tmp, "%s.tmp", path);
+    fp = fopen(tmp, "wb");
+    if (fp == NULL) return -1;
+    fwrite(&h, sizeof h, 1, fp);
+    fwrite(ix->slots, sizeof *ix->slots, (size_t)ix->size, fp);
+    if (ix->ctrl) fwrite(ix->ctrl, 1, (size_t)ix->size, fp);
+
+    int failed = ferror(fp);
+    if (fclose(fp) != 0 || failed) {
+        remove(tmp);
+        return -1;
+    }
+#ifdef _WIN32
+    remove(path);
+#endif
+    if (rename(tmp, path) != 0) {
+        remove(tmp);
+        return -1;
+    }
+    return 0;
+}
+
+static int read_index(FILE* fp, const IndexFileHeader* h, IdIndex* ix) {
+    IdIndex loaded = { 0 };
+    loaded.slots = malloc((size_t)h->size * sizeof *loaded.slots);
+#ifdef CMS_SWISS_INDEX
+    loaded.ctrl = malloc((size_t)h->size);
+    if (!loaded.ctrl) goto fail;
+#endif
+    if (!loaded.slots || fread(loaded.slots, sizeof *loaded.slots, (size_t)h->size, fp) != (size_t)h->size) goto fail;
+    if (loaded.ctrl && fread(loaded.ctrl, 1, (size_t)h->size, fp) != (size_t)h->size) goto fail;
+    loaded.size = h->size;
+    loaded.used = h->used;
+    idindex_free(ix);
+    *ix = loaded;
+    return 0;
+
+fail:
+    idindex_free(&loaded);
+    return -1;
+}
+
+// A loaded table must be one this build could have made for exactly these rows: every row
+// indexed once, each slot found by a lookup of its key and pointing at the row with that ID.
+static int index_matches(const IdIndex* ix, const StudentRecord* recs, int rows) {
+    char* seen = calloc((size_t)(rows ? rows : 1), 1);
+    int used = 0, ok = seen != NULL;
+    for (int i = 0; ok && i < ix->size; i++) {
+        if (!slot_used(ix, i)) continue;
+        int key = ix->slots[i].key, pos = ix->slots[i].pos, found;
+        ok = key != 0 && pos >= 0 && pos < rows && !seen[pos]++ && recs[pos].id == key &&
+            idindex_get(ix, key, &found) && found == pos;
+        used++;
+    }
+    free(seen);
+    return ok && used == ix->used && used == rows;
+}
+
+static int cmp_slot(const void* a, const void* b) {
+    int x = ((const IndexSlot*)a)->key, y = ((const IndexSlot*)b)->key;
+    return (x > y) - (x < y);
+}
+
+static int eytz_fill(StaticIndex* s, const IndexSlot* sorted, int i, int k) { // in-order walk of the implicit tree
+    if (k <= s->count) {
+        i = eytz_fill(s, sorted, i, 2 * k);
+        s->keys[k] = sorted[i].key;
+        s->pos[k] = sorted[i].pos;
+        i = eytz_fill(s, sorted, i + 1, 2 * k + 1);
+    }
+    return i;
+}
+
+void static_index_release(StaticIndex* s) {
+    if (s && atomic_fetch_sub(&s->refs, 1) == 1) {
+        free(s->keys);
+        free(s->pos);
+        free(s);
+    }
+}
+
+static void drop_layout(void) {
+    static_index_release(layout);
+    layout = NULL;
+}
+
+static int static_build(const StudentRecord* recs, int count) {
+    IndexSlot* sorted = malloc((size_t)(count ? count : 1) * sizeof *sorted);
+    int n = 0, inOrder = 1;
+    if (!sorted) return -1;
+    for (int i = 0; i < count; i++) {
+        if (recs[i].id == 0) continue; // left to the callers' scan, as in the hash table
+        sorted[n].key = recs[i].id;
+        sorted[n].pos = i;
+        if (n > 0 && sorted[n - 1].key > recs[i].id) inOrder = 0;
+        n++;
+    }
+    if (!inOrder) qsort(sorted, (size_t)n, sizeof *sorted, cmp_slot); // already sorted after SORT by ID
+
+    StaticIndex* next = malloc(sizeof *next); // a new one: snapshots may still be searching the old
+    if (next) {
+        next->keys = malloc((size_t)(n + 1) * sizeof *next->keys);
+        next->pos = malloc((size_t)(n + 1) * sizeof *next->pos);
+    }
+    if (!next || !next->keys || !next->pos) {
+        if (next) {
+            free(next->keys);
+            free(next->pos);
+        }
+        free(next);
+        free(sorted);
+        return -1;
+    }
+    atomic_init(&next->refs, 1);
+    next->count = n;
+    eytz_fill(next, sorted, 0, 1);
+    free(sorted);
+    drop_layout();
+    layout = next;
+    return 0;
+}
+
+static int static_depth(void) { // levels of the Eytzinger tree
+    int depth = 0;
+    for (int k = layout ? layout->count : 0; k > 0; k >>= 1) depth++;
+    return depth;
+}
+
+int static_index_get(const StaticIndex* s, int id, int* out_pos) {
+    int k = 1;
+    if (!s) return 0;
+    while (k <= s->count) {
+        CMS_PREFETCH(s->keys + 16 * (long)k); // the line holding the node four levels down
+        k = 2 * k + (s->keys[k] < id);
+    }
+    while (k & 1) k >>= 1; // undo the right turns taken after the last left turn
+    k >>= 1;
+    if (k == 0 || s->keys[k] != id) return 0;
+    if (out_pos) *out_pos = s->pos[k];
+    return 1;
+}
+
+StaticIndex* index_static_share(void) { // the current layout with a reference for the caller, NULL in hash mode
+    if (!staticMode || !layout) return NULL;
+    atomic_fetch_add(&layout->refs, 1);
+    return layout;
+}
+
+void index_build(const StudentRecord* recs, int count) {
+    TRACE_START(t0);
+    rebuilds++;
+    if (staticMode && static_build(recs, count) == 0) {
+        idindex_build(&mainIndex, recs, 0);
+    }
+    else {
+        staticMode = 0; // out of memory for the static copy: stay correct with the hash table
+        drop_layout();
+        idindex_build(&mainIndex, recs, count);
+    }
+    TRACE_STOP("index.build", t0);
+}
+
+int index_get(int id, int* out_pos) {
+    if (staticMode) {
+        if (mainIndex.used > 0 && idindex_get(&mainIndex, id, out_pos)) return 1;
+        return static_index_get(layout, id, out_pos);
+    }
+    return idindex_get(&mainIndex, id, out_pos);
+}
+
+void index_get_batch(const int* ids, int n, int* out_pos) {
+    if (staticMode) { // the Eytzinger walk already prefetches ahead
+        for (int i = 0; i < n; i++) {
+            if (!index_get(ids[i], &out_pos[i])) out_pos[i] = -1;
+        }
+        return;
+    }
+    idindex_get_batch(&mainIndex, ids, n, out_pos);
+}
+
+void index_put(int id, int pos) {
+    idindex_put(&mainIndex, id, pos);
+}
+
+void index_rebuild(const StudentRecord* recs, int count) { // after rows moved (DELETE, SORT, COMMIT)
+    TRACE_START(t0);
     index_build(recs, count);
+    TRACE_STOP("index.rebuild", t0);
+}
+
+void index_seal(const StudentRecord* recs, int count) { // end of a bulk load: build the static layout
+    if (staticMode) index_build(recs, count);
+}
+
+void index_set_static(int on, const StudentRecord* recs, int count) {
+    staticMode = on;
+    if (!on) drop_layout();
+    index_build(recs, count);
+}
+
+void index_memory(long long* hashBytes, long long* staticBytes) {
+    *hashBytes = (long long)mainIndex.size * (long long)(sizeof(IndexSlot) + (mainIndex.ctrl ? 1 : 0));
+    *staticBytes = staticMode && layout ? (long long)(layout->count + 1) * 2 * (long long)sizeof(int) : 0;
+}
+
+void index_show(void) {
+    long long hashBytes, staticBytes;
+    index_memory(&hashBytes, &staticBytes);
+    printf("\nIndex mode: %s\n", staticMode ? "STATIC (Eytzinger array + hash table for new rows)" : "HASH");
+    if (staticMode) {
+        printf("  static IDs   : %d (%.1f KB)\n", layout ? layout->count : 0, staticBytes / 1024.0);
+    }
+    printf("  hash table   : %s, %d of %d slots used (%.1f KB)\n", idindex_kind(), mainIndex.used, mainIndex.size,
+        hashBytes / 1024.0);
+    printf("Use INDEX STATIC or INDEX HASH to switch.\n");
+}
+
+void index_stats(IndexStats* out) {
+    idindex_stats(&mainIndex, out);
+    out->rebuilds = rebuilds;
+    out->staticKeys = staticMode && layout ? layout->count : 0;
+}
+
+int index_complete(void) { // 0 while a key is missing, so a miss may not be trusted
+    return mainIndex.dropped == 0;
+}
+
+void index_show_stats(void) {
+    static const char* buckets[PROBE_BUCKETS] = { "1", "2", "3-4", "5-8", "9-16", "17-32", "33-64", "65+" };
+    IndexStats st;
+    index_stats(&st);
+    printf("\nIndex health (%s hash table%s)\n", idindex_kind(), st.staticKeys ? ", new rows only in STATIC mode" : "");
+    printf("  load factor  : %d of %d slots (%.1f%%, grows at %d%%)\n", st.used, st.size,
+        st.size ? 100.0 * st.used / st.size : 0.0, maxLoad);
+    printf("  probe length : mean %.2f %s", st.meanProbe, ix_unit());
+    if (st.expectedProbe > 0) printf(" (%.2f expected at this load)", st.expectedProbe);
+    printf(", max %d\n", st.maxProbe);
+    for (int b = 0; b < PROBE_BUCKETS; b++) {
+        if (st.probes[b] == 0) continue;
+        printf("    %5s      : %lld key(s) (%.1f%%)\n", buckets[b], st.probes[b], st.used ? 100.0 * st.probes[b] / st.used : 0.0);
+    }
+    printf("  tombstones   : %d (DELETE rebuilds the index)\n", st.tombstones);
+    printf("  rebuilds     : %d, plus %d resize(s) while inserting\n", st.rebuilds, st.grows);
+    printf("  dropped keys : %d%s\n", st.dropped, st.dropped ? " (out of memory; lookups fall back to a scan)" : "");
+    if (st.staticKeys) printf("  static IDs   : %d, found in at most %d comparisons\n", st.staticKeys, static_depth());
+}
+
+int index_clone(IdIndex* out) { // in static mode only the rows added since the layout: see index_static_share
+    return idindex_copy(out, &mainIndex);
+}
+
+static int image_fits(int size, int used, long long bytes) { // a table this build could have made, in bytes
+#ifdef CMS_SWISS_INDEX
+    int shape = size % GROUP == 0 && (size & (size - 1)) == 0; // whole groups, power-of-two masking
+    long long slotBytes = (long long)sizeof(IndexSlot) + 1;
+#else
+    int shape = used < size; // an empty slot ends every probe
+    long long slotBytes = (long long)sizeof(IndexSlot);
+#endif
+    return size > 0 && used >= 0 && used <= size && shape && bytes == (long long)size * slotBytes;
+}
+
+// The command loop's hash table, for the memory-mapped store to save with the rows;
+// NULL in static mode, where OPEN lays the IDs out again anyway
+const IdIndex* index_table(void) {
+    return staticMode ? NULL : &mainIndex;
+}
+
+// OPEN of the memory-mapped store: adopt the table saved after the rows (the slots, then the
+// control bytes of a Swiss table). The store is written and renamed in one piece, so the rows
+// cannot be newer than it; the checks only keep lookups inside the table and records[]:
+// this build's layout, and one used slot per row, each pointing at a row. 0, or -1 to rebuild.
+int index_adopt(const char* kind, int size, int used, const void* image, long long bytes, int rows) {
+    IdIndex ix = { 0 };
+    int seen = 0;
+    if (staticMode || strncmp(kind, idindex_kind(), 8) != 0 || used != rows || !image_fits(size, used, bytes)) return -1;
+    ix.slots = malloc((size_t)size * sizeof *ix.slots);
+#ifdef CMS_SWISS_INDEX
+    ix.ctrl = malloc((size_t)size);
+    if (!ix.ctrl) {
+        idindex_free(&ix);
+        return -1;
+    }
+    memcpy(ix.ctrl, (const char*)image + (size_t)size * sizeof *ix.slots, (size_t)size);
+#endif
+    if (!ix.slots) {
+        idindex_free(&ix);
+        return -1;
+    }
+    memcpy(ix.slots, image, (size_t)size * sizeof *ix.slots);
+    ix.size = size;
+    ix.used = used;
+    for (int i = 0; i < size && seen >= 0; i++) {
+        if (!slot_used(&ix, i)) continue;
+        seen = ix.slots[i].key != 0 && ix.slots[i].pos >= 0 && ix.slots[i].pos < rows ? seen + 1 : -1;
+    }
+    if (seen != used) {
+        idindex_free(&ix);
+        return -1;
+    }
+    idindex_free(&mainIndex);
+    mainIndex = ix;
+    return 0;
+}
+
+// Adopt the index saved in path if it was written for exactly this data
+// (same rows, same checksum, same index layout); otherwise leave mainIndex alone.
+int index_load_file(const char* path, int rows, unsigned long long checksum) {
+    IndexFileHeader h;
+    FILE* fp;
+    int rc = -1;
+    if (staticMode) return -1; // the static layout is built from records[] anyway
+    fp = fopen(path, "rb");
+    if (fp == NULL) return -1;
+
+    long payload = -1;
+    if (fread(&h, sizeof h, 1, fp) == 1 && fseek(fp, 0, SEEK_END) == 0) {
+        payload = ftell(fp) - (long)sizeof h; // the slots must be all there is, no more and no less
+        fseek(fp, (long)sizeof h, SEEK_SET);
+    }
+    if (payload >= 0 && memcmp(h.magic, INDEX_MAGIC, sizeof INDEX_MAGIC) == 0 &&
+        strncmp(h.kind, idindex_kind(), sizeof h.kind) == 0 &&
+        h.slotBytes == sizeof(IndexSlot) && h.rows == rows && h.checksum == checksum &&
+        image_fits(h.size, h.used, payload)) {
+        IdIndex loaded = { 0 };
+        if (read_index(fp, &h, &loaded) == 0 && index_matches(&loaded, records, rows)) {
+            idindex_free(&mainIndex);
+            mainIndex = loaded;
+            rc = 0;
+        }
+        else idindex_free(&loaded);
+    }
+    fclose(fp);
+    return rc;
 }
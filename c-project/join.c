@@ -0,0 +1,361 @@
+/*
+ *This file contains attached tables and JOIN.
+ *ATTACH reads another tab-separated text file keyed by student ID, such as course
+ *enrolments or assessment marks: its first column is the ID and the line before the
+ *first row names the columns. An ID may have any number of rows. The table keeps:
+ *  - the IDs in one array and the rest of each row as text
+ *  - an ID index (the build side of every join with it): ID -> its first row, and
+ *    next[] links the following rows with the same ID in file order
+ *JOIN <left> <right> is a hash join on the ID. The left table is streamed in order and
+ *its IDs are probed in windows against the right table's index (idindex_get_batch),
+ *or, when the right table is STUDENTS, against the ID index of the last committed
+ *snapshot (snapshot_find_batch). Each match is handed to the caller as it is found,
+ *so nothing is materialised and memory does not grow with the result.
+ *Rows with ID 0 are skipped at ATTACH, as the index cannot hold that key.
+*/
+
+#define _CRT_SECURE_NO_WARNINGS
+#include "student_db.h"
+#include <ctype.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define JOIN_WINDOW 256 // IDs probed at once
+#define STUDENTS_COLUMNS "Name\tProgramme\tMark"
+
+typedef struct {
+    char name[MAX_TABLE_NAME];
+    char path[260];
+    char* header;      // column names after the ID, tab-separated
+    int columns;
+    int rows;
+    int* ids;
+    size_t* at;        // row i's other columns start at text + at[i]
+    int* next;         // next row with the same ID, -1 after the last
+    char* text;
+    size_t textLen;
+    IdIndex index;     // ID -> first row
+} JoinTable;
+
+static JoinTable* tables[MAX_TABLES];
+
+static void table_free(JoinTable* t) {
+    if (!t) return;
+    free(t->header);
+    free(t->ids);
+    free(t->at);
+    free(t->next);
+    free(t->text);
+    idindex_free(&t->index);
+    free(t);
+}
+
+static JoinTable* find_table(const char* name) {
+    for (int i = 0; i < MAX_TABLES; i++) {
+        if (tables[i] && strcmp(tables[i]->name, name) == 0) return tables[i];
+    }
+    return NULL;
+}
+
+static int is_students(const char* name) {
+    return strcmp(name, "STUDENTS") == 0;
+}
+
+// upper-cased into out[MAX_TABLE_NAME]: the name given, else the file name without directory or extension
+static int table_name(char* out, const char* name, const char* path) {
+    const char* src = name;
+    size_t len;
+    if (!src || !src[0]) {
+        src = strrchr(path, '/');
+        const char* back = strrchr(path, '\\');
+        if (back && (!src || back > src)) src = back;
+        src = src ? src + 1 : path;
+    }
+    for (len = 0; src[len] && src[len] != '.'; len++) {
+        if (len == MAX_TABLE_NAME - 1 || !(isalnum((unsigned char)src[len]) || src[len] == '_')) return -1;
+        out[len] = (char)toupper((unsigned char)src[len]);
+    }
+    out[len] = '\0';
+    return len > 0 && !is_students(out) ? 0 : -1;
+}
+
+static int parse_id(const char* line, int* id, const char** rest) { // 1 if line starts with an ID and a tab
+    char* end;
+    long v = strtol(line, &end, 10);
+    if (end == line || (*end != '\t' && *end != '\0')) return 0;
+    *id = (int)v;
+    *rest = *end == '\t' ? end + 1 : end;
+    return 1;
+}
+
+static void strip_newline(char* line) {
+    size_t len = strlen(line);
+    while (len > 0 && (line[len - 1] == '\n' || line[len - 1] == '\r')) line[--len] = '\0';
+}
+
+static int add_row(JoinTable* t, int* cap, size_t* textCap, int id, const char* rest) {
+    size_t len = strlen(rest);
+    if (t->rows == *cap) {
+        int c = *cap ? *cap * 2 : 1024;
+        int* ids = realloc(t->ids, (size_t)c * sizeof *ids);
+        if (ids) t->ids = ids;
+        size_t* at = realloc(t->at, (size_t)c * sizeof *at);
+        if (at) t->at = at;
+        if (!ids || !at) return -1;
+        *cap = c;
+    }
+    if (t->textLen + len + 1 > *textCap) {
+        size_t c = *textCap ? *textCap : 65536;
+        while (c < t->textLen + len + 1) c *= 2;
+        char* text = realloc(t->text, c);
+        if (!text) return -1;
+        t->text = text;
+        *textCap = c;
+    }
+    memcpy(t->text + t->textLen, rest, len + 1);
+    t->ids[t->rows] = id;
+    t->at[t->rows] = t->textLen;
+    t->textLen += len + 1;
+    t->rows++;
+    return 0;
+}
+
+static int build_index(JoinTable* t) { // backwards, so each ID ends up pointing at its first row
+    TRACE_START(t0);
+    t->next = malloc((size_t)(t->rows ? t->rows : 1) * sizeof *t->next);
+    if (!t->next) return -1;
+    for (int i = t->rows - 1; i >= 0; i--) {
+        int first;
+        t->next[i] = idindex_get(&t->index, t->ids[i], &first) ? first : -1;
+        idindex_put(&t->index, t->ids[i], i);
+    }
+    TRACE_STOP("join.build", t0);
+    return t->index.dropped ? -1 : 0;
+}
+
+// Reads path as table name (or one named after the file): 0 with out describing it, -1 if the file
+// cannot be read, -2 if out of memory, -3 if the name is not usable, already attached, or MAX_TABLES are
+int db_attach(const char* path, const char* name, TableInfo* out) {
+    char line[MAX_LINE_LEN + 1];
+    char tableName[MAX_TABLE_NAME];
+    int slot = -1, cap = 0;
+    size_t textCap = 0;
+
+    if (table_name(tableName, name, path) != 0 || find_table(tableName)) return -3;
+    for (int i = MAX_TABLES - 1; i >= 0; i--) {
+        if (!tables[i]) slot = i;
+    }
+    if (slot < 0) return -3;
+
+    FILE* fp = fopen(path, "r");
+    if (fp == NULL) return -1;
+    JoinTable* t = calloc(1, sizeof *t);
+    if (!t) {
+        fclose(fp);
+        return -2;
+    }
+    snprintf(t->name, sizeof t->name, "%s", tableName);
+    snprintf(t->path, sizeof t->path, "%s", path);
+
+    int rc = 0, lineStart = 1;
+    while (rc == 0 && fgets(line, sizeof line, fp) != NULL) {
+        int wasStart = lineStart, id;
+        const char* rest;
+        lineStart = strchr(line, '\n') != NULL;
+        if (!wasStart || (!lineStart && !feof(fp))) continue; // longer than a row can be, as in OPEN
+        strip_newline(line);
+        if (!parse_id(line, &id, &rest)) {
+            if (t->rows == 0 && line[0]) { // the last line before the first row names the columns
+                free(t->header);
+                const char* cols = strchr(line, '\t');
+                t->header = malloc(strlen(cols ? cols + 1 : "") + 1);
+                if (!t->header) rc = -2;
+                else strcpy(t->header, cols ? cols + 1 : "");
+            }
+            continue;
+        }
+        if (id != 0 && add_row(t, &cap, &textCap, id, rest) != 0) rc = -2;
+    }
+    fclose(fp);
+
+    if (rc == 0 && !t->header) { // no header line: the columns are numbered
+        int n = t->rows ? 1 : 0;
+        for (const char* p = t->rows ? t->text : ""; *p; p++) n += *p == '\t';
+        t->header = calloc((size_t)n * 8 + 1, 1);
+        if (!t->header) rc = -2;
+        for (int c = 0; rc == 0 && c < n; c++) sprintf(t->header + strlen(t->header), "%sCOL%d", c ? "\t" : "", c + 2);
+    }
+    if (rc == 0 && build_index(t) != 0) rc = -2;
+    if (rc != 0) {
+        table_free(t);
+        return rc;
+    }
+    t->columns = t->header[0] ? 1 : 0;
+    for (const char* p = t->header; *p; p++) t->columns += *p == '\t';
+    tables[slot] = t;
+    out->name = t->name;
+    out->path = t->path;
+    out->rows = t->rows;
+    out->columns = t->columns;
+    return 0;
+}
+
+int db_detach(const char* name) { // 0, or -1 if no such table is attached
+    for (int i = 0; i < MAX_TABLES; i++) {
+        if (tables[i] && strcmp(tables[i]->name, name) == 0) {
+            table_free(tables[i]);
+            tables[i] = NULL;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+int db_tables(TableInfo* out, int max) { // the attached tables, in the order they were attached to slots
+    int n = 0;
+    for (int i = 0; i < MAX_TABLES && n < max; i++) {
+        if (!tables[i]) continue;
+        out[n].name = tables[i]->name;
+        out[n].path = tables[i]->path;
+        out[n].rows = tables[i]->rows;
+        out[n].columns = tables[i]->columns;
+        n++;
+    }
+    return n;
+}
+
+const char* db_table_columns(const char* name) { // column names after the ID, NULL for an unknown table
+    if (is_students(name)) return STUDENTS_COLUMNS;
+    JoinTable* t = find_table(name);
+    return t ? t->header : NULL;
+}
+
+static JoinCols cols_of(const JoinTable* t, int row) {
+    JoinCols c;
+    c.student = NULL;
+    c.columns = t->text + t->at[row];
+    return c;
+}
+
+// Streams left JOIN right on the ID to emit, in the left table's order and, for an ID with
+// several right rows, in theirs. Returns the rows emitted, or -1 if a table is not attached.
+long long db_join(const char* left, const char* right, JoinEmit emit, void* ctx) {
+    JoinTable* lt = is_students(left) ? NULL : find_table(left);
+    JoinTable* rt = is_students(right) ? NULL : find_table(right);
+    int ids[JOIN_WINDOW], pos[JOIN_WINDOW];
+    const StudentRecord* found[JOIN_WINDOW];
+    long long emitted = 0;
+
+    if ((!lt && !is_students(left)) || (!rt && !is_students(right))) return -1;
+    if (!lt || !rt) lazy_fetch_all(); // rows --lazy has not read yet have no names
+    TRACE_START(t0);
+    DbSnapshot* snap = snapshot_acquire(); // STUDENTS as of the last commit, as the server's readers see it
+    int rows = lt ? lt->rows : snapshot_count(snap);
+
+    for (int start = 0; start < rows; start += JOIN_WINDOW) {
+        int m = rows - start < JOIN_WINDOW ? rows - start : JOIN_WINDOW;
+        for (int k = 0; k < m; k++) ids[k] = lt ? lt->ids[start + k] : snapshot_row(snap, start + k)->id;
+        if (rt) idindex_get_batch(&rt->index, ids, m, pos);
+        else snapshot_find_batch(snap, ids, m, found);
+
+        for (int k = 0; k < m; k++) {
+            JoinCols l, r;
+            if (lt) l = cols_of(lt, start + k);
+            else {
+                l.student = snapshot_row(snap, start + k);
+                l.columns = NULL;
+            }
+            if (!rt) {
+                if (!found[k]) continue;
+                r.student = found[k];
+                r.columns = NULL;
+                emit(ctx, ids[k], l, r);
+                emitted++;
+                continue;
+            }
+            for (int p = ids[k] != 0 ? pos[k] : -1; p >= 0; p = rt->next[p]) {
+                emit(ctx, ids[k], l, cols_of(rt, p));
+                emitted++;
+            }
+        }
+    }
+    snapshot_release(snap);
+    TRACE_STOP("join.probe", t0);
+    return emitted;
+}
+
+void attachTable(void) {
+    char path[260], name[MAX_TABLE_NAME + 8];
+    TableInfo info;
+
+    printf("Enter file to attach: ");
+    if (fgets(path, sizeof path, stdin) == NULL) return;
+    strip_newline(path);
+    printf("Enter table name (blank for the file name): ");
+    if (fgets(name, sizeof name, stdin) == NULL) return;
+    strip_newline(name);
+
+    int rc = db_attach(path, name, &info);
+    if (rc == -1) printf("Error: Cannot read '%s'.\n", path);
+    else if (rc == -2) printf("Error: Out of memory. '%s' was not attached.\n", path);
+    else if (rc == -3) {
+        printf("Error: Table names are up to %d letters, digits or '_', not STUDENTS nor one already attached", MAX_TABLE_NAME - 1);
+        printf(" (at most %d tables).\n", MAX_TABLES);
+    }
+    else printf("Attached %d rows of '%s' as %s (columns: ID\t%s).\n", info.rows, path, info.name, db_table_columns(info.name));
+}
+
+void detachTable(const char* args) {
+    char name[MAX_TABLE_NAME];
+    if (sscanf(args, "%31s", name) != 1) {
+        printf("Usage: DETACH <table>\n");
+        return;
+    }
+    if (db_detach(name) != 0) printf("No table %s is attached.\n", name);
+    else printf("%s detached.\n", name);
+}
+
+void showTables(void) {
+    TableInfo info[MAX_TABLES];
+    int n = db_tables(info, MAX_TABLES);
+    DbSnapshot* snap = snapshot_acquire();
+    printf("\nTable\t\tRows\t\tColumns\tFile\n");
+    printf("----------------------------------------\n");
+    printf("%-15s\t%-15d\t%d\t%s\n", "STUDENTS", snapshot_count(snap), 4, FILENAME);
+    snapshot_release(snap);
+    for (int i = 0; i < n; i++) {
+        printf("%-15s\t%-15d\t%d\t%s\n", info[i].name, info[i].rows, info[i].columns + 1, info[i].path);
+    }
+}
+
+static void print_cols(JoinCols c) {
+    if (c.student) printf("\t%-15s\t%-25s\t%.1f", c.student->name, c.student->programme, c.student->mark);
+    else if (c.columns[0]) printf("\t%s", c.columns);
+}
+
+static void print_row(void* ctx, int id, JoinCols left, JoinCols right) {
+    (void)ctx;
+    printf("%d", id);
+    print_cols(left);
+    print_cols(right);
+    putchar('\n');
+}
+
+void joinTables(const char* args) { // JOIN <table> is STUDENTS JOIN <table>
+    char left[MAX_TABLE_NAME], right[MAX_TABLE_NAME];
+    int n = sscanf(args, "%31s %31s", left, right);
+    if (n == 1) {
+        strcpy(right, left);
+        strcpy(left, "STUDENTS");
+    }
+    if (n < 1 || !db_table_columns(left) || !db_table_columns(right)) {
+        printf("Usage: JOIN [<left>] <right>, tables STUDENTS or ones attached with ATTACH (see TABLES).\n");
+        return;
+    }
+    const char* lc = db_table_columns(left);
+    const char* rc = db_table_columns(right);
+    printf("\nID%s%s%s%s\n", lc[0] ? "\t" : "", lc, rc[0] ? "\t" : "", rc);
+    printf("----------------------------------------\n");
+    long long rows = db_join(left, right, print_row, NULL);
+    printf("%lld rows (%s JOIN %s on ID)\n", rows, left, right);
+}
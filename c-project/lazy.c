@@ -0,0 +1,241 @@
+/*
+ *This file contains lazy loading (student_db --lazy).
+ *OPEN makes one pass over the text file that only reads each row's ID and mark
+ *and remembers where its line starts, then builds the ID index from that. Names
+ *and programmes stay in the file until a row is first used:
+ *  - QUERY, UPDATE and DELETE parse just the rows they touch (one seek each)
+ *  - SORT by ID or MARK needs no names, SUMMARY only the two names it prints
+ *  - SHOWALL, SAVE, BEGIN and SORT by NAME or PROGRAMME parse everything left
+ *    in one sequential pass
+ *Rows that are not parsed yet hold empty strings, so every path that shows or
+ *writes names goes through lazy_fetch* first. The file stays open until the last
+ *row is parsed and must not be changed by another program before that; a row whose
+ *line no longer carries its ID keeps empty strings and a warning is printed.
+*/
+
+#define _CRT_SECURE_NO_WARNINGS
+#include "student_db.h"
+#include <stdlib.h>
+#include <string.h>
+
+static int enabled = 0;
+static FILE* src = NULL;            // the file OPEN scanned, while rows are pending
+static long* lineAt = NULL;         // line k starts here (kept rows only, in file order)
+static unsigned char* parsed = NULL;
+static IdIndex pendingIx;           // ID -> k
+static int lines = 0;
+static int lineCap = 0;
+static int left = 0;                // rows still to parse
+static int stale = 0;               // the file changed under us
+
+void lazy_configure(int on) {
+    enabled = on;
+}
+
+int lazy_enabled(void) {
+    return enabled;
+}
+
+int lazy_pending(void) {
+    return left;
+}
+
+void lazy_close(void) { // forget the pending rows (OPEN again, or exit)
+    if (src) fclose(src);
+    src = NULL;
+    free(lineAt);
+    free(parsed);
+    lineAt = NULL;
+    parsed = NULL;
+    idindex_free(&pendingIx);
+    lines = lineCap = left = 0;
+}
+
+// Splits "id<TAB>name<TAB>programme<TAB>mark" in place; 1 for a record line, the
+// same lines db_parse_row accepts apart from odd whitespace around the tabs.
+static int split_row(char* line, int* id, char** name, char** programme, float* mark) {
+    char* end;
+    long v = strtol(line, &end, 10);
+    if (end == line || *end != '\t') return 0;
+
+    char* n = end + 1;
+    char* t = strchr(n, '\t');
+    if (!t || t == n || t - n > MAX_TEXT_LEN) return 0;
+    char* p = t + 1;
+    char* u = strchr(p, '\t');
+    if (!u || u == p || u - p > MAX_TEXT_LEN) return 0;
+    float m = strtof(u + 1, &end);
+    if (end == u + 1) return 0;
+
+    *t = '\0';
+    *u = '\0';
+    *id = (int)v;
+    *name = n;
+    *programme = p;
+    *mark = m;
+    return 1;
+}
+
+static int remember(int id, long at) { // 0, or -1 when out of memory
+    if (lines == lineCap) {
+        int cap = lineCap ? lineCap * 2 : INITIAL_RECORDS;
+        long* grownAt = realloc(lineAt, (size_t)cap * sizeof *grownAt);
+        if (!grownAt) return -1;
+        lineAt = grownAt;
+        lineCap = cap;
+    }
+    lineAt[lines] = at;
+    idindex_put(&pendingIx, id, lines);
+    lines = lines + 1;
+    return 0;
+}
+
+// returns records indexed or -1; a compressed file is decoded in full by db_open
+int lazy_open(const char* path) {
+    char line[MAX_LINE_LEN];
+    StudentRecord blank, rec;
+    long at = 0;
+    int lineStart = 1;
+    int failed = 0;
+    STATS_START(t0);
+
+    lazy_close();
+    FILE* fp = fopen(path, "rb");
+    if (fp == NULL) {
+        audit_log("OPEN", NULL, NULL, "FAIL");
+        return -1;
+    }
+    if (cmsz_is_compressed(fp)) {
+        fclose(fp);
+        return db_open(path);
+    }
+
+    recordCount = 0;
+    index_build(records, 0);
+    arena_reset();
+    rec_set_name(&blank, "", NULL); // shared by every row until it is parsed
+    rec_set_programme(&blank, "", NULL);
+    stale = 0;
+
+    TRACE_START(t1);
+    while (!failed && fgets(line, sizeof line, fp) != NULL) {
+        long here = at;
+        int wasStart = lineStart;
+        size_t len = strlen(line);
+        char *name, *programme;
+        int id;
+        float mark;
+        at += (long)len;
+        lineStart = len > 0 && line[len - 1] == '\n';
+        if (!wasStart || !split_row(line, &id, &name, &programme, &mark)) {
+            continue; // header, malformed line or the tail of an overlong one
+        }
+        rec = blank;
+        rec.id = id;
+        rec.mark = mark;
+        if (id == 0) { // the pending index cannot hold ID 0, so parse it now
+            rec_set_name(&rec, name, NULL);
+            rec_set_programme(&rec, programme, NULL);
+        }
+
+        int rc = db_load_row(&rec);
+        if (rc < 0 || (rc == 0 && rec.id != 0 && remember(rec.id, here) != 0)) failed = 1;
+    }
+    TRACE_STOP("open.scan", t1);
+
+    left = lines;
+    parsed = calloc((size_t)(lines ? lines : 1), 1);
+    if (failed || !parsed) { // never serve part of the table
+        fclose(fp);
+        lazy_close();
+        refresh_forget();
+        recordCount = 0;
+        index_build(records, 0);
+        index_seal(records, 0);
+        snapshot_publish();
+        audit_log("OPEN", NULL, NULL, "FAIL(NO_MEMORY)");
+        return -1;
+    }
+    refresh_mark(fp, path); // rows appended later are read in full by REFRESH
+    if (left > 0) src = fp;
+    else fclose(fp);
+
+    index_seal(records, recordCount);
+    snapshot_publish();
+    STATS_STOP(STAT_IO_OPEN, t0);
+    audit_log("OPEN", NULL, NULL, "SUCCESS(LAZY)");
+    return recordCount;
+}
+
+static void fill_row(int k, char* line) { // line is row k's text, read from the file again
+    int id, pos;
+    int check;
+    char *name, *programme;
+    float mark;
+
+    parsed[k] = 1;
+    left = left - 1;
+    if (!split_row(line, &id, &name, &programme, &mark) || !idindex_get(&pendingIx, id, &check) || check != k) {
+        if (!stale) printf("Warning: the database file changed since OPEN; some rows keep empty names.\n");
+        stale = 1;
+        return;
+    }
+    pos = db_find_pos(id);
+    if (pos < 0) return;
+    rec_set_name(&records[pos], name, NULL);
+    rec_set_programme(&records[pos], programme, NULL);
+}
+
+static int fetch_one(int id) { // 1 if the row was parsed now
+    char line[MAX_LINE_LEN];
+    int k;
+    if (left == 0 || id == 0 || !idindex_get(&pendingIx, id, &k) || parsed[k]) return 0;
+
+    if (fseek(src, lineAt[k], SEEK_SET) != 0 || fgets(line, sizeof line, src) == NULL) line[0] = '\0';
+    fill_row(k, line);
+    return 1;
+}
+
+static void finish(int changed) {
+    if (left == 0) lazy_close();
+    if (changed && !txn_active()) snapshot_publish(); // BEGIN fetches everything, see below
+}
+
+void lazy_fetch(const int* ids, int n) { // before readers look these IDs up in a snapshot
+    int changed = 0;
+    for (int i = 0; i < n && left > 0; i++) changed |= fetch_one(ids[i]);
+    finish(changed);
+}
+
+void lazy_fetch_row(int pos) { // writer side: UPDATE and DELETE publish the row themselves
+    if (left > 0 && fetch_one(records[pos].id) && left == 0) lazy_close();
+}
+
+// Everything left, in one sequential pass. BEGIN calls it too: a transaction's
+// queries read the last committed snapshot, which cannot take parsed rows later.
+void lazy_fetch_all(void) {
+    char line[MAX_LINE_LEN];
+    long at = 0;
+    int k = 0;
+    int lineStart = 1;
+    if (left == 0) return;
+
+    TRACE_START(t0);
+    rewind(src);
+    while (k < lines && fgets(line, sizeof line, src) != NULL) {
+        long here = at;
+        int wasStart = lineStart;
+        size_t len = strlen(line);
+        at += (long)len;
+        lineStart = len > 0 && line[len - 1] == '\n';
+        if (!wasStart || here != lineAt[k]) continue;
+        if (!parsed[k]) fill_row(k, line);
+        k = k + 1;
+    }
+    for (; k < lines; k++) { // the file got shorter
+        line[0] = '\0';
+        if (!parsed[k]) fill_row(k, line);
+    }
+    finish(1);
+    TRACE_STOP("lazy.fetch_all", t0);
+}
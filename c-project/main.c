@@ -3,20 +3,31 @@
  *It includes the database management system's loop and the declaration statement.
  *
  *IMPORTANT PLEASE READ BELOW
- *TO RUN THE CODE, COPY THIS INTO CONSOLE AND ENTER: student_db main.c 1open.c 2showall.c 3insert.c 4query.c 5update.c 6delete.c 7save.c 8sort.c 9summary.c audit.c index.c
+ *TO RUN THE CODE, COPY THIS INTO CONSOLE AND ENTER: student_db main.c 1open.c 2showall.c 3insert.c 4query.c 5update.c 6delete.c 7save.c 8sort.c 9summary.c audit.c index.c snapshot.c server.c db.c stats.c mmapstore.c compress.c txn.c repl.c shard.c arena.c lazy.c refresh.c extsort.c sketch.c trace.c shmexport.c join.c
  *ENSURE THAT YOUR TERMINAL IS IN THE CORRECT DIRECTORY WHERE THE FILES ARE LOCATED
  *THEN, RUN THE PROGRAM WITH: ./student_db
+ *OPERATION TIMINGS ARE SHOWN BY THE STATS COMMAND (BUILD WITH -DCMS_NO_STATS TO TURN THEM OFF); TO WRITE THEM TO A FILE ON EXIT, RUN: ./student_db --stats-json [stats.json]
+ *TO RECORD A TIMELINE OF EVERY COMMAND AND ITS PHASES FOR chrome://tracing OR PERFETTO, RUN: ./student_db --trace [trace.json]  (see trace.c)
+ *TO USE THE SIMD (SWISS TABLE) ID INDEX, ADD -DCMS_SWISS_INDEX WHEN COMPILING (see index.c)
+ *TO STORE NAMES AND PROGRAMMES IN A STRING ARENA INSTEAD OF FIXED 40-BYTE ARRAYS, ADD -DCMS_STRING_ARENA (see arena.c, MEMORY compares the two)
+ *TO INDEX THE TEXT FILE AT OPEN AND READ EACH ROW ONLY WHEN IT IS FIRST USED, RUN: ./student_db --lazy  (see lazy.c)
+ *REFRESH READS ROWS OTHER PROGRAMS APPENDED TO THE TEXT FILE; TO DO IT WHENEVER THE FILE CHANGES, RUN: ./student_db --watch  (Linux only, see refresh.c)
+ *TO WRITE THE TEXT FILE SORTED WITHOUT LOADING IT (FOR FILES LARGER THAN MEMORY), RUN:
+ *  ./student_db --sort-file <output> [--sort-by "PROGRAMME, MARK DESC"] [--sort-memory MB]  (see extsort.c)
+ *TO SPLIT THE TEXT FILE INTO N SHARD FILES LOADED AND SAVED IN PARALLEL, RUN: ./student_db --shards N  (see shard.c)
+ *TO KEEP RECORDS IN A MEMORY-MAPPED FILE INSTEAD OF LOADING THE TEXT FILE, RUN: ./student_db --mmap [store file]  (see mmapstore.c)
+ *TO SERVE LOCAL CLIENTS INSTEAD OF THE MENU, RUN: ./student_db --server [socket path]  (Linux only, see server.c)
+ *TO LET OTHER LOCAL PROGRAMS READ THE TABLE FROM SHARED MEMORY, RUN: ./student_db --export-shm [/name]  (see shmexport.c; they use shmreader.c)
+ *TO FEED READ-ONLY REPLICAS, ADD --replicate [socket path]; A REPLICA RUNS WITH --follow [socket path]  (Linux only, see repl.c)
 */
 
 
 #define _CRT_SECURE_NO_WARNINGS
 #include "student_db.h"
 #include <ctype.h>
+#include <stdlib.h>
 #include <string.h>
 
-StudentRecord records[MAX_RECORDS];
-int recordCount = 0;
-
 void showDeclaration(void) { // printing of declaration statement at start of program
     printf("========================================\n");
     printf("              Declaration               \n");
@@ -52,30 +63,189 @@ void showMenu(void) { // management system menu display
     printf("\n=== Student Database Management System ===\n");
     printf("Available Commands:\n");
     printf("  OPEN     - Open Database\n");
+    printf("  REFRESH  - Read Records Appended to the File since OPEN\n");
     printf("  SHOWALL  - Show All Records\n");
     printf("  INSERT   - Insert Record\n");
-    printf("  QUERY    - Query Record\n");
+    printf("  QUERY    - Query Record (QUERY <id> <id> ... looks up several at once)\n");
     printf("  UPDATE   - Update Record\n");
     printf("  DELETE   - Delete Record\n");
-    printf("  SAVE     - Save Database\n");
+    printf("  SAVE     - Save Database (SAVE STATUS shows a save in progress, SAVE COMPRESSED writes the compact Sample-CMS.cmsz, SAVE INDEX also stores the ID index)\n");
     printf("  SORT     - Sort Records\n");
-    printf("  SUMMARY  - Show Summary Statistics\n");
+    printf("  SUMMARY  - Show Summary Statistics (SUMMARY APPROX adds percentiles, distinct counts and top programmes from sketches)\n");
+    printf("  ATTACH   - Attach Another Table Keyed by Student ID (TABLES lists them, DETACH <table> drops one)\n");
+    printf("  JOIN     - Join Two Tables on Student ID (JOIN <table> joins STUDENTS with it, JOIN <left> <right>)\n");
+    printf("  INDEX    - Show the ID Index (INDEX STATIC for read-mostly use, INDEX HASH to go back, INDEX STATS for probe lengths)\n");
+    printf("  MEMORY   - Show the Memory Footprint of the Table\n");
+    printf("  BEGIN    - Start a Transaction (COMMIT applies it, ROLLBACK undoes it)\n");
+    printf("  STATS    - Show Operation Timings (and replication lag on a replica)\n");
     printf("  QUIT     - Exit Program\n");
     printf("Enter command: ");
 }
 
-int main(void) {
+int main(int argc, char* argv[]) {
+    char line[4096];
     char command[50];
+    char args[4000];
+    int showPrompt = 1; // the menu is drawn again after each command, not after a blank line
+    const char* serverSocket = NULL;
+    const char* replicateSocket = NULL;
+    const char* followSocket = NULL;
+    int watch = 0;
+    const char* sortFile = NULL;
+    const char* sortBy = "ID";
+    int sortMemory = 64; // MB
+    const char* tracePath = NULL;
+    const char* statsPath = NULL;
+
+    for (int i = 1; i < argc; i++) { // an option's value is optional
+        const char* value = (i + 1 < argc && argv[i + 1][0] != '-') ? argv[i + 1] : NULL;
+        if (strcmp(argv[i], "--server") == 0) {
+            serverSocket = value ? value : "student_db.sock";
+        }
+        else if (strcmp(argv[i], "--mmap") == 0) {
+            mstore_configure(value ? value : "Sample-CMS.db");
+        }
+        else if (strcmp(argv[i], "--shards") == 0) {
+            shard_configure(value ? atoi(value) : 4);
+        }
+        else if (strcmp(argv[i], "--lazy") == 0) {
+            lazy_configure(1);
+        }
+        else if (strcmp(argv[i], "--watch") == 0) {
+            watch = 1;
+        }
+        else if (strcmp(argv[i], "--sort-file") == 0) {
+            sortFile = value ? value : "Sample-CMS.sorted.txt";
+        }
+        else if (strcmp(argv[i], "--sort-by") == 0) {
+            sortBy = value ? value : "ID";
+        }
+        else if (strcmp(argv[i], "--sort-memory") == 0) {
+            sortMemory = value ? atoi(value) : 64;
+        }
+        else if (strcmp(argv[i], "--trace") == 0) {
+            tracePath = value ? value : "trace.json";
+        }
+        else if (strcmp(argv[i], "--stats-json") == 0) {
+            statsPath = value ? value : "stats.json";
+        }
+        else if (strcmp(argv[i], "--export-shm") == 0) {
+            shm_export_configure(value ? value : "/student_db");
+        }
+        else if (strcmp(argv[i], "--replicate") == 0) {
+            replicateSocket = value ? value : "student_db.repl";
+        }
+        else if (strcmp(argv[i], "--follow") == 0) {
+            followSocket = value ? value : "student_db.repl";
+        }
+        else {
+            printf("Unknown option %s\n", argv[i]);
+            return 1;
+        }
+        if (value) i++;
+    }
+    if (tracePath && trace_open(tracePath) != 0) {
+        printf("--trace needs the timings, which this build compiled out (CMS_NO_STATS)\n");
+        return 1;
+    }
+    if (sortFile != NULL) { // a batch job on the file: nothing is loaded, served or audited
+        SortKey keys[MAX_SORT_KEYS];
+        int count = db_parse_sort(sortBy, keys);
+        if (count <= 0) {
+            printf("Unknown sort order '%s'. Use up to %d of ID, NAME, PROGRAMME, MARK, each with ASC or DESC.\n",
+                sortBy, MAX_SORT_KEYS);
+            return 1;
+        }
+        SortFileResult res;
+        TRACE_START(t0);
+        int rc = db_sort_file(FILENAME, sortFile, keys, count, (size_t)(sortMemory > 0 ? sortMemory : 1) << 20, &res);
+        TRACE_STOP("SORT FILE", t0);
+        trace_close();
+        if (rc == -1) {
+            printf("Cannot read '%s' (a compressed file must be OPENed and SAVEd as text first).\n", FILENAME);
+            return 1;
+        }
+        if (rc != 0) {
+            printf("Sorting '%s' failed: out of memory, or '%s' and its run files could not be written.\n", FILENAME, sortFile);
+            return 1;
+        }
+        printf("Sorted %lld rows of '%s' into '%s' (%d run file(s), %d merge pass(es), %d MB budget)\n",
+            res.rows, FILENAME, sortFile, res.runs, res.passes, sortMemory > 0 ? sortMemory : 1);
+        return 0;
+    }
+#ifdef CMS_STRING_ARENA
+    if (mstore_enabled()) {
+        printf("--mmap keeps fixed-size rows; it cannot be used in a -DCMS_STRING_ARENA build\n");
+        return 1;
+    }
+#endif
+    if (shard_count() > 0 && mstore_enabled()) {
+        printf("--shards splits the text file; it cannot be combined with --mmap\n");
+        return 1;
+    }
+    if (lazy_enabled() && (mstore_enabled() || shard_count() > 0 || replicateSocket || followSocket || shm_export_enabled())) {
+        printf("--lazy reads rows from the single text file on demand; it cannot be combined with --mmap, --shards, --replicate, --follow or --export-shm\n");
+        return 1;
+    }
+    if (followSocket && (replicateSocket || mstore_enabled())) {
+        printf("--follow keeps its own in-memory copy; it cannot be combined with --replicate or --mmap\n");
+        return 1;
+    }
+    if (watch && (mstore_enabled() || shard_count() > 0 || followSocket)) {
+        printf("--watch follows the single text file; it cannot be combined with --mmap, --shards or --follow\n");
+        return 1;
+    }
+    if (watch && refresh_watch(FILENAME) != 0) {
+        printf("Could not watch %s for changes\n", FILENAME);
+        return 1;
+    }
+    if (replicateSocket && repl_listen(replicateSocket) != 0) {
+        printf("Could not listen for replicas on %s\n", replicateSocket);
+        return 1;
+    }
+    if (followSocket && repl_follow(followSocket) != 0) { // the primary itself may come up later
+        printf("Could not follow %s\n", followSocket);
+        return 1;
+    }
+    if (shm_export_enabled() && shm_export_open() != 0) {
+        printf("Could not create the shared-memory segment (POSIX systems only)\n");
+        return 1;
+    }
+
+    if (serverSocket != NULL) { // non-interactive server mode
+        if (!followSocket) audit_open(); // a replica's changes are audited by its primary
+        if (!followSocket && storage_open() < 0) {
+            printf("Warning: could not open the database, starting with an empty one.\n");
+        }
+        int rc = server_run(serverSocket);
+        txn_rollback(); // an unfinished transaction is never applied
+        repl_close();
+        refresh_close();
+        db_save_wait();
+        lazy_close();
+        mstore_close();
+        shm_export_close();
+        audit_close();
+        if (statsPath) stats_dump_json(statsPath);
+        trace_close();
+        return rc == 0 ? 0 : 1;
+    }
 
     showDeclaration();
 
-    audit_open();
+    if (!followSocket) audit_open();
 
     while (1) { // menu loop
-        showMenu();
-        if (scanf("%49s", command) != 1) {
-            int ch;
-            while ((ch = getchar()) != '\n' && ch != EOF) {}
+        db_save_poll();
+        repl_poll();
+        refresh_poll();
+        if (showPrompt) showMenu();
+        if (fgets(line, sizeof line, stdin) == NULL) { // end of input
+            break;
+        }
+        args[0] = '\0';
+        showPrompt = sscanf(line, "%49s %3999[^\n]", command, args) >= 1; // a blank line just waits for the next
+        if (!showPrompt) {
             continue;
         }
         
@@ -83,20 +253,38 @@ int main(void) {
         for (int i = 0; command[i]; i++) {
             command[i] = toupper(command[i]);
         }
-        
-        // clears input buffer
-        int ch;
-        while ((ch = getchar()) != '\n' && ch != EOF) {}
+        for (int i = 0; args[i]; i++) {
+            args[i] = toupper(args[i]);
+        }
 
-        if (strcmp(command, "OPEN") == 0) {
+        STATS_START(t0);
+        TRACE_START(tc);
+        if (repl_is_follower() && (strcmp(command, "OPEN") == 0 || strcmp(command, "REFRESH") == 0 || strcmp(command, "INSERT") == 0 ||
+            strcmp(command, "UPDATE") == 0 || strcmp(command, "DELETE") == 0 || strcmp(command, "BEGIN") == 0 ||
+            (strcmp(command, "SAVE") == 0 && strcmp(args, "STATUS") != 0))) {
+            printf("%s is not allowed on a read-only replica. Run it on the primary.\n", command);
+        }
+        else if (txn_active() && (strcmp(command, "OPEN") == 0 || strcmp(command, "REFRESH") == 0 || strcmp(command, "SORT") == 0)) {
+            printf("%s is not allowed inside a transaction. COMMIT or ROLLBACK first.\n", command);
+        }
+        else if (strcmp(command, "OPEN") == 0) {
             openDatabase();
+            STATS_STOP(STAT_OPEN, t0);
+        }
+        else if (strcmp(command, "REFRESH") == 0) {
+            refreshDatabase();
         }
         else if (strcmp(command, "SHOWALL") == 0) {
             showAll();
+            STATS_STOP(STAT_SHOWALL, t0);
         }
-        else if (strcmp(command, "INSERT") == 0) {
+        else if (strcmp(command, "INSERT") == 0) { // prompting commands time their core call themselves
             insertRecord();
         }
+        else if (strcmp(command, "QUERY") == 0 && args[0] != '\0') {
+            queryMany(args);
+            STATS_STOP(STAT_QUERY, t0);
+        }
         else if (strcmp(command, "QUERY") == 0) {
             queryRecord();
         }
@@ -106,25 +294,101 @@ int main(void) {
         else if (strcmp(command, "DELETE") == 0) {
             deleteRecord();
         }
+        else if (strcmp(command, "SAVE") == 0 && strcmp(args, "STATUS") == 0) {
+            showSaveStatus();
+        }
+        else if (strcmp(command, "SAVE") == 0 && strcmp(args, "INDEX") == 0) {
+            saveWithIndex();
+            STATS_STOP(STAT_SAVE, t0);
+        }
+        else if (strcmp(command, "SAVE") == 0 && strcmp(args, "COMPRESSED") == 0) {
+            saveCompressed();
+            STATS_STOP(STAT_SAVE, t0);
+        }
         else if (strcmp(command, "SAVE") == 0) {
             saveDatabase();
+            STATS_STOP(STAT_SAVE, t0);
         }
         else if (strcmp(command, "SORT") == 0) {
             sortRecords();
         }
+        else if (strcmp(command, "SUMMARY") == 0 && strcmp(args, "APPROX") == 0) {
+            showSummaryApprox();
+            STATS_STOP(STAT_SUMMARY, t0);
+        }
         else if (strcmp(command, "SUMMARY") == 0) {
             showSummary();
+            STATS_STOP(STAT_SUMMARY, t0);
+        }
+        else if (strcmp(command, "ATTACH") == 0) {
+            attachTable();
+        }
+        else if (strcmp(command, "DETACH") == 0) {
+            detachTable(args);
+        }
+        else if (strcmp(command, "TABLES") == 0) {
+            showTables();
+        }
+        else if (strcmp(command, "JOIN") == 0) {
+            joinTables(args);
+            STATS_STOP(STAT_JOIN, t0);
+        }
+        else if (strcmp(command, "INDEX") == 0 && strcmp(args, "STATIC") == 0) {
+            index_set_static(1, records, recordCount);
+            if (!txn_active()) snapshot_publish(); // readers switch layouts too
+            index_show();
+        }
+        else if (strcmp(command, "INDEX") == 0 && strcmp(args, "HASH") == 0) {
+            index_set_static(0, records, recordCount);
+            if (!txn_active()) snapshot_publish(); // readers switch layouts too
+            index_show();
+        }
+        else if (strcmp(command, "INDEX") == 0 && strcmp(args, "STATS") == 0) {
+            index_show_stats();
+        }
+        else if (strcmp(command, "INDEX") == 0) {
+            index_show();
+        }
+        else if (strcmp(command, "MEMORY") == 0) {
+            showMemory();
+        }
+        else if (strcmp(command, "BEGIN") == 0) {
+            beginTransaction();
+        }
+        else if (strcmp(command, "COMMIT") == 0) {
+            commitTransaction();
+        }
+        else if (strcmp(command, "ROLLBACK") == 0) {
+            rollbackTransaction();
+        }
+        else if (strcmp(command, "STATS") == 0) {
+            stats_show();
+            repl_show();
         }
         else if (strcmp(command, "QUIT") == 0) {
+            if (txn_rollback() > 0) {
+                printf("The open transaction was rolled back.\n");
+            }
             printf("Exiting program. Goodbye!\n");
+            db_save_wait(); // the last audit line comes after a running save has finished
             audit_log("EXIT", NULL, NULL, "SUCCESS");
             break;
         }
         else {
             printf("Invalid command! Please enter a valid command from the menu.\n");
         }
+        TRACE_STOP(command, tc); // menu commands include their prompts; STATS times the operations
     }
 
+    txn_rollback(); // end of input inside a transaction
+    repl_close();
+    refresh_close();
+    db_save_wait();
+    lazy_close();
+    mstore_close();
+    shm_export_close();
     audit_close();
+    if (statsPath) stats_dump_json(statsPath);
+    trace_close();
     return 0;
 }
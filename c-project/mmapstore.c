@@ -0,0 +1,311 @@
+/*
+ *This file contains the memory-mapped storage engine (student_db --mmap [file]).
+ *The data file is a fixed-layout header followed by the StudentRecord array itself,
+ *and records[] points straight into the mapping: OPEN maps the file instead of
+ *parsing it, and INSERT/UPDATE/DELETE/SORT write into the mapped pages.
+ *The mapping is private (copy-on-write), so changes stay in memory until SAVE.
+ *SAVE writes a new file (header, then rows), fsyncs it and renames it over the old
+ *one, then maps it in place of the old; a crash at any point leaves either the old
+ *file or the new one, never a mix. OPEN drops unsaved changes as it does with the
+ *text file.
+ *The ID index is saved in the same file after the rows, so OPEN adopts it
+ *(index_adopt) instead of building it again.
+ *Growing past the file's capacity moves records[] to anonymous memory: the file on
+ *disk is never written except by SAVE's rename.
+ *The first OPEN of a missing file imports the text database (FILENAME).
+*/
+
+#define _CRT_SECURE_NO_WARNINGS
+#include "student_db.h"
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MSTORE_MAGIC "CMSMMAP1"
+
+typedef struct {
+    char magic[8];
+    unsigned int recordSize;  // sizeof(StudentRecord) of the writer, guards against layout changes
+    unsigned int reserved;
+    long long count;          // rows valid as of the last SAVE
+    long long capacity;       // rows the file has room for
+    unsigned long long generation;
+    long long indexAt;        // the ID index saved after the rows, 0 if there is none
+    int indexSize;            // its slots
+    int indexUsed;
+    char indexKind[8];        // idindex_kind() of the writer
+} MStoreHeader;               // 64 bytes, keeps the records that follow aligned
+
+static const char* storePath = NULL;
+
+void mstore_configure(const char* path) {
+    storePath = path;
+}
+
+int mstore_enabled(void) {
+    return storePath != NULL;
+}
+
+#if (defined(__unix__) || defined(__APPLE__)) && !defined(CMS_STRING_ARENA) // arena rows point outside the file
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static int storeFd = -1;
+static MStoreHeader* header = NULL;
+static size_t mappedBytes = 0;
+
+static size_t bytes_for(long long capacity) {
+    return sizeof(MStoreHeader) + (size_t)capacity * sizeof(StudentRecord);
+}
+
+static int map_file(int fd, size_t bytes) { // fd -1: anonymous memory
+    void* base = mmap(NULL, bytes, PROT_READ | PROT_WRITE, fd >= 0 ? MAP_PRIVATE : MAP_PRIVATE | MAP_ANONYMOUS, fd, 0);
+    if (base == MAP_FAILED) return -1;
+    if (header) munmap(header, mappedBytes); // SAVE: the old file's mapping, now that the new one is in place
+    header = base;
+    mappedBytes = bytes;
+    records = (StudentRecord*)(header + 1);
+    recordCapacity = (int)header->capacity;
+    return 0;
+}
+
+static void unmap_file(void) {
+    if (header) munmap(header, mappedBytes);
+    header = NULL;
+    mappedBytes = 0;
+    records = NULL;
+    recordCapacity = 0;
+}
+
+int mstore_active(void) {
+    return header != NULL;
+}
+
+// Grows the mapping, records[] moves into anonymous memory with room for count rows.
+// The file keeps the last SAVE; the next SAVE writes a file of the new capacity.
+int mstore_reserve(int count) {
+    if (count <= recordCapacity) return 0;
+
+    long long capacity = recordCapacity ? recordCapacity : INITIAL_RECORDS;
+    while (capacity < count) capacity *= 2;
+
+    MStoreHeader* old = header;
+    size_t oldBytes = mappedBytes;
+    header = NULL; // keep the old mapping until the rows are copied out of it
+    if (map_file(-1, bytes_for(capacity)) != 0) { // the old mapping is still in place
+        header = old;
+        mappedBytes = oldBytes;
+        records = (StudentRecord*)(header + 1);
+        recordCapacity = (int)header->capacity;
+        return -1;
+    }
+    memcpy(header, old, sizeof *old + (size_t)recordCount * sizeof(StudentRecord));
+    munmap(old, oldBytes);
+    header->capacity = capacity;
+    recordCapacity = (int)capacity;
+    return 0;
+}
+
+static int write_at(int fd, const void* data, size_t n, off_t at) {
+    const char* p = data;
+    while (n > 0) {
+        ssize_t done = pwrite(fd, p, n, at);
+        if (done <= 0) return -1;
+        p += done;
+        n -= (size_t)done;
+        at += done;
+    }
+    return 0;
+}
+
+static void sync_dir(const char* path) { // makes a rename in path's directory survive a crash
+    char dir[260];
+    snprintf(dir, sizeof dir, "%s", path);
+    char* slash = strrchr(dir, '/');
+    if (slash) slash[slash == dir ? 1 : 0] = '\0';
+    else snprintf(dir, sizeof dir, ".");
+    int fd = open(dir, O_RDONLY);
+    if (fd >= 0) {
+        fsync(fd);
+        close(fd);
+    }
+}
+
+static int create_from_text(void) { // one-time import of the text database
+    int loaded = db_open(FILENAME);
+    if (loaded < 0) loaded = 0;
+
+    long long capacity = INITIAL_RECORDS;
+    while (capacity < loaded) capacity *= 2;
+
+    char tmp[280];
+    snprintf(tmp, sizeof tmp, "%s.tmp", storePath); // renamed once complete, so no half-imported store is left
+    storeFd = open(tmp, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (storeFd < 0) return -1;
+    if (ftruncate(storeFd, (off_t)bytes_for(capacity)) != 0) return -1;
+
+    StudentRecord* heap = records;
+    void* base = mmap(NULL, bytes_for(capacity), PROT_READ | PROT_WRITE, MAP_SHARED, storeFd, 0);
+    if (base == MAP_FAILED) return -1;
+
+    MStoreHeader* h = base;
+    memset(h, 0, sizeof *h);
+    memcpy(h->magic, MSTORE_MAGIC, sizeof h->magic);
+    h->recordSize = sizeof(StudentRecord);
+    h->count = loaded;
+    h->capacity = capacity;
+    if (loaded > 0) memcpy(h + 1, heap, (size_t)loaded * sizeof *heap);
+    int synced = msync(base, bytes_for(capacity), MS_SYNC) == 0;
+    munmap(base, bytes_for(capacity));
+    if (!synced || rename(tmp, storePath) != 0) {
+        unlink(tmp);
+        return -1;
+    }
+    sync_dir(storePath);
+
+    free(heap); // from now on records[] lives in the mapping
+    records = NULL;
+    recordCapacity = 0;
+    return 0;
+}
+
+int mstore_open(void) { // map the store, returns rows available or -1
+    struct stat st;
+    STATS_START(t0);
+
+    if (header) { // re-OPEN: drop unsaved changes and map the file again
+        unmap_file();
+        close(storeFd);
+        storeFd = -1;
+    }
+
+    if (stat(storePath, &st) != 0) {
+        if (create_from_text() != 0) goto fail;
+        stat(storePath, &st);
+    }
+    else {
+        free(records); // heap rows from an earlier text OPEN
+        records = NULL;
+        recordCapacity = 0;
+        storeFd = open(storePath, O_RDWR);
+        if (storeFd < 0) goto fail;
+    }
+    if ((size_t)st.st_size < sizeof(MStoreHeader) || map_file(storeFd, (size_t)st.st_size) != 0) goto fail;
+
+    if (memcmp(header->magic, MSTORE_MAGIC, sizeof header->magic) != 0 ||
+        header->recordSize != sizeof(StudentRecord) ||
+        header->capacity < 0 || header->capacity > INT_MAX || bytes_for(header->capacity) > (size_t)st.st_size ||
+        header->count < 0 || header->count > header->capacity) {
+        printf("'%s' is not a student_db store (or was written by an incompatible build).\n", storePath);
+        unmap_file();
+        goto fail;
+    }
+
+    recordCount = (int)header->count;
+    long long at = header->indexAt;
+    if (at < (long long)bytes_for(header->capacity) || at > (long long)st.st_size ||
+        index_adopt(header->indexKind, header->indexSize, header->indexUsed, (char*)header + at, (long long)st.st_size - at, recordCount) != 0) {
+        index_build(records, recordCount);
+    }
+    snapshot_publish();
+    STATS_STOP(STAT_IO_OPEN, t0);
+    audit_log("OPEN", NULL, NULL, "SUCCESS(MMAP)");
+    return recordCount;
+
+fail:
+    if (storeFd >= 0) close(storeFd);
+    storeFd = -1;
+    audit_log("OPEN", NULL, NULL, "FAIL(MMAP)");
+    return -1;
+}
+
+// SAVE: a new file with the header, the rows and the index, made durable and renamed over the old one
+int mstore_sync(void) {
+    char tmp[280];
+    STATS_START(t0);
+    if (!header) {
+        audit_log("SAVE", NULL, NULL, "FAIL(MMAP)");
+        return -1;
+    }
+    MStoreHeader h = *header;
+    h.count = recordCount;
+    h.generation++;
+    const IdIndex* ix = index_table();
+    size_t slotBytes = ix ? (size_t)ix->size * sizeof *ix->slots : 0;
+    size_t ctrlBytes = ix && ix->ctrl ? (size_t)ix->size : 0;
+    h.indexAt = ix ? (long long)bytes_for(h.capacity) : 0;
+    h.indexSize = ix ? ix->size : 0;
+    h.indexUsed = ix ? ix->used : 0;
+    snprintf(h.indexKind, sizeof h.indexKind, "%s", idindex_kind());
+    size_t bytes = bytes_for(h.capacity) + slotBytes + ctrlBytes;
+
+    snprintf(tmp, sizeof tmp, "%s.tmp", storePath);
+    int fd = open(tmp, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0 || ftruncate(fd, (off_t)bytes) != 0 ||
+        write_at(fd, &h, sizeof h, 0) != 0 ||
+        write_at(fd, records, (size_t)recordCount * sizeof(StudentRecord), (off_t)sizeof h) != 0 ||
+        (slotBytes && write_at(fd, ix->slots, slotBytes, (off_t)h.indexAt) != 0) ||
+        (ctrlBytes && write_at(fd, ix->ctrl, ctrlBytes, (off_t)(h.indexAt + (long long)slotBytes)) != 0) ||
+        fsync(fd) != 0 || rename(tmp, storePath) != 0) { // the old file stays whole until the rename
+        if (fd >= 0) close(fd);
+        unlink(tmp);
+        audit_log("SAVE", NULL, NULL, "FAIL(MMAP)");
+        return -1;
+    }
+    sync_dir(storePath);
+
+    // map the new file: it holds exactly records[], and the old one is no longer on disk
+    int oldFd = storeFd;
+    storeFd = fd;
+    if (map_file(fd, bytes) == 0) close(oldFd);
+    else { // stay on the old mapping; the next SAVE writes every row again anyway
+        storeFd = oldFd;
+        close(fd);
+        *header = h;
+    }
+    STATS_STOP(STAT_IO_SAVE, t0);
+    audit_log("SAVE", NULL, NULL, "SUCCESS(MMAP)");
+    return 0;
+}
+
+void mstore_close(void) {
+    if (!header) return;
+    unmap_file();
+    close(storeFd);
+    storeFd = -1;
+    recordCount = 0;
+}
+
+#else
+
+int mstore_active(void) {
+    return 0;
+}
+
+int mstore_reserve(int count) {
+    (void)count;
+    return -1;
+}
+
+int mstore_open(void) {
+#ifdef CMS_STRING_ARENA
+    printf("The memory-mapped store keeps fixed-size rows; it is not available in -DCMS_STRING_ARENA builds.\n");
+#else
+    printf("The memory-mapped store needs POSIX mmap.\n");
+#endif
+    audit_log("OPEN", NULL, NULL, "FAIL(MMAP)");
+    return -1;
+}
+
+int mstore_sync(void) {
+    audit_log("SAVE", NULL, NULL, "FAIL(MMAP)");
+    return -1;
+}
+
+void mstore_close(void) {
+}
+
+#endif
@@ -0,0 +1,249 @@
+/*
+ *This file contains REFRESH, which follows rows other programs append to the text file.
+ *OPEN remembers how far it read the file, which file it was (device and inode)
+ *and the last bytes before that point. REFRESH then:
+ *  - reads only the complete lines after that point and adds their rows through
+ *    the index, as OPEN would (a duplicate ID keeps the row already loaded)
+ *  - does a full OPEN instead when the file was replaced, truncated or rewritten,
+ *    which also drops changes not saved yet, as OPEN always does
+ *A line still being written (no newline yet) is left for the next REFRESH. Our
+ *own SAVE replaces the file, so it records the new file the same way.
+ *With --watch, inotify reports changes to the file and the refresh runs by itself:
+ *before each menu prompt, or as soon as the server wakes up (Linux only).
+*/
+
+#define _CRT_SECURE_NO_WARNINGS
+#include "student_db.h"
+#include <string.h>
+#include <sys/stat.h>
+
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+#define TAIL_BYTES 64 // compared before reading on, so a rewrite of the same size is noticed
+
+static int tracked = 0;
+static char trackedPath[260];
+static unsigned long long fileDev, fileIno;
+static long offset = 0;                     // bytes of the file already read
+static unsigned char tail[TAIL_BYTES];      // the bytes just before offset
+static int tailLen = 0;
+static int compressed = 0;                  // nothing is ever appended to those
+
+void refresh_forget(void) {
+    tracked = 0;
+}
+
+// OPEN has read fp (opened from path) up to where fp is now
+void refresh_mark(FILE* fp, const char* path) {
+    struct stat st;
+    long at = ftell(fp);
+    tracked = 0;
+    if (at < 0 || fstat(fileno(fp), &st) != 0) return;
+
+    tailLen = at < TAIL_BYTES ? (int)at : TAIL_BYTES;
+    if (fseek(fp, at - tailLen, SEEK_SET) != 0 || fread(tail, 1, (size_t)tailLen, fp) != (size_t)tailLen) return;
+    rewind(fp);
+    compressed = cmsz_is_compressed(fp);
+    snprintf(trackedPath, sizeof trackedPath, "%s", path);
+    fileDev = (unsigned long long)st.st_dev;
+    fileIno = (unsigned long long)st.st_ino;
+    offset = at;
+    tracked = 1;
+}
+
+void refresh_saved(const char* path) { // our SAVE renamed a new file over the database
+    if (strcmp(path, FILENAME) != 0) return; // an export elsewhere (or the benchmark's file)
+    FILE* fp = fopen(path, "rb");
+    if (fp == NULL || fseek(fp, 0, SEEK_END) != 0) tracked = 0;
+    else refresh_mark(fp, path);
+    if (fp) fclose(fp);
+}
+
+static int unchanged(FILE* fp) { // 1 if fp is still the file OPEN read, at least up to offset
+    struct stat st;
+    unsigned char now[TAIL_BYTES];
+    if (fstat(fileno(fp), &st) != 0 || (unsigned long long)st.st_dev != fileDev ||
+        (unsigned long long)st.st_ino != fileIno || (long long)st.st_size < offset) {
+        return 0;
+    }
+    if (fseek(fp, offset - tailLen, SEEK_SET) != 0 || fread(now, 1, (size_t)tailLen, fp) != (size_t)tailLen) {
+        return 0;
+    }
+    return memcmp(now, tail, (size_t)tailLen) == 0;
+}
+
+static RefreshResult reload(int* rows) {
+    int loaded = storage_open();
+    if (loaded < 0) return REFRESH_FAILED; // the table is kept when the file cannot be read
+    *rows = loaded;
+    return REFRESH_RELOADED;
+}
+
+// Reads the complete lines after offset; fp is positioned there. Returns rows added or -1.
+static int read_appended(FILE* fp) {
+    char line[MAX_LINE_LEN];
+    StudentRecord rec;
+    long at = offset;
+    int lineStart = 1;
+    int first = recordCount;
+    int failed = 0;
+    TRACE_START(t0);
+
+    while (fgets(line, sizeof line, fp) != NULL) {
+        size_t len = strlen(line);
+        int whole = len > 0 && line[len - 1] == '\n';
+        if (!whole && feof(fp)) break; // still being written
+        at += (long)len;
+        if (lineStart && db_parse_row(line, &rec, NULL)) {
+            int rc = db_load_row(&rec);
+            if (rc < 0) {
+                failed = 1;
+                break;
+            }
+            if (rc == 1) arena_forget(&rec, NULL); // duplicate ID: its strings are not used
+        }
+        lineStart = whole;
+        if (whole) offset = at;
+    }
+    TRACE_STOP("refresh.read", t0);
+
+    if (recordCount > first) {
+        snapshot_publish();
+        audit_begin_group(); // one flush, and replicas get the rows together
+        for (int i = first; i < recordCount; i++) audit_log("INSERT", NULL, &records[i], "SUCCESS");
+        audit_end_group(1);
+    }
+    tailLen = offset < TAIL_BYTES ? (int)offset : TAIL_BYTES;
+    if (fseek(fp, offset - tailLen, SEEK_SET) != 0 || fread(tail, 1, (size_t)tailLen, fp) != (size_t)tailLen) {
+        tracked = 0; // cannot tell next time, so the next REFRESH reads everything
+    }
+    return failed ? -1 : recordCount - first;
+}
+
+// rows gets the rows appended, or the rows loaded by a full reload
+RefreshResult db_refresh(int* rows) {
+    SaveStatus save;
+    *rows = 0;
+    if (mstore_enabled() || shard_count() > 0) return REFRESH_UNSUPPORTED;
+    db_save_poll();
+    db_save_status(&save);
+    if (save.state == SAVE_RUNNING || txn_active()) return REFRESH_BUSY; // a SAVE is replacing the file
+
+    FILE* fp = tracked ? fopen(trackedPath, "rb") : NULL;
+    if (fp == NULL || !unchanged(fp)) {
+        if (fp) fclose(fp);
+        RefreshResult result = reload(rows);
+        audit_log("REFRESH", NULL, NULL, result == REFRESH_RELOADED ? "SUCCESS(RELOADED)" : "FAIL");
+        return result;
+    }
+    int added = compressed ? 0 : read_appended(fp); // fp is at offset after unchanged()
+    fclose(fp);
+    if (added < 0) {
+        audit_log("REFRESH", NULL, NULL, "FAIL(NO_MEMORY)");
+        return REFRESH_FAILED;
+    }
+    *rows = added;
+    audit_log("REFRESH", NULL, NULL, "SUCCESS");
+    return REFRESH_APPENDED;
+}
+
+void refreshDatabase(void) {
+    int rows;
+    switch (db_refresh(&rows)) {
+    case REFRESH_APPENDED:
+        printf("%d new record(s) read from '%s' (%d in total)\n", rows, FILENAME, recordCount);
+        break;
+    case REFRESH_RELOADED:
+        printf("'%s' was replaced or rewritten; reloaded all %d records\n", FILENAME, rows);
+        break;
+    case REFRESH_BUSY:
+        printf("A save is still writing '%s' (or a transaction is open). Try again afterwards.\n", FILENAME);
+        break;
+    case REFRESH_UNSUPPORTED:
+        printf("REFRESH follows the single text file; it is not available with --mmap or --shards.\n");
+        break;
+    default:
+        printf("Error reading '%s'; the records in memory are unchanged.\n", FILENAME);
+        break;
+    }
+}
+
+#ifdef __linux__
+
+static int watchFd = -1;
+static int due = 0; // --watch saw a change not refreshed yet
+static char watchName[260];
+
+int refresh_watch(const char* path) { // --watch: inotify on the file's directory, so a rename over it is seen too
+    char dir[260];
+    const char* slash = strrchr(path, '/');
+    if (slash) snprintf(dir, sizeof dir, "%.*s", (int)(slash - path), path);
+    else snprintf(dir, sizeof dir, ".");
+    if (dir[0] == '\0') snprintf(dir, sizeof dir, "/");
+    snprintf(watchName, sizeof watchName, "%s", slash ? slash + 1 : path);
+
+    watchFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (watchFd < 0) return -1;
+    if (inotify_add_watch(watchFd, dir, IN_MODIFY | IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE) < 0) {
+        close(watchFd);
+        watchFd = -1;
+        return -1;
+    }
+    return 0;
+}
+
+int refresh_fd(void) {
+    return watchFd;
+}
+
+static void drain_events(void) { // sets due when one of the events is about our file
+    char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    ssize_t n;
+    while ((n = read(watchFd, buf, sizeof buf)) > 0) {
+        for (char* p = buf; p < buf + n;) {
+            struct inotify_event* ev = (struct inotify_event*)p;
+            if (ev->len > 0 && strcmp(ev->name, watchName) == 0) due = 1;
+            p += sizeof *ev + ev->len;
+        }
+    }
+}
+
+void refresh_poll(void) { // command thread: refresh if --watch saw the file change
+    int rows;
+    if (watchFd < 0) return;
+    drain_events();
+    if (!due) return;
+    RefreshResult result = db_refresh(&rows);
+    if (result == REFRESH_BUSY) return; // tried again at the next poll
+    due = 0;
+    if (result == REFRESH_APPENDED && rows > 0) printf("[watch] %d new record(s) read from '%s'\n", rows, FILENAME);
+    else if (result == REFRESH_RELOADED) printf("[watch] '%s' was rewritten; reloaded %d records\n", FILENAME, rows);
+    else if (result == REFRESH_FAILED) printf("[watch] could not read '%s'\n", FILENAME);
+}
+
+void refresh_close(void) {
+    if (watchFd >= 0) close(watchFd);
+    watchFd = -1;
+}
+
+#else
+
+int refresh_watch(const char* path) {
+    (void)path;
+    return -1; // no inotify: REFRESH by hand
+}
+
+int refresh_fd(void) {
+    return -1;
+}
+
+void refresh_poll(void) {
+}
+
+void refresh_close(void) {
+}
+
+#endif
@@ -0,0 +1,659 @@
+/*
+ *This file contains log-shipping replication between processes on one machine.
+ *  student_db --replicate [socket]   primary: followers connect to the socket
+ *  student_db --follow [socket]      follower: a read-only copy kept up to date
+ *
+ *The primary ships the images audit_log() already receives. Outside a transaction
+ *every change is logged after its snapshot is published; inside one, the changes
+ *are held back and shipped together at COMMIT (a ROLLBACK ships nothing). A
+ *shipper thread owns the follower sockets: it sends each new follower a copy
+ *taken from a snapshot (RESET, ROW..., SYNCED), queues the changes logged
+ *meanwhile, then streams them. A change logged while the copy was being taken
+ *can appear in both, so followers apply INSERT/UPDATE as upserts and ignore
+ *DELETE of a missing ID. A follower that falls more than MAX_QUEUE behind is
+ *dropped and gets a fresh copy when it reconnects; OPEN on the primary resends
+ *the copy to everyone.
+ *
+ *Stream: one line per message, fields separated by tabs
+ *  RESET <seq> <sent_ns>          SYNCED <seq> <sent_ns>       HEARTBEAT <seq> <sent_ns>
+ *  ROW <id> <name> <programme> <mark>
+ *  INSERT|UPDATE <seq> <sent_ns> <id> <name> <programme> <mark>
+ *  DELETE <seq> <sent_ns> <id>
+ *sent_ns is CLOCK_MONOTONIC, which both processes share, so the follower records
+ *now - sent_ns as the replication lag (repl.lag in STATS).
+ *Followers apply what has arrived between commands (menu) or as it arrives
+ *(server mode), one transaction per batch so a batch publishes once.
+*/
+
+#define _CRT_SECURE_NO_WARNINGS
+#define _GNU_SOURCE // accept4, pipe2
+#include "student_db.h"
+
+#ifdef __linux__
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#define MAX_FOLLOWERS 32
+#define SYNC_ROWS 1024                 // rows added to a follower's queue at a time during the copy
+#define MAX_QUEUE (256u << 20)         // a follower further behind than this is dropped
+#define HEARTBEAT_NS 1000000000ull
+#define RETRY_US 200000                // follower: reconnect interval
+
+typedef struct {
+    char* data;
+    size_t len;
+    size_t cap;
+} ReplBuf;
+
+typedef struct Follower {
+    int fd;
+    ReplBuf out;          // being sent
+    size_t sent;
+    ReplBuf later;        // changes logged while the copy is still being sent
+    int resync;           // start (again) from a fresh snapshot
+    DbSnapshot* sync;     // copy in progress
+    int syncPos;
+    int dead;
+    struct Follower* next;
+} Follower;
+
+typedef struct {
+    char op;              // 'I', 'U' or 'D'
+    StudentRecord rec;
+} HeldChange;
+
+// primary
+static const char* listenPath = NULL;
+static int listenFd = -1;
+static int wakeFds[2] = { -1, -1 };    // primary: wakes the shipper; follower: wakes the command loop
+static pthread_t shipper;
+static pthread_t receiver;
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static Follower* followers = NULL;   // created and freed by the shipper thread only
+static int followerCount = 0;
+static int stopping = 0;               // guarded by lock, like everything the threads share
+static unsigned long long seq = 0;
+static unsigned long long lastShipNs = 0;
+static int grouping = 0;
+static HeldChange* held = NULL;      // changes of the open transaction
+static int heldCount = 0;
+static int heldCap = 0;
+
+// follower
+static const char* upstreamPath = NULL;
+static int upFd = -1;                 // set by the receiver thread
+static ReplBuf in;                     // received, not yet applied
+static StudentRecord* staging = NULL; // the copy being received, swapped in at SYNCED
+static int stagingCount = 0;
+static int stagingCap = 0;
+static int receiving = 0;
+static int synced = 0;
+static unsigned long long appliedSeq = 0;
+static unsigned long long lastMsgNs = 0;
+static unsigned long long lastLagNs = 0;
+
+static int buf_append(ReplBuf* b, const char* s, size_t n) {
+    if (b->len + n > b->cap) {
+        size_t cap = b->cap ? b->cap * 2 : 4096;
+        while (cap < b->len + n) cap *= 2;
+        char* grown = realloc(b->data, cap);
+        if (!grown) return -1;
+        b->data = grown;
+        b->cap = cap;
+    }
+    memcpy(b->data + b->len, s, n);
+    b->len += n;
+    return 0;
+}
+
+static int fmt_record(char* line, size_t n, const char* head, const StudentRecord* r) {
+    return snprintf(line, n, "%s\t%d\t%s\t%s\t%.9g\n", head, r->id, r->name, r->programme, r->mark);
+}
+
+static void wake_shipper(void) {
+    char b = 1;
+    if (write(wakeFds[1], &b, 1) < 0) {
+        // the pipe is full, so the shipper is already due to wake up
+    }
+}
+
+// ---- primary: command thread side ----
+
+static void queue_line(const char* line, size_t n) { // caller holds lock
+    for (Follower* f = followers; f; f = f->next) {
+        if (f->dead) continue;
+        ReplBuf* b = (f->sync || f->resync) ? &f->later : &f->out;
+        if (f->out.len + f->later.len + n > MAX_QUEUE || buf_append(b, line, n) != 0) f->dead = 1;
+    }
+    lastShipNs = clock_ns();
+}
+
+static void ship(char op, const StudentRecord* r) {
+    char head[64], line[MAX_LINE_LEN + 64];
+    pthread_mutex_lock(&lock);
+    seq++;
+    if (op == 'D') {
+        snprintf(line, sizeof line, "DELETE\t%llu\t%llu\t%d\n", seq, clock_ns(), r->id);
+    }
+    else {
+        snprintf(head, sizeof head, "%s\t%llu\t%llu", op == 'I' ? "INSERT" : "UPDATE", seq, clock_ns());
+        fmt_record(line, sizeof line, head, r);
+    }
+    if (followers) queue_line(line, strlen(line));
+    pthread_mutex_unlock(&lock);
+}
+
+void repl_record(const char* op, const StudentRecord* before, const StudentRecord* after, const char* status) {
+    if (listenFd < 0) return;
+    if (strcmp(op, "OPEN") == 0 && strncmp(status, "SUCCESS", 7) == 0) { // a different table: copy it again
+        pthread_mutex_lock(&lock);
+        for (Follower* f = followers; f; f = f->next) {
+            f->resync = 1;
+            f->later.len = 0;
+        }
+        pthread_mutex_unlock(&lock);
+        wake_shipper();
+        return;
+    }
+    if (strcmp(status, "SUCCESS") != 0) return;
+
+    char kind;
+    const StudentRecord* r;
+    if (strcmp(op, "INSERT") == 0 && after) kind = 'I', r = after;
+    else if (strcmp(op, "UPDATE") == 0 && after) kind = 'U', r = after;
+    else if (strcmp(op, "DELETE") == 0 && before) kind = 'D', r = before;
+    else return;
+
+    if (grouping) { // shipped at COMMIT
+        if (heldCount == heldCap) {
+            int cap = heldCap ? heldCap * 2 : 64;
+            HeldChange* grown = realloc(held, (size_t)cap * sizeof *grown);
+            if (!grown) return;
+            held = grown;
+            heldCap = cap;
+        }
+        held[heldCount].op = kind;
+        held[heldCount].rec = *r;
+        heldCount++;
+        return;
+    }
+    ship(kind, r);
+    wake_shipper();
+}
+
+void repl_begin_group(void) {
+    grouping = 1;
+    heldCount = 0;
+}
+
+void repl_end_group(int committed) {
+    grouping = 0;
+    if (listenFd < 0 || !committed) return;
+    for (int i = 0; i < heldCount; i++) ship(held[i].op, &held[i].rec);
+    if (heldCount > 0) wake_shipper();
+    heldCount = 0;
+}
+
+// ---- primary: shipper thread ----
+
+static void control_line(Follower* f, const char* kind) {
+    char line[96];
+    int n = snprintf(line, sizeof line, "%s\t%llu\t%llu\n", kind, seq, clock_ns());
+    if (buf_append(&f->out, line, (size_t)n) != 0) f->dead = 1;
+}
+
+static void fill_copy(Follower* f) { // next part of the copy into the empty out buffer
+    char line[MAX_LINE_LEN + 64];
+    if (f->resync) {
+        if (f->sync) snapshot_release(f->sync);
+        f->sync = snapshot_acquire(); // later changes are already going to f->later
+        f->syncPos = 0;
+        f->resync = 0;
+        control_line(f, "RESET");
+    }
+    int count = snapshot_count(f->sync);
+    int end = f->syncPos + SYNC_ROWS < count ? f->syncPos + SYNC_ROWS : count;
+    for (; f->syncPos < end; f->syncPos++) {
+        int n = fmt_record(line, sizeof line, "ROW", snapshot_row(f->sync, f->syncPos));
+        if (buf_append(&f->out, line, (size_t)n) != 0) f->dead = 1;
+    }
+    if (f->syncPos == count) { // copy done: the queued changes follow it
+        snapshot_release(f->sync);
+        f->sync = NULL;
+        control_line(f, "SYNCED");
+        if (buf_append(&f->out, f->later.data, f->later.len) != 0) f->dead = 1;
+        f->later.len = 0;
+    }
+}
+
+static void feed(Follower* f) { // send without blocking until the socket is full
+    while (!f->dead) {
+        if (f->sent < f->out.len) {
+            ssize_t n = send(f->fd, f->out.data + f->sent, f->out.len - f->sent, MSG_DONTWAIT | MSG_NOSIGNAL);
+            if (n < 0) {
+                if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) f->dead = 1;
+                return;
+            }
+            f->sent += (size_t)n;
+            continue;
+        }
+        f->out.len = 0;
+        f->sent = 0;
+        if (!f->resync && !f->sync) return;
+        fill_copy(f);
+    }
+}
+
+static int wants_out(const Follower* f) {
+    return f->sent < f->out.len || f->resync || f->sync;
+}
+
+static void drop(Follower* f) { // caller holds lock
+    Follower** p = &followers;
+    while (*p != f) p = &(*p)->next;
+    *p = f->next;
+    close(f->fd);
+    if (f->sync) snapshot_release(f->sync);
+    free(f->out.data);
+    free(f->later.data);
+    free(f);
+    followerCount--;
+}
+
+static void accept_followers(void) { // caller holds lock
+    while (1) {
+        int fd = accept4(listenFd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) return;
+        Follower* f = followerCount < MAX_FOLLOWERS ? calloc(1, sizeof *f) : NULL;
+        if (!f) {
+            close(fd);
+            continue;
+        }
+        f->fd = fd;
+        f->resync = 1;
+        f->next = followers;
+        followers = f;
+        followerCount++;
+    }
+}
+
+static void* shipper_main(void* arg) {
+    struct pollfd pfd[MAX_FOLLOWERS + 2];
+    Follower* polled[MAX_FOLLOWERS];
+    char drain[64];
+    (void)arg;
+
+    while (1) {
+        int n = 0;
+        pthread_mutex_lock(&lock);
+        if (stopping) {
+            pthread_mutex_unlock(&lock);
+            break;
+        }
+        pfd[0].fd = wakeFds[0];
+        pfd[0].events = POLLIN;
+        pfd[1].fd = listenFd;
+        pfd[1].events = POLLIN;
+        for (Follower* f = followers; f; f = f->next) {
+            polled[n] = f;
+            pfd[n + 2].fd = f->fd;
+            pfd[n + 2].events = (short)(POLLIN | (wants_out(f) ? POLLOUT : 0)); // POLLIN only to see hangups
+            n++;
+        }
+        pthread_mutex_unlock(&lock);
+
+        poll(pfd, (nfds_t)(n + 2), 200);
+
+        pthread_mutex_lock(&lock);
+        while (read(wakeFds[0], drain, sizeof drain) > 0) {}
+        if (pfd[1].revents & POLLIN) accept_followers();
+        for (int i = 0; i < n; i++) { // followers never send anything, so readable means gone
+            if (pfd[i + 2].revents & (POLLIN | POLLHUP | POLLERR)) polled[i]->dead = 1;
+        }
+        if (followers && clock_ns() - lastShipNs >= HEARTBEAT_NS) {
+            char line[96];
+            int len = snprintf(line, sizeof line, "HEARTBEAT\t%llu\t%llu\n", seq, clock_ns());
+            queue_line(line, (size_t)len);
+        }
+        Follower* f = followers;
+        while (f) {
+            Follower* next = f->next;
+            feed(f);
+            if (f->dead) drop(f);
+            f = next;
+        }
+        pthread_mutex_unlock(&lock);
+    }
+    return NULL;
+}
+
+int repl_listen(const char* socketPath) { // primary; 0, or -1 if the socket cannot be opened
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof addr);
+    addr.sun_family = AF_UNIX;
+    if (strlen(socketPath) >= sizeof addr.sun_path) return -1;
+    strcpy(addr.sun_path, socketPath);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) return -1;
+    unlink(socketPath);
+    if (bind(fd, (struct sockaddr*)&addr, sizeof addr) != 0 || listen(fd, MAX_FOLLOWERS) != 0 ||
+        pipe2(wakeFds, O_NONBLOCK | O_CLOEXEC) != 0) {
+        close(fd);
+        return -1;
+    }
+    signal(SIGPIPE, SIG_IGN);
+    listenFd = fd;
+    listenPath = socketPath;
+    if (pthread_create(&shipper, NULL, shipper_main, NULL) != 0) {
+        close(fd);
+        listenFd = -1;
+        return -1;
+    }
+    return 0;
+}
+
+// ---- follower ----
+// A receiver thread reads the stream into `in` as fast as the primary sends it and
+// wakes the command loop through the pipe; the command loop applies complete lines.
+
+static void* receiver_main(void* arg) {
+    char chunk[65536];
+    (void)arg;
+
+    while (1) {
+        pthread_mutex_lock(&lock);
+        int quit = stopping;
+        pthread_mutex_unlock(&lock);
+        if (quit) break;
+
+        if (upFd < 0) {
+            struct sockaddr_un addr;
+            memset(&addr, 0, sizeof addr);
+            addr.sun_family = AF_UNIX;
+            strcpy(addr.sun_path, upstreamPath);
+            int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+            if (fd >= 0 && connect(fd, (struct sockaddr*)&addr, sizeof addr) == 0) {
+                pthread_mutex_lock(&lock);
+                upFd = fd;
+                pthread_mutex_unlock(&lock);
+                continue;
+            }
+            if (fd >= 0) close(fd);
+            usleep(RETRY_US);
+            continue;
+        }
+
+        ssize_t got = recv(upFd, chunk, sizeof chunk, 0);
+        if (got < 0 && errno == EINTR) continue;
+        pthread_mutex_lock(&lock);
+        if (got > 0) {
+            if (buf_append(&in, chunk, (size_t)got) != 0) got = 0;
+        }
+        if (got <= 0) { // the primary went away: drop a partial line, it will copy again
+            while (in.len > 0 && in.data[in.len - 1] != '\n') in.len--;
+            close(upFd);
+            upFd = -1;
+        }
+        pthread_mutex_unlock(&lock);
+        wake_shipper(); // the same pipe wakes the command loop here
+    }
+    return NULL;
+}
+
+int repl_follow(const char* socketPath) { // follower; 0, or -1 if the thread cannot start
+    struct sockaddr_un addr;
+    if (strlen(socketPath) >= sizeof addr.sun_path || pipe2(wakeFds, O_NONBLOCK | O_CLOEXEC) != 0) return -1;
+    upstreamPath = socketPath;
+    if (pthread_create(&receiver, NULL, receiver_main, NULL) != 0) {
+        upstreamPath = NULL;
+        return -1;
+    }
+    return 0;
+}
+
+int repl_is_follower(void) {
+    return upstreamPath != NULL;
+}
+
+int repl_fd(void) { // readable when repl_poll() has work, -1 on a primary
+    return upstreamPath ? wakeFds[0] : -1;
+}
+
+static int split_tabs(char* line, char** f, int max) {
+    int n = 0;
+    f[n++] = line;
+    for (char* p = line; *p && n < max; p++) {
+        if (*p == '\t') {
+            *p = '\0';
+            f[n++] = p + 1;
+        }
+    }
+    return n;
+}
+
+static int parse_record(char** f, StudentRecord* r) { // id, name, programme, mark
+    char* end;
+    r->id = (int)strtol(f[0], &end, 10);
+    if (end == f[0]) return -1;
+    rec_set_name(r, f[1], NULL);
+    rec_set_programme(r, f[2], NULL);
+    r->mark = strtof(f[3], NULL);
+    return 0;
+}
+
+static void stage_row(const StudentRecord* r) {
+    if (stagingCount == stagingCap) {
+        int cap = stagingCap ? stagingCap * 2 : INITIAL_RECORDS;
+        StudentRecord* grown = realloc(staging, (size_t)cap * sizeof *grown);
+        if (!grown) return;
+        staging = grown;
+        stagingCap = cap;
+    }
+    staging[stagingCount++] = *r;
+}
+
+static void install_copy(void) { // the received copy replaces the table in one step
+    for (int i = 0; i < recordCount; i++) arena_forget(&records[i], NULL);
+    free(records);
+    records = staging;
+    recordCount = stagingCount;
+    recordCapacity = stagingCap;
+    staging = NULL;
+    stagingCount = stagingCap = 0;
+    index_build(records, recordCount);
+    index_seal(records, recordCount);
+    snapshot_publish();
+    sketch_reset();
+    arena_maybe_compact(); // the old table's strings are all garbage now
+    receiving = 0;
+    synced = 1;
+}
+
+static void apply_line(char* line, int* inTxn) {
+    char* f[8];
+    StudentRecord r;
+    int n = split_tabs(line, f, 8);
+    unsigned long long now = clock_ns();
+
+    if (strcmp(f[0], "ROW") == 0) {
+        if (n == 5 && receiving && parse_record(f + 1, &r) == 0) stage_row(&r);
+        return;
+    }
+    if (n < 3) return;
+    unsigned long long msgSeq = strtoull(f[1], NULL, 10);
+    unsigned long long sent = strtoull(f[2], NULL, 10);
+    lastMsgNs = now;
+
+    if (strcmp(f[0], "RESET") == 0) {
+        receiving = 1;
+        stagingCount = 0;
+    }
+    else if (strcmp(f[0], "SYNCED") == 0 && receiving) {
+        if (*inTxn) {
+            txn_commit();
+            *inTxn = 0;
+        }
+        install_copy();
+        appliedSeq = msgSeq;
+    }
+    else if (strcmp(f[0], "HEARTBEAT") == 0) {
+        if (!receiving) appliedSeq = msgSeq; // nothing was pending
+    }
+    else if (!receiving && synced) {
+        if (!*inTxn) *inTxn = txn_begin() == 0;
+        if (strcmp(f[0], "DELETE") == 0 && n == 4) {
+            db_delete(atoi(f[3])); // already gone is fine, see the top of the file
+        }
+        else if ((strcmp(f[0], "INSERT") == 0 || strcmp(f[0], "UPDATE") == 0) && n == 7 &&
+            db_find_pos(atoi(f[3])) >= 0) { // update in place, the strings are copied once
+            db_update(atoi(f[3]), f[4], f[5], strtof(f[6], NULL));
+        }
+        else if ((strcmp(f[0], "INSERT") == 0 || strcmp(f[0], "UPDATE") == 0) && n == 7 &&
+            parse_record(f + 3, &r) == 0) {
+            db_insert(&r);
+        }
+        else return;
+        appliedSeq = msgSeq;
+        lastLagNs = now > sent ? now - sent : 0;
+        stats_record(STAT_REPL_LAG, lastLagNs);
+    }
+}
+
+void repl_poll(void) { // follower: apply whatever the primary has sent so far
+    char drain[64];
+    if (!upstreamPath) return;
+    while (read(wakeFds[0], drain, sizeof drain) > 0) {}
+
+    pthread_mutex_lock(&lock);
+    size_t end = in.len;
+    while (end > 0 && in.data[end - 1] != '\n') end--;
+    ReplBuf batch = in; // take the complete lines, the rest stays for the receiver
+    in.data = NULL;
+    in.len = in.cap = 0;
+    if (end < batch.len && buf_append(&in, batch.data + end, batch.len - end) != 0) end = batch.len;
+    int wasConnected = upFd >= 0;
+    pthread_mutex_unlock(&lock);
+
+    int inTxn = 0;
+    size_t start = 0;
+    char* nl;
+    while (start < end && (nl = memchr(batch.data + start, '\n', end - start)) != NULL) {
+        *nl = '\0';
+        apply_line(batch.data + start, &inTxn);
+        start = (size_t)(nl - batch.data) + 1;
+    }
+    if (inTxn) txn_commit(); // one publish for the batch
+    free(batch.data);
+    if (!wasConnected) { // a copy cut short is never installed
+        receiving = 0;
+        stagingCount = 0;
+    }
+}
+
+// ---- status ----
+
+int repl_status(char* buf, size_t n) { // tab-separated, 0 when replication is off
+    if (listenFd >= 0) {
+        pthread_mutex_lock(&lock);
+        snprintf(buf, n, "PRIMARY\t%d\t%llu", followerCount, seq);
+        pthread_mutex_unlock(&lock);
+        return 1;
+    }
+    if (upstreamPath) {
+        pthread_mutex_lock(&lock);
+        int connected = upFd >= 0;
+        pthread_mutex_unlock(&lock);
+        const char* state = !connected ? "DISCONNECTED" : (receiving || !synced) ? "COPYING" : "STREAMING";
+        unsigned long long age = lastMsgNs ? (clock_ns() - lastMsgNs) / 1000000ull : 0;
+        snprintf(buf, n, "FOLLOWER\t%s\t%llu\t%.3f\t%llu", state, appliedSeq, lastLagNs / 1e6, age);
+        return 1;
+    }
+    return 0;
+}
+
+void repl_show(void) {
+    if (listenFd >= 0) {
+        pthread_mutex_lock(&lock);
+        printf("Replication: primary on %s, %d follower(s), last change #%llu\n", listenPath, followerCount, seq);
+        pthread_mutex_unlock(&lock);
+    }
+    else if (upstreamPath) {
+        char line[160];
+        char* f[6];
+        repl_status(line, sizeof line);
+        split_tabs(line, f, 6);
+        printf("Replication: follower of %s, %s, applied change #%s, last lag %s ms, last message %s ms ago\n",
+            upstreamPath, f[1], f[2], f[3], f[4]);
+        printf("(read-only: the lag distribution is the repl.lag row above)\n");
+    }
+}
+
+void repl_close(void) {
+    if (listenFd >= 0) {
+        pthread_mutex_lock(&lock);
+        stopping = 1;
+        pthread_mutex_unlock(&lock);
+        wake_shipper();
+        pthread_join(shipper, NULL);
+        while (followers) drop(followers);
+        close(listenFd);
+        close(wakeFds[0]);
+        close(wakeFds[1]);
+        unlink(listenPath);
+        listenFd = -1;
+    }
+    if (upstreamPath) {
+        pthread_mutex_lock(&lock);
+        stopping = 1;
+        if (upFd >= 0) shutdown(upFd, SHUT_RDWR); // ends the receiver's recv()
+        pthread_mutex_unlock(&lock);
+        pthread_join(receiver, NULL);
+        if (upFd >= 0) close(upFd);
+        upstreamPath = NULL;
+    }
+}
+
+#else
+
+int repl_listen(const char* socketPath) {
+    (void)socketPath;
+    printf("Replication needs Unix domain sockets (Linux only).\n");
+    return -1;
+}
+
+int repl_follow(const char* socketPath) {
+    (void)socketPath;
+    printf("Replication needs Unix domain sockets (Linux only).\n");
+    return -1;
+}
+
+int repl_is_follower(void) { return 0; }
+int repl_fd(void) { return -1; }
+void repl_poll(void) {}
+void repl_record(const char* op, const StudentRecord* before, const StudentRecord* after, const char* status) {
+    (void)op;
+    (void)before;
+    (void)after;
+    (void)status;
+}
+void repl_begin_group(void) {}
+void repl_end_group(int committed) { (void)committed; }
+int repl_status(char* buf, size_t n) {
+    (void)buf;
+    (void)n;
+    return 0;
+}
+void repl_show(void) {}
+void repl_close(void) {}
+
+#endif
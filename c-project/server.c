@@ -0,0 +1,715 @@
+/*
+ *This file contains the server mode (student_db --server [socket]).
+ *The server owns the in-memory database and serves many local clients over a
+ *Unix domain socket from one epoll event loop, so requests never race.
+ *
+ *Protocol: one request per line, fields separated by tabs, commands case-insensitive
+ *  OPEN | SHOWALL | SAVE | SUMMARY
+ *  SUMMARY APPROX                         (from sketches, see sketch.c: rows COUNT, AVERAGE, PERCENTILES
+ *                                          (10, 25, 50, 75, 90), DISTINCT_NAMES, DISTINCT_PROGRAMMES,
+ *                                          TOP<TAB>programme<TAB>rows for each top programme, SKETCH<TAB>bytes<TAB>stale)
+ *  REFRESH                                (reads rows appended to the file: "APPENDED<TAB>n",
+ *                                          or "RELOADED<TAB>n" after a full OPEN, see refresh.c)
+ *  SAVE STATUS                            (SAVE itself only starts a background save)
+ *  SAVE COMPRESSED                        (same, in the compressed snapshot format to Sample-CMS.cmsz)
+ *  SAVE INDEX                             (text, plus the ID index for a faster OPEN)
+ *  INSERT <id> <name> <programme> <mark>
+ *  QUERY <id> [<id> ...]                  (several IDs: the rows found, in request order)
+ *  UPDATE <id> <name> <programme> <mark>   (empty name/programme or mark -1 keeps the field)
+ *  DELETE <id>
+ *  SORT <field> [ASC|DESC] [<field> ...]   (fields ID, NAME, PROGRAMME, MARK; e.g.
+ *                                          SORT<TAB>PROGRAMME<TAB>MARK<TAB>DESC<TAB>NAME)
+ *  BEGIN | COMMIT | ROLLBACK               (one client at a time; others get ERR TXN_BUSY for writes,
+ *                                          and a client that disconnects is rolled back; SHOWALL,
+ *                                          QUERY and SUMMARY show the owner its uncommitted changes
+ *                                          and everyone else the last commit)
+ *  ATTACH <file> [<name>]                 (another table keyed by student ID, see join.c: "<NAME><TAB>rows")
+ *  DETACH <name> | TABLES                 (TABLES: name, rows, file, then the column names, STUDENTS first)
+ *  JOIN [<left>] <right>                  (hash join on the ID, left defaults to STUDENTS: ID, then
+ *                                          the left columns, then the right ones, as "OK *" and the
+ *                                          rows as the join finds them, ended by a line ".")
+ *  INDEX STATS                            (ID index health: LOAD used size, PROBES mean expected max,
+ *                                          HISTOGRAM with keys at 1, 2, 3-4, ... 65+ probes, then
+ *                                          TOMBSTONES, REBUILDS, GROWS, DROPPED, STATIC_KEYS, see index.c)
+ *  STATS                                  (name, count, mean, p50, p99, max in microseconds per row,
+ *                                          then a REPL row when replication is on, see repl.c)
+ *A replica (--follow) answers the changing commands other than SORT with ERR READ_ONLY.
+ *Every reply is "OK <n>" followed by n tab-separated rows, "OK *" followed by rows up to a
+ *line ".", or "ERR <reason>".
+ *Clients may pipeline requests; replies always come back in request order.
+*/
+
+#define _CRT_SECURE_NO_WARNINGS
+#define _GNU_SOURCE // accept4
+#include "student_db.h"
+
+#ifdef __linux__
+
+#include <ctype.h>
+#include <errno.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#define MAX_EVENTS 64
+#define MAX_FIELDS 8
+#define MAX_LINE 4096              // longest request accepted
+#define OUT_HIGH_WATER (1 << 20)   // stop reading from a client that does not drain its replies
+#define JOIN_FLUSH (64 * 1024)     // JOIN sends its rows as they come, once this much is waiting
+
+typedef struct {
+    char* data;
+    size_t len;
+    size_t cap;
+} Buffer;
+
+typedef struct Conn {
+    int fd;
+    Buffer in;
+    Buffer out;
+    size_t outSent;
+    unsigned events;   // epoll interest currently registered
+    int eof;           // client closed its write side
+    struct Conn* prev;
+    struct Conn* next;
+} Conn;
+
+static volatile sig_atomic_t stopping = 0;
+static Conn* conns = NULL;
+static Conn* txnOwner = NULL; // the client between BEGIN and COMMIT/ROLLBACK
+
+static void on_signal(int sig) {
+    (void)sig;
+    stopping = 1;
+}
+
+static int buf_reserve(Buffer* b, size_t extra) {
+    if (b->len + extra <= b->cap) return 0;
+    size_t cap = b->cap ? b->cap : 4096;
+    while (cap < b->len + extra) cap *= 2;
+    char* data = realloc(b->data, cap);
+    if (!data) return -1;
+    b->data = data;
+    b->cap = cap;
+    return 0;
+}
+
+static void buf_printf(Buffer* b, const char* fmt, ...) {
+    va_list ap;
+    va_start(ap, fmt);
+    int n = vsnprintf(NULL, 0, fmt, ap);
+    va_end(ap);
+    if (n < 0 || buf_reserve(b, (size_t)n + 1) != 0) return;
+    va_start(ap, fmt);
+    vsnprintf(b->data + b->len, (size_t)n + 1, fmt, ap);
+    va_end(ap);
+    b->len += (size_t)n;
+}
+
+static void reply_row(Buffer* out, const StudentRecord* r) {
+    buf_printf(out, "%d\t%s\t%s\t%.2f\n", r->id, r->name, r->programme, r->mark);
+}
+
+static void reply_cols(Buffer* out, JoinCols c) {
+    if (c.student) buf_printf(out, "\t%s\t%s\t%.2f", c.student->name, c.student->programme, c.student->mark);
+    else if (c.columns[0]) buf_printf(out, "\t%s", c.columns);
+}
+
+static int out_pending(const Conn* c) {
+    return c->outSent < c->out.len;
+}
+
+static int flush_out(Conn* c) { // returns -1 if the client went away
+    while (out_pending(c)) {
+        ssize_t w = send(c->fd, c->out.data + c->outSent, c->out.len - c->outSent, MSG_NOSIGNAL);
+        if (w < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) return 0;
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        c->outSent += (size_t)w;
+    }
+    c->out.len = 0;
+    c->outSent = 0;
+    return 0;
+}
+
+static void reply_join_row(void* ctx, int id, JoinCols left, JoinCols right) {
+    Conn* c = ctx;
+    Buffer* out = &c->out;
+    buf_printf(out, "%d", id);
+    reply_cols(out, left);
+    reply_cols(out, right);
+    buf_printf(out, "\n");
+    if (out->len - c->outSent >= JOIN_FLUSH) { // hand what the socket takes to the client now
+        flush_out(c);
+        if (c->outSent > out->len / 2) { // drop the sent half, so a slow reader costs no more than its backlog
+            memmove(out->data, out->data + c->outSent, out->len - c->outSent);
+            out->len -= c->outSent;
+            c->outSent = 0;
+        }
+    }
+}
+
+static int parse_int(const char* s, int* out) {
+    char* end;
+    long v = strtol(s, &end, 10);
+    if (end == s || *end != '\0') return 0;
+    *out = (int)v;
+    return 1;
+}
+
+static int parse_mark(const char* s, float* out) {
+    char* end;
+    if (s[0] == '\0') { // empty means "keep" for UPDATE
+        *out = -1;
+        return 1;
+    }
+    *out = strtof(s, &end);
+    return end != s && *end == '\0';
+}
+
+static int split_fields(char* line, char** f) { // tab-separated, empty fields preserved
+    int n = 0;
+    f[n++] = line;
+    for (char* p = line; *p && n < MAX_FIELDS; p++) {
+        if (*p == '\t') {
+            *p = '\0';
+            f[n++] = p + 1;
+        }
+    }
+    return n;
+}
+
+static int parse_id_list(char** f, int n, int* ids, int max) { // fields 1..n-1, the last may still hold tabs
+    int count = 0;
+    for (int i = 1; i < n; i++) {
+        char* p = f[i];
+        for (;;) {
+            char* tab = (i == n - 1) ? strchr(p, '\t') : NULL;
+            if (tab) *tab = '\0';
+            if (count == max || !parse_int(p, &ids[count])) return -1;
+            count++;
+            if (!tab) break;
+            p = tab + 1;
+        }
+    }
+    return count;
+}
+
+static int is_write(const char* command) {
+    return strcmp(command, "INSERT") == 0 || strcmp(command, "UPDATE") == 0 || strcmp(command, "DELETE") == 0 ||
+        strcmp(command, "SORT") == 0 || strcmp(command, "OPEN") == 0 || strcmp(command, "REFRESH") == 0;
+}
+
+static int replica_refuses(char** f, int n) { // SORT only reorders the replica's own copy
+    if (strcmp(f[0], "SAVE") == 0) return n < 2 || strcmp(f[1], "STATUS") != 0;
+    return (is_write(f[0]) && strcmp(f[0], "SORT") != 0) || strcmp(f[0], "BEGIN") == 0;
+}
+
+static void handle_request(Conn* c, char* line) {
+    char* f[MAX_FIELDS];
+    int n = split_fields(line, f);
+    int id;
+    float mark;
+    Buffer* out = &c->out;
+
+    for (char* p = f[0]; *p; p++) *p = (char)toupper((unsigned char)*p);
+    if (strcmp(f[0], "SAVE") == 0 || strcmp(f[0], "SUMMARY") == 0 || strcmp(f[0], "INDEX") == 0) { // keyword arguments
+        for (int k = 1; k < n; k++) {
+            for (char* p = f[k]; *p; p++) *p = (char)toupper((unsigned char)*p);
+        }
+    }
+
+    if (repl_is_follower() && replica_refuses(f, n)) {
+        buf_printf(out, "ERR READ_ONLY\n");
+        return;
+    }
+    if (txnOwner && txnOwner != c && is_write(f[0])) { // readers still see the last commit
+        buf_printf(out, "ERR TXN_BUSY\n");
+        return;
+    }
+    if (txnOwner == c && (strcmp(f[0], "SORT") == 0 || strcmp(f[0], "OPEN") == 0 || strcmp(f[0], "REFRESH") == 0)) {
+        buf_printf(out, "ERR IN_TXN\n");
+        return;
+    }
+    if (strcmp(f[0], "BEGIN") == 0) {
+        if (txn_begin() != 0) {
+            buf_printf(out, "ERR TXN_OPEN\n");
+            return;
+        }
+        txnOwner = c;
+        buf_printf(out, "OK 0\n");
+        return;
+    }
+    if (strcmp(f[0], "COMMIT") == 0 || strcmp(f[0], "ROLLBACK") == 0) {
+        if (txnOwner != c) {
+            buf_printf(out, "ERR NO_TXN\n");
+            return;
+        }
+        int changes = strcmp(f[0], "COMMIT") == 0 ? txn_commit() : txn_rollback();
+        txnOwner = NULL;
+        buf_printf(out, "OK 1\n%d\n", changes);
+        return;
+    }
+
+    if (strcmp(f[0], "OPEN") == 0) {
+        int loaded = storage_open();
+        if (loaded < 0) buf_printf(out, "ERR OPEN_FAILED\n");
+        else buf_printf(out, "OK 1\n%d\n", loaded);
+    }
+    else if (strcmp(f[0], "REFRESH") == 0) {
+        int rows;
+        RefreshResult rc = db_refresh(&rows);
+        if (rc == REFRESH_APPENDED) buf_printf(out, "OK 1\nAPPENDED\t%d\n", rows);
+        else if (rc == REFRESH_RELOADED) buf_printf(out, "OK 1\nRELOADED\t%d\n", rows);
+        else if (rc == REFRESH_BUSY) buf_printf(out, "ERR SAVE_RUNNING\n");
+        else if (rc == REFRESH_UNSUPPORTED) buf_printf(out, "ERR UNSUPPORTED\n");
+        else buf_printf(out, "ERR REFRESH_FAILED\n");
+    }
+    else if (strcmp(f[0], "SHOWALL") == 0 && txnOwner == c) { // records[] minus the rows this transaction deleted
+        int count = 0;
+        for (int i = 0; i < recordCount; i++) count += !txn_row_deleted(i);
+        buf_printf(out, "OK %d\n", count);
+        for (int i = 0; i < recordCount; i++) {
+            if (!txn_row_deleted(i)) reply_row(out, &records[i]);
+        }
+    }
+    else if (strcmp(f[0], "SHOWALL") == 0) {
+        lazy_fetch_all();
+        DbSnapshot* snap = snapshot_acquire();
+        int count = snapshot_count(snap);
+        buf_printf(out, "OK %d\n", count);
+        for (int i = 0; i < count; i++) reply_row(out, snapshot_row(snap, i));
+        snapshot_release(snap);
+    }
+    else if (strcmp(f[0], "INSERT") == 0) {
+        StudentRecord rec;
+        if (n != 5 || !parse_int(f[1], &rec.id) || !parse_mark(f[4], &rec.mark) || rec.mark < 0) {
+            buf_printf(out, "ERR USAGE INSERT<TAB>id<TAB>name<TAB>programme<TAB>mark\n");
+            return;
+        }
+        rec_set_name(&rec, f[2], NULL);
+        rec_set_programme(&rec, f[3], NULL);
+        int rc = db_insert(&rec);
+        if (rc == -1) buf_printf(out, "ERR DUPLICATE\n");
+        else if (rc == -2) buf_printf(out, "ERR NO_MEMORY\n");
+        else buf_printf(out, "OK 0\n");
+    }
+    else if (strcmp(f[0], "QUERY") == 0 && n > 2) { // batch: the rows found, in request order
+        static int ids[MAX_LINE / 2];
+        static const StudentRecord* rows[MAX_LINE / 2];
+        int count = parse_id_list(f, n, ids, MAX_LINE / 2);
+        if (count < 0) {
+            buf_printf(out, "ERR USAGE QUERY<TAB>id[<TAB>id...]\n");
+            return;
+        }
+        lazy_fetch(ids, count);
+        DbSnapshot* snap = snapshot_acquire();
+        int found = 0;
+        if (txnOwner == c) {
+            for (int i = 0; i < count; i++) found += (rows[i] = txn_find(ids[i])) != NULL;
+        }
+        else {
+            found = snapshot_find_batch(snap, ids, count, rows);
+        }
+        buf_printf(out, "OK %d\n", found);
+        for (int i = 0; i < count; i++) {
+            if (rows[i]) reply_row(out, rows[i]);
+        }
+        snapshot_release(snap);
+    }
+    else if (strcmp(f[0], "QUERY") == 0) {
+        if (n != 2 || !parse_int(f[1], &id)) {
+            buf_printf(out, "ERR USAGE QUERY<TAB>id\n");
+            return;
+        }
+        lazy_fetch(&id, 1);
+        DbSnapshot* snap = snapshot_acquire();
+        const StudentRecord* rec = txnOwner == c ? txn_find(id) : snapshot_find(snap, id);
+        if (rec) {
+            buf_printf(out, "OK 1\n");
+            reply_row(out, rec);
+        }
+        else {
+            buf_printf(out, "ERR NOT_FOUND\n");
+        }
+        snapshot_release(snap);
+    }
+    else if (strcmp(f[0], "UPDATE") == 0) {
+        if (n != 5 || !parse_int(f[1], &id) || !parse_mark(f[4], &mark)) {
+            buf_printf(out, "ERR USAGE UPDATE<TAB>id<TAB>name<TAB>programme<TAB>mark\n");
+            return;
+        }
+        if (db_update(id, f[2], f[3], mark) != 0) buf_printf(out, "ERR NOT_FOUND\n");
+        else buf_printf(out, "OK 0\n");
+    }
+    else if (strcmp(f[0], "DELETE") == 0) {
+        if (n != 2 || !parse_int(f[1], &id)) {
+            buf_printf(out, "ERR USAGE DELETE<TAB>id\n");
+            return;
+        }
+        if (db_delete(id) != 0) buf_printf(out, "ERR NOT_FOUND\n");
+        else buf_printf(out, "OK 0\n");
+    }
+    else if (strcmp(f[0], "SAVE") == 0 && n > 1 && strcmp(f[1], "INDEX") == 0) {
+        if (storage_save(FORMAT_TEXT_INDEX) != 0) buf_printf(out, "ERR SAVE_FAILED\n");
+        else buf_printf(out, "OK 0\n");
+    }
+    else if (strcmp(f[0], "SAVE") == 0 && n > 1 && strcmp(f[1], "COMPRESSED") == 0) {
+        if (storage_save(FORMAT_COMPRESSED) != 0) buf_printf(out, "ERR SAVE_FAILED\n");
+        else buf_printf(out, "OK 0\n");
+    }
+    else if (strcmp(f[0], "SAVE") == 0 && n == 2 && strcmp(f[1], "STATUS") == 0) { // state, rows written, rows total, seconds
+        static const char* states[] = { "IDLE", "RUNNING", "DONE", "FAILED" };
+        SaveStatus st;
+        db_save_status(&st);
+        buf_printf(out, "OK 1\n%s\t%ld\t%ld\t%.3f\n", states[st.state], st.rowsWritten, st.rowsTotal, st.seconds);
+    }
+    else if (strcmp(f[0], "SAVE") == 0 && n > 1) {
+        buf_printf(out, "ERR USAGE SAVE[<TAB>STATUS|COMPRESSED|INDEX]\n");
+    }
+    else if (strcmp(f[0], "SAVE") == 0) {
+        if (storage_save(FORMAT_TEXT) < 0) buf_printf(out, "ERR SAVE_FAILED\n"); // 1: no shard changed
+        else buf_printf(out, "OK 0\n");
+    }
+    else if (strcmp(f[0], "SORT") == 0) {
+        char spec[MAX_LINE];
+        SortKey keys[MAX_SORT_KEYS];
+        int len = 0;
+        if (n < 2) {
+            buf_printf(out, "ERR USAGE SORT<TAB>field[<TAB>DESC][<TAB>field...]\n");
+            return;
+        }
+        for (int k = 1; k < n; k++) { // fields may come as tabs or as "PROGRAMME, MARK DESC" in one
+            len += snprintf(spec + len, sizeof spec - (size_t)len, "%s ", f[k]);
+        }
+        int count = db_parse_sort(spec, keys);
+        if (count <= 0) {
+            buf_printf(out, "ERR UNKNOWN_FIELD\n");
+            return;
+        }
+        if (db_sort_by(keys, count) != 0) buf_printf(out, "ERR NO_MEMORY\n");
+        else buf_printf(out, "OK 0\n");
+    }
+    else if (strcmp(f[0], "SUMMARY") == 0 && n > 1 && strcmp(f[1], "APPROX") == 0) {
+        ApproxSummary st;
+        if (db_summary_approx(&st) != 0) {
+            buf_printf(out, "ERR EMPTY\n");
+            return;
+        }
+        buf_printf(out, "OK %d\nCOUNT\t%lld\nAVERAGE\t%.2f\nPERCENTILES\t%.1f\t%.1f\t%.1f\t%.1f\t%.1f\n", 6 + st.topCount,
+            st.count, st.average, st.quantiles[0], st.quantiles[1], st.quantiles[2], st.quantiles[3], st.quantiles[4]);
+        buf_printf(out, "DISTINCT_NAMES\t%lld\nDISTINCT_PROGRAMMES\t%lld\n", st.distinctNames, st.distinctProgrammes);
+        for (int i = 0; i < st.topCount; i++) buf_printf(out, "TOP\t%s\t%lld\n", st.topProgramme[i], st.topRows[i]);
+        buf_printf(out, "SKETCH\t%zu\t%lld\n", st.bytes, st.stale);
+        audit_log("SUMMARY", NULL, NULL, "SUCCESS(APPROX)");
+    }
+    else if (strcmp(f[0], "SUMMARY") == 0 && n > 1) {
+        buf_printf(out, "ERR USAGE SUMMARY[<TAB>APPROX]\n");
+    }
+    else if (strcmp(f[0], "SUMMARY") == 0) {
+        SummaryStats st;
+        if (db_summary(&st, txnOwner == c) != 0) {
+            buf_printf(out, "ERR EMPTY\n");
+            return;
+        }
+        buf_printf(out, "OK 1\n%d\t%.2f\t%.2f\t%s\t%.2f\t%s\n",
+            st.count, st.average, st.highest, st.highName, st.lowest, st.lowName);
+        audit_log("SUMMARY", NULL, NULL, "SUCCESS");
+    }
+    else if (strcmp(f[0], "INDEX") == 0 && n > 1 && strcmp(f[1], "STATS") == 0) {
+        IndexStats st;
+        index_stats(&st);
+        buf_printf(out, "OK 8\nLOAD\t%d\t%d\nPROBES\t%.2f\t%.2f\t%d\nHISTOGRAM", st.used, st.size,
+            st.meanProbe, st.expectedProbe, st.maxProbe);
+        for (int b = 0; b < PROBE_BUCKETS; b++) buf_printf(out, "\t%lld", st.probes[b]);
+        buf_printf(out, "\nTOMBSTONES\t%d\nREBUILDS\t%d\nGROWS\t%d\nDROPPED\t%d\nSTATIC_KEYS\t%d\n",
+            st.tombstones, st.rebuilds, st.grows, st.dropped, st.staticKeys);
+    }
+    else if (strcmp(f[0], "INDEX") == 0) {
+        buf_printf(out, "ERR USAGE INDEX<TAB>STATS\n");
+    }
+    else if (strcmp(f[0], "ATTACH") == 0 && (n == 2 || n == 3)) {
+        TableInfo t;
+        int rc = db_attach(f[1], n == 3 ? f[2] : NULL, &t);
+        if (rc == -1) buf_printf(out, "ERR CANNOT_READ\n");
+        else if (rc == -2) buf_printf(out, "ERR NO_MEMORY\n");
+        else if (rc == -3) buf_printf(out, "ERR BAD_NAME\n");
+        else buf_printf(out, "OK 1\n%s\t%d\n", t.name, t.rows);
+    }
+    else if (strcmp(f[0], "DETACH") == 0 && n == 2) {
+        for (char* p = f[1]; *p; p++) *p = (char)toupper((unsigned char)*p);
+        if (db_detach(f[1]) != 0) buf_printf(out, "ERR NO_TABLE\n");
+        else buf_printf(out, "OK 0\n");
+    }
+    else if (strcmp(f[0], "TABLES") == 0) {
+        TableInfo t[MAX_TABLES];
+        int count = db_tables(t, MAX_TABLES);
+        DbSnapshot* snap = snapshot_acquire();
+        buf_printf(out, "OK %d\nSTUDENTS\t%d\t%s\t%s\n", count + 1, snapshot_count(snap), FILENAME, db_table_columns("STUDENTS"));
+        snapshot_release(snap);
+        for (int i = 0; i < count; i++) {
+            const char* cols = db_table_columns(t[i].name);
+            buf_printf(out, "%s\t%d\t%s%s%s\n", t[i].name, t[i].rows, t[i].path, cols[0] ? "\t" : "", cols);
+        }
+    }
+    else if (strcmp(f[0], "JOIN") == 0 && (n == 2 || n == 3)) { // "OK *", the rows as they are found, then "."
+        for (int k = 1; k < n; k++) {
+            for (char* p = f[k]; *p; p++) *p = (char)toupper((unsigned char)*p);
+        }
+        if (!db_table_columns(n == 3 ? f[1] : "STUDENTS") || !db_table_columns(f[n - 1])) {
+            buf_printf(out, "ERR NO_TABLE\n");
+            return;
+        }
+        buf_printf(out, "OK *\n");
+        db_join(n == 3 ? f[1] : "STUDENTS", f[n - 1], reply_join_row, c);
+        buf_printf(out, ".\n");
+    }
+    else if (strcmp(f[0], "STATS") == 0) {
+        StatSummary rows[STAT_COUNT];
+        char repl[160];
+        int count = 0;
+        for (int i = 0; i < STAT_COUNT; i++) count += stats_get((StatId)i, &rows[count]);
+        int hasRepl = repl_status(repl, sizeof repl);
+        buf_printf(out, "OK %d\n", count + hasRepl);
+        for (int i = 0; i < count; i++) {
+            buf_printf(out, "%s\t%llu\t%.1f\t%.1f\t%.1f\t%.1f\n", rows[i].name, rows[i].count,
+                rows[i].meanNs / 1000.0, rows[i].p50Ns / 1000.0, rows[i].p99Ns / 1000.0, rows[i].maxNs / 1000.0);
+        }
+        if (hasRepl) buf_printf(out, "REPL\t%s\n", repl);
+    }
+    else {
+        buf_printf(out, "ERR UNKNOWN_COMMAND\n");
+    }
+}
+
+static int stat_for(const char* command) { // StatId of a request, -1 if it is not timed
+    static const char* names[] = {
+        "OPEN", "SHOWALL", "INSERT", "QUERY", "UPDATE", "DELETE", "SAVE", "SORT", "SUMMARY", "JOIN"
+    };
+    for (int i = 0; i < (int)(sizeof names / sizeof names[0]); i++) {
+        if (strcmp(command, names[i]) == 0) return STAT_OPEN + i;
+    }
+    return -1;
+}
+
+static void conn_close(int ep, Conn* c) {
+    if (txnOwner == c) { // a client that goes away never commits
+        txn_rollback();
+        txnOwner = NULL;
+    }
+    epoll_ctl(ep, EPOLL_CTL_DEL, c->fd, NULL);
+    close(c->fd);
+    if (c->prev) c->prev->next = c->next;
+    else conns = c->next;
+    if (c->next) c->next->prev = c->prev;
+    free(c->in.data);
+    free(c->out.data);
+    free(c);
+}
+
+static void process_lines(Conn* c) { // answer every complete request while replies keep draining
+    size_t start = 0;
+    while (start < c->in.len && c->out.len - c->outSent < OUT_HIGH_WATER) {
+        char* nl = memchr(c->in.data + start, '\n', c->in.len - start);
+        if (!nl) break;
+        *nl = '\0';
+        if (nl > c->in.data + start && nl[-1] == '\r') nl[-1] = '\0';
+        if (c->in.data[start] != '\0') {
+            STATS_START(t0);
+            TRACE_START(t1);
+            handle_request(c, c->in.data + start); // leaves the upper-cased command name
+            int stat = stat_for(c->in.data + start);
+            if (stat >= 0) STATS_STOP((StatId)stat, t0);
+            TRACE_STOP(c->in.data + start, t1);
+        }
+        start = (size_t)(nl - c->in.data) + 1;
+    }
+    if (start > 0) {
+        memmove(c->in.data, c->in.data + start, c->in.len - start);
+        c->in.len -= start;
+    }
+}
+
+static void conn_event(int ep, Conn* c, unsigned events) {
+    if (events & EPOLLERR) {
+        conn_close(ep, c);
+        return;
+    }
+
+    if ((c->events & EPOLLIN) && (events & (EPOLLIN | EPOLLHUP))) {
+        while (1) {
+            if (buf_reserve(&c->in, 4096) != 0) {
+                conn_close(ep, c);
+                return;
+            }
+            ssize_t r = recv(c->fd, c->in.data + c->in.len, c->in.cap - c->in.len, 0);
+            if (r > 0) {
+                c->in.len += (size_t)r;
+                continue;
+            }
+            if (r == 0) c->eof = 1;
+            else if (errno == EINTR) continue;
+            else if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                conn_close(ep, c);
+                return;
+            }
+            break;
+        }
+    }
+
+    process_lines(c);
+    if (c->in.len > MAX_LINE && !memchr(c->in.data, '\n', c->in.len)) {
+        buf_printf(&c->out, "ERR LINE_TOO_LONG\n");
+        c->in.len = 0;
+        c->eof = 1;
+    }
+    if (flush_out(c) != 0) {
+        conn_close(ep, c);
+        return;
+    }
+    if (!out_pending(c)) process_lines(c); // requests held back by the high-water mark
+    if (flush_out(c) != 0) {
+        conn_close(ep, c);
+        return;
+    }
+
+    int moreRequests = c->in.len > 0 && memchr(c->in.data, '\n', c->in.len) != NULL;
+    if (c->eof && !out_pending(c) && !moreRequests) {
+        conn_close(ep, c);
+        return;
+    }
+
+    unsigned want = 0;
+    if (out_pending(c)) want |= EPOLLOUT;
+    if (!c->eof && c->out.len - c->outSent < OUT_HIGH_WATER) want |= EPOLLIN;
+    if (want != c->events) {
+        struct epoll_event ev = { 0 };
+        ev.events = want;
+        ev.data.ptr = c;
+        epoll_ctl(ep, EPOLL_CTL_MOD, c->fd, &ev);
+        c->events = want;
+    }
+}
+
+static void accept_clients(int ep, int lfd) {
+    while (1) {
+        int fd = accept4(lfd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) return; // EAGAIN: backlog drained
+
+        Conn* c = calloc(1, sizeof *c);
+        if (!c) {
+            close(fd);
+            continue;
+        }
+        c->fd = fd;
+        c->events = EPOLLIN;
+
+        struct epoll_event ev = { 0 };
+        ev.events = EPOLLIN;
+        ev.data.ptr = c;
+        if (epoll_ctl(ep, EPOLL_CTL_ADD, fd, &ev) != 0) {
+            close(fd);
+            free(c);
+            continue;
+        }
+        c->next = conns;
+        if (conns) conns->prev = c;
+        conns = c;
+    }
+}
+
+int server_run(const char* socketPath) {
+    struct sockaddr_un addr;
+    struct sigaction sa;
+    struct epoll_event events[MAX_EVENTS];
+
+    memset(&addr, 0, sizeof addr);
+    addr.sun_family = AF_UNIX;
+    if (strlen(socketPath) >= sizeof addr.sun_path) {
+        printf("Socket path too long: %s\n", socketPath);
+        return -1;
+    }
+    strcpy(addr.sun_path, socketPath);
+
+    memset(&sa, 0, sizeof sa);
+    sa.sa_handler = on_signal; // no SA_RESTART, so epoll_wait returns on Ctrl+C
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+    signal(SIGPIPE, SIG_IGN);
+
+    int lfd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (lfd < 0) {
+        perror("socket");
+        return -1;
+    }
+    unlink(socketPath);
+    if (bind(lfd, (struct sockaddr*)&addr, sizeof addr) != 0 || listen(lfd, SOMAXCONN) != 0) {
+        perror("bind");
+        close(lfd);
+        return -1;
+    }
+
+    int ep = epoll_create1(EPOLL_CLOEXEC);
+    struct epoll_event ev = { 0 };
+    ev.events = EPOLLIN;
+    ev.data.ptr = NULL; // NULL marks the listening socket
+    epoll_ctl(ep, EPOLL_CTL_ADD, lfd, &ev);
+
+    static int replMarker; // events[].data.ptr of a replica's wake-up pipe
+    if (repl_fd() >= 0) {
+        ev.events = EPOLLIN;
+        ev.data.ptr = &replMarker;
+        epoll_ctl(ep, EPOLL_CTL_ADD, repl_fd(), &ev);
+    }
+    static int watchMarker; // the inotify descriptor of --watch
+    if (refresh_fd() >= 0) {
+        ev.events = EPOLLIN;
+        ev.data.ptr = &watchMarker;
+        epoll_ctl(ep, EPOLL_CTL_ADD, refresh_fd(), &ev);
+    }
+
+    printf("Serving %d records on %s (Ctrl+C to stop)\n", recordCount, socketPath);
+    while (!stopping) {
+        SaveStatus save;
+        db_save_status(&save);
+        int n = epoll_wait(ep, events, MAX_EVENTS, save.state == SAVE_RUNNING ? 100 : -1);
+        db_save_poll();
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            perror("epoll_wait");
+            break;
+        }
+        repl_poll();
+        for (int i = 0; i < n; i++) {
+            if (events[i].data.ptr == NULL) accept_clients(ep, lfd);
+            else if (events[i].data.ptr == &replMarker) continue; // applied by repl_poll() above
+            else if (events[i].data.ptr == &watchMarker) continue; // read by refresh_poll() below
+            else conn_event(ep, events[i].data.ptr, events[i].events);
+        }
+        refresh_poll(); // after the requests, so a COMMIT just made lets a postponed refresh run
+    }
+
+    while (conns) conn_close(ep, conns);
+    close(ep);
+    close(lfd);
+    unlink(socketPath);
+    printf("Server stopped.\n");
+    return 0;
+}
+
+#else
+
+int server_run(const char* socketPath) {
+    (void)socketPath;
+    printf("Server mode needs Unix domain sockets and epoll (Linux only).\n");
+    return -1;
+}
+
+#endif
@@ -0,0 +1,200 @@
+/*
+ *This file contains the sharded text storage (student_db --shards N).
+ *The rows are spread over N files by a hash of the ID: <file>.0 .. <file>.N-1,
+ *each in the usual text format, plus <file>.shards holding N. The table in
+ *memory stays one records[] array with one index, so queries, snapshots,
+ *transactions and replicas work as before. What changes is the I/O:
+ *  - OPEN parses the shard files on one thread each, then merges them
+ *  - every change marks its shard dirty, and SAVE rewrites only the dirty
+ *    shards, one thread each (see 7save.c)
+ *Rows come back grouped by shard, so SORT order is not kept across OPEN.
+ *Without <file>.shards, OPEN reads the single file and the next SAVE splits it.
+ *Every file <file>.shards counts was written, so one that cannot be read fails OPEN
+ *and leaves the table in memory alone; serving the rest would lose rows at the next SAVE.
+*/
+
+#define _CRT_SECURE_NO_WARNINGS
+#include "student_db.h"
+#include <pthread.h>
+#include <stdlib.h>
+
+#define SHARD_NO_MEMORY 1
+#define SHARD_UNREADABLE 2
+
+typedef struct {
+    pthread_t thread;
+    char path[280];
+    StudentRecord* rows;
+    StrPool* strings;  // this thread's names and programmes, adopted by the table after the merge
+    int count;
+    int failed;    // SHARD_NO_MEMORY or SHARD_UNREADABLE: every file in the manifest was written, so none may be missing
+} ShardLoad;
+
+static int shards = 0;                  // 0: one file, as before
+static int savedShards = 0;             // N in <file>.shards at the last OPEN or SAVE
+static unsigned long long dirty = 0;    // bit k: shard k changed since it was written
+
+void shard_configure(int count) { // 0 goes back to one file
+    if (count < 0) count = 0;
+    if (count > MAX_SHARDS) count = MAX_SHARDS;
+    shards = count;
+}
+
+int shard_count(void) {
+    return shards;
+}
+
+int shard_of(int id) {
+    return (int)(((unsigned)id * 2654435761u) % (unsigned)shards); // spreads consecutive IDs
+}
+
+void shard_touch(int id) {
+    if (shards > 0) dirty |= 1ull << shard_of(id);
+}
+
+void shard_touch_all(void) {
+    if (shards > 0) dirty = shards == 64 ? ~0ull : (1ull << shards) - 1;
+}
+
+unsigned long long shard_take_dirty(void) { // the shards a SAVE starting now must write
+    unsigned long long mask = dirty;
+    dirty = 0;
+    return mask;
+}
+
+void shard_restore_dirty(unsigned long long mask) { // that SAVE failed
+    dirty |= mask;
+}
+
+void shard_path(char* out, size_t n, const char* base, int shard) {
+    snprintf(out, n, "%s.%d", base, shard);
+}
+
+int shard_pending(void) {
+    return dirty != 0;
+}
+
+int shard_write_manifest(const char* base) { // after the shard files, so OPEN never sees a count with missing files
+    char path[280];
+    snprintf(path, sizeof path, "%s.shards", base);
+    FILE* fp = fopen(path, "w");
+    if (fp == NULL) return -1;
+    fprintf(fp, "%d\n", shards);
+    return fclose(fp) == 0 ? 0 : -1;
+}
+
+void shard_saved(const char* base) { // command thread, once a sharded SAVE has succeeded
+    char path[280];
+    if (shards == 0) return;
+    for (int k = shards; k < savedShards; k++) { // left over from a larger shard count
+        shard_path(path, sizeof path, base, k);
+        remove(path);
+    }
+    savedShards = shards;
+}
+
+static int read_manifest(const char* base) { // N, or 0 without a sharded copy
+    char path[280];
+    int n = 0;
+    snprintf(path, sizeof path, "%s.shards", base);
+    FILE* fp = fopen(path, "r");
+    if (fp == NULL) return 0;
+    if (fscanf(fp, "%d", &n) != 1 || n < 1 || n > MAX_SHARDS) n = 0;
+    fclose(fp);
+    return n;
+}
+
+static void* load_shard(void* arg) {
+    ShardLoad* s = arg;
+    char line[MAX_LINE_LEN];
+    StudentRecord rec;
+    int capacity = 0;
+    FILE* fp = fopen(s->path, "r");
+    if (fp == NULL) {
+        s->failed = SHARD_UNREADABLE;
+        return NULL;
+    }
+    trace_thread("open shard");
+    TRACE_START(t0);
+    s->strings = pool_new(); // NULL in fixed-array builds
+
+    while (fgets(line, sizeof line, fp) != NULL) {
+        if (!db_parse_row(line, &rec, s->strings)) continue; // header or malformed line
+        if (s->count == capacity) {
+            capacity = capacity ? capacity * 2 : INITIAL_RECORDS;
+            StudentRecord* grown = realloc(s->rows, (size_t)capacity * sizeof *grown);
+            if (!grown) {
+                s->failed = SHARD_NO_MEMORY;
+                break;
+            }
+            s->rows = grown;
+        }
+        s->rows[s->count++] = rec;
+    }
+    fclose(fp);
+    TRACE_STOP("open.shard", t0);
+    return NULL;
+}
+
+int shard_open(const char* base) { // returns records loaded or -1
+    ShardLoad load[MAX_SHARDS] = { 0 };
+    int onDisk = read_manifest(base);
+    int total = 0, failed = 0;
+    STATS_START(t0);
+
+    savedShards = onDisk;
+    if (onDisk == 0) { // never saved sharded: read the single file, split it at the next SAVE
+        int loaded = db_open(base);
+        if (loaded >= 0) shard_touch_all();
+        return loaded;
+    }
+
+    for (int k = 0; k < onDisk; k++) {
+        shard_path(load[k].path, sizeof load[k].path, base, k);
+        if (pthread_create(&load[k].thread, NULL, load_shard, &load[k]) != 0) {
+            load_shard(&load[k]); // no thread to spare: parse it here
+            load[k].thread = pthread_self();
+        }
+    }
+    for (int k = 0; k < onDisk; k++) {
+        if (!pthread_equal(load[k].thread, pthread_self())) pthread_join(load[k].thread, NULL);
+        if (load[k].failed > failed) failed = load[k].failed;
+        total += load[k].count;
+    }
+    if (failed == SHARD_UNREADABLE) { // the table in memory stays as it was, as when db_open cannot read the file
+        for (int k = 0; k < onDisk; k++) {
+            free(load[k].rows);
+            arena_unpin(load[k].strings); // drops a loader pool nothing else holds
+        }
+        audit_log("OPEN", NULL, NULL, "FAIL(MISSING_SHARD)");
+        return -1;
+    }
+
+    recordCount = 0;
+    index_build(records, 0);
+    arena_reset();
+    if (!failed && db_reserve(total) != 0) failed = SHARD_NO_MEMORY;
+    for (int k = 0; k < onDisk; k++) {
+        for (int i = 0; !failed && i < load[k].count; i++) {
+            db_load_row(&load[k].rows[i]); // the first row of an ID wins, as in db_open
+        }
+        free(load[k].rows);
+        arena_adopt(load[k].strings);
+    }
+    if (failed) { // never serve part of the table
+        recordCount = 0;
+        index_build(records, 0);
+    }
+    index_seal(records, recordCount);
+    snapshot_publish();
+    dirty = 0;
+    if (onDisk != shards) shard_touch_all(); // saved with another count: rewrite every shard
+
+    if (failed) {
+        audit_log("OPEN", NULL, NULL, "FAIL(NO_MEMORY)");
+        return -1;
+    }
+    STATS_STOP(STAT_IO_OPEN, t0);
+    audit_log("OPEN", NULL, NULL, "SUCCESS(SHARDED)");
+    return recordCount;
+}
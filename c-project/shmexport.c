@@ -0,0 +1,259 @@
+/*
+ *This file contains the shared-memory export (student_db --export-shm [name]).
+ *Every snapshot the command loop publishes (see snapshot.c) is also written into a
+ *POSIX shared-memory segment, so reporting jobs on the same machine look up IDs and
+ *scan marks in place with the library in shmreader.c instead of parsing the text file:
+ *  - the segment is a header, the rows and an ID index of its own; the layout is in
+ *    shmreader.h and is the same whatever the build flags
+ *  - only the snapshot chunks that changed since the last export are written; IDs
+ *    appended (INSERT) are added to the index and IDs removed (DELETE, COMMIT) taken out
+ *    of it, and it is rebuilt only when the segment grows or rows move otherwise (SORT, OPEN)
+ *  - readers are never waited for: each export happens between two increments of the
+ *    header's sequence number, and a reader that saw it change reads again
+ *Like the snapshots it holds committed rows only. With -DCMS_STRING_ARENA names and
+ *programmes longer than 39 bytes are cut short in the segment. The segment is removed
+ *when student_db exits; another student_db exporting under the same name replaces it.
+*/
+
+#define _CRT_SECURE_NO_WARNINGS
+#include "student_db.h"
+#include "shmreader.h"
+#include <stdlib.h>
+#include <string.h>
+
+static const char* exportName = NULL;
+
+void shm_export_configure(const char* name) {
+    exportName = name;
+}
+
+int shm_export_enabled(void) {
+    return exportName != NULL;
+}
+
+#if defined(__unix__) || defined(__APPLE__)
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define MIN_ROWS 1024
+
+static int segFd = -1;
+static CmsShmHeader* seg = NULL;
+static size_t segBytes = 0;
+static long long rowCapacity = 0;
+static DbSnapshot* exported = NULL; // the version in the segment, kept so shared chunks compare by address
+
+static int bits_for(long long rows) { // the index is at most half full
+    int bits = 4;
+    while (((long long)1 << bits) < rows * 2) bits++;
+    return bits;
+}
+
+static size_t bytes_for(long long rows) {
+    return sizeof(CmsShmHeader) + (size_t)rows * sizeof(CmsShmRow) + ((size_t)1 << bits_for(rows)) * sizeof(CmsShmSlot);
+}
+
+static CmsShmSlot* slots_of(void) {
+    return (CmsShmSlot*)((char*)seg + seg->slotsAt);
+}
+
+static int map_segment(size_t bytes) {
+    void* base = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, segFd, 0);
+    if (base == MAP_FAILED) return -1;
+    if (seg) munmap(seg, segBytes);
+    seg = base;
+    segBytes = bytes;
+    return 0;
+}
+
+// Makes room for count rows: the rows stay where they are, the index moves after them.
+// Readers only see the new layout once the header is rewritten in the next export.
+static int reserve(long long count) {
+    if (count <= rowCapacity) return 0;
+    long long capacity = rowCapacity;
+    while (capacity < count) capacity *= 2;
+    size_t bytes = bytes_for(capacity);
+    if (ftruncate(segFd, (off_t)bytes) != 0 || map_segment(bytes) != 0) return -1;
+    rowCapacity = capacity;
+    return 1;
+}
+
+static void copy_text(char* dst, const char* src) { // dst is zeroed, so it stays terminated
+    size_t len = strlen(src);
+    memcpy(dst, src, len < CMS_SHM_TEXT - 1 ? len : CMS_SHM_TEXT - 1);
+}
+
+static void export_row(CmsShmRow* dst, const StudentRecord* r) {
+    CmsShmRow row;
+    memset(&row, 0, sizeof row); // padding and the unused text bytes are zero
+    row.id = r->id;
+    row.mark = r->mark;
+    copy_text(row.name, r->name);
+    copy_text(row.programme, r->programme);
+    memcpy(dst, &row, sizeof row);
+}
+
+static void index_add(int id, int pos) { // the first row wins for a repeated ID
+    unsigned mask = (1u << seg->slotBits) - 1;
+    CmsShmSlot* slots = slots_of();
+    unsigned s = cms_shm_slot(id, seg->slotBits);
+    while (slots[s].pos >= 0 && slots[s].key != id) s = (s + 1) & mask;
+    if (slots[s].pos < 0) {
+        slots[s].key = id;
+        slots[s].pos = pos;
+    }
+}
+
+static CmsShmSlot* index_slot(int id) { // the slot holding id, NULL if none does
+    unsigned mask = (1u << seg->slotBits) - 1;
+    CmsShmSlot* slots = slots_of();
+    for (unsigned s = cms_shm_slot(id, seg->slotBits); slots[s].pos >= 0; s = (s + 1) & mask) {
+        if (slots[s].key == id) return &slots[s];
+    }
+    return NULL;
+}
+
+static void index_remove(int id) { // backward-shift deletion, so no probe chain is cut short
+    unsigned mask = (1u << seg->slotBits) - 1;
+    CmsShmSlot* slots = slots_of();
+    CmsShmSlot* hole = index_slot(id);
+    if (!hole) return;
+    unsigned i = (unsigned)(hole - slots);
+    for (unsigned j = (i + 1) & mask; slots[j].pos >= 0; j = (j + 1) & mask) {
+        unsigned home = cms_shm_slot(slots[j].key, seg->slotBits);
+        if (i <= j ? (i < home && home <= j) : (i < home || home <= j)) continue; // still reachable from home
+        slots[i] = slots[j];
+        i = j;
+    }
+    slots[i].key = -1;
+    slots[i].pos = -1;
+}
+
+static void build_index(const CmsShmRow* rows, int count) {
+    memset(slots_of(), 0xff, ((size_t)1 << seg->slotBits) * sizeof(CmsShmSlot)); // pos -1: empty
+    for (int i = 0; i < count; i++) index_add(rows[i].id, i);
+}
+
+// Brings the index from exported to snap when snap is exported with some rows taken out
+// (DELETE, or COMMIT of several): their IDs leave, the rows after them move up.
+// 0 done, or -1 with the index untouched when snap differs in another way.
+static int index_drop_removed(const DbSnapshot* snap, int count) {
+    int before = snapshot_count(exported);
+    int from = snapshot_next_change(exported, snap, 0); // rows before it are in both
+    int j = from;
+    for (int i = from; i < before && j < count; i++) { // is snap[from..] a subsequence of exported[from..]?
+        if (snapshot_row(exported, i)->id == snapshot_row(snap, j)->id) j++;
+    }
+    if (j < count) return -1;
+
+    j = from;
+    for (int i = from; i < before; i++) {
+        int id = snapshot_row(exported, i)->id;
+        if (j < count && id == snapshot_row(snap, j)->id) {
+            CmsShmSlot* slot = index_slot(id);
+            if (slot && slot->pos == i) slot->pos = j;
+            j++;
+        }
+        else index_remove(id);
+    }
+    return 0;
+}
+
+int shm_export_open(void) { // creates an empty segment; 0, or -1 if it cannot be created
+    if (!exportName) return -1;
+    shm_unlink(exportName); // left behind by a student_db that did not exit cleanly
+    segFd = shm_open(exportName, O_RDWR | O_CREAT | O_EXCL, 0644);
+    if (segFd < 0) return -1;
+    rowCapacity = MIN_ROWS;
+    segBytes = 0;
+    if (ftruncate(segFd, (off_t)bytes_for(rowCapacity)) != 0 || map_segment(bytes_for(rowCapacity)) != 0) {
+        shm_export_close();
+        return -1;
+    }
+    // a new segment reads as zeros: seq 0, no rows, not live yet
+    seg->version = CMS_SHM_VERSION;
+    seg->rowSize = sizeof(CmsShmRow);
+    seg->bytes = segBytes;
+    seg->rowsAt = sizeof(CmsShmHeader);
+    seg->slotsAt = seg->rowsAt + rowCapacity * (long long)sizeof(CmsShmRow);
+    seg->slotBits = bits_for(rowCapacity);
+    build_index(NULL, 0);
+    memcpy(seg->magic, CMS_SHM_MAGIC, sizeof seg->magic);
+    atomic_store_explicit(&seg->live, 1, memory_order_release);
+    shm_export_publish(); // the table as it is now, if anything is loaded yet
+    return 0;
+}
+
+// Writes the current snapshot into the segment. Runs on the command loop after every
+// snapshot_publish; when the segment cannot grow, readers keep the last version.
+void shm_export_publish(void) {
+    if (!seg) return;
+    TRACE_START(t0);
+    DbSnapshot* snap = snapshot_acquire();
+    int count = snapshot_count(snap);
+    int grown = reserve(count);
+    if (grown < 0) {
+        snapshot_release(snap);
+        return;
+    }
+
+    unsigned long long seq = atomic_load_explicit(&seg->seq, memory_order_relaxed);
+    atomic_store_explicit(&seg->seq, seq + 1, memory_order_relaxed); // odd: readers retry
+    atomic_thread_fence(memory_order_release);
+
+    CmsShmRow* rows = (CmsShmRow*)((char*)seg + seg->rowsAt);
+    for (int i = snapshot_next_change(exported, snap, 0); i < count; i = snapshot_next_change(exported, snap, i + 1)) {
+        export_row(&rows[i], snapshot_row(snap, i));
+    }
+    if (grown) {
+        seg->bytes = segBytes;
+        seg->slotsAt = seg->rowsAt + rowCapacity * (long long)sizeof(CmsShmRow);
+        seg->slotBits = bits_for(rowCapacity);
+    }
+    if (grown || !exported) build_index(rows, count);
+    else if (snapshot_ids_kept(exported, snap)) { // rows were only appended
+        for (int i = snapshot_count(exported); i < count; i++) index_add(rows[i].id, i);
+    }
+    else if (index_drop_removed(snap, count) != 0) build_index(rows, count);
+    seg->count = count;
+    seg->generation = snapshot_version(snap);
+
+    atomic_store_explicit(&seg->seq, seq + 2, memory_order_release);
+    snapshot_release(exported);
+    exported = snap;
+    TRACE_STOP("shm.export", t0);
+}
+
+void shm_export_close(void) {
+    if (seg) {
+        atomic_store_explicit(&seg->live, 0, memory_order_release); // readers still mapping it get -1
+        munmap(seg, segBytes);
+    }
+    if (segFd >= 0) {
+        close(segFd);
+        shm_unlink(exportName);
+    }
+    seg = NULL;
+    segFd = -1;
+    segBytes = 0;
+    rowCapacity = 0;
+    snapshot_release(exported);
+    exported = NULL;
+}
+
+#else
+
+int shm_export_open(void) {
+    return -1;
+}
+
+void shm_export_publish(void) {
+}
+
+void shm_export_close(void) {
+}
+
+#endif
@@ -0,0 +1,184 @@
+/*
+ *This file contains the shared-memory reader library (see shmreader.h for its use).
+ *It is linked into other programs, not into student_db:
+ *  gcc -c shmreader.c    (add -lrt when linking with glibc older than 2.34)
+ *The segment is written by one process under a sequence number (a seqlock):
+ *  - the writer makes seq odd, changes the rows and index, then makes it even again
+ *  - a reader notes an even seq, reads the rows in place and checks seq is unchanged,
+ *    otherwise it reads again; readers never block the writer or each other
+ *Every offset in the header is checked against the mapping before it is used, so a
+ *half-written header can only cost a retry. The segment only grows; a reader maps
+ *it again when the writer has grown it.
+*/
+
+#define _CRT_SECURE_NO_WARNINGS
+#define _POSIX_C_SOURCE 200809L
+#include "shmreader.h"
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__unix__) || defined(__APPLE__)
+
+#include <fcntl.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#define WRITER_TIMEOUT_NS 2000000000ull // seq odd this long: the writer died mid-change
+
+struct CmsShm {
+    int fd;
+    const CmsShmHeader* header;
+    size_t mapped;
+};
+
+static unsigned long long now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long long)ts.tv_sec * 1000000000ull + (unsigned long long)ts.tv_nsec;
+}
+
+static int map_segment(CmsShm* shm) { // (re)maps the segment at its current size
+    struct stat st;
+    if (fstat(shm->fd, &st) != 0 || (size_t)st.st_size < sizeof(CmsShmHeader)) return -1;
+    void* base = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, shm->fd, 0);
+    if (base == MAP_FAILED) return -1;
+    if (shm->header) munmap((void*)shm->header, shm->mapped);
+    shm->header = base;
+    shm->mapped = (size_t)st.st_size;
+    return 0;
+}
+
+CmsShm* cms_shm_open(const char* name) { // NULL if student_db is not exporting under name
+    CmsShm* shm = calloc(1, sizeof *shm);
+    if (!shm) return NULL;
+    shm->fd = shm_open(name ? name : CMS_SHM_NAME, O_RDONLY, 0);
+    if (shm->fd < 0 || map_segment(shm) != 0 || memcmp(shm->header->magic, CMS_SHM_MAGIC, 8) != 0 ||
+        shm->header->version != CMS_SHM_VERSION || shm->header->rowSize != sizeof(CmsShmRow)) {
+        cms_shm_close(shm);
+        return NULL;
+    }
+    return shm;
+}
+
+void cms_shm_close(CmsShm* shm) {
+    if (!shm) return;
+    if (shm->header) munmap((void*)shm->header, shm->mapped);
+    if (shm->fd >= 0) close(shm->fd);
+    free(shm);
+}
+
+// Starts a read: 0 with view set, or -1 once student_db has exited (open the segment again
+// to follow a new one). A view from an earlier begin is no longer valid after this call.
+int cms_shm_begin(CmsShm* shm, CmsShmView* view) {
+    unsigned long long deadline = 0;
+    for (unsigned spins = 1;; spins++) {
+        const CmsShmHeader* h = shm->header;
+        unsigned long long seq = atomic_load_explicit(&h->seq, memory_order_acquire);
+        if (seq & 1) { // the writer is in the middle of a change
+            if (spins % 64 == 0) {
+                if (!deadline) deadline = now_ns() + WRITER_TIMEOUT_NS;
+                else if (now_ns() > deadline) return -1;
+                sched_yield();
+            }
+            continue;
+        }
+        if (!atomic_load_explicit(&h->live, memory_order_relaxed)) return -1;
+
+        unsigned long long bytes = h->bytes;
+        long long count = h->count, rowsAt = h->rowsAt, slotsAt = h->slotsAt;
+        int bits = h->slotBits;
+        view->generation = h->generation;
+        atomic_thread_fence(memory_order_acquire);
+        if (atomic_load_explicit(&h->seq, memory_order_relaxed) != seq) continue; // the header was changing
+
+        if (bytes > shm->mapped) { // grown since it was mapped
+            if (map_segment(shm) != 0) return -1;
+            continue;
+        }
+        if (bits < 1 || bits > 30 || count < 0 || count > 0x7fffffff || rowsAt < (long long)sizeof *h || slotsAt < 0 ||
+            (unsigned long long)rowsAt + (unsigned long long)count * sizeof(CmsShmRow) > shm->mapped ||
+            (unsigned long long)slotsAt + ((unsigned long long)1 << bits) * sizeof(CmsShmSlot) > shm->mapped) {
+            return -1; // a consistent header that does not fit: not a segment this library can read
+        }
+        const char* base = (const char*)h;
+        view->seq = seq;
+        view->count = (int)count;
+        view->rows = (const CmsShmRow*)(base + rowsAt);
+        view->slots = (const CmsShmSlot*)(base + slotsAt);
+        view->slotBits = bits;
+        return 0;
+    }
+}
+
+int cms_shm_end(CmsShm* shm, const CmsShmView* view) { // 1 if nothing changed since begin
+    atomic_thread_fence(memory_order_acquire);
+    return atomic_load_explicit(&shm->header->seq, memory_order_relaxed) == view->seq;
+}
+
+// The row with id inside a view, or NULL; the pointer is into the segment (no copy)
+const CmsShmRow* cms_shm_lookup(const CmsShmView* view, int id) {
+    unsigned mask = (1u << view->slotBits) - 1;
+    unsigned i = cms_shm_slot(id, view->slotBits);
+    for (unsigned n = 0; n <= mask; n++, i = (i + 1) & mask) { // bounded, the slots may be half-written
+        int pos = view->slots[i].pos;
+        if (pos < 0) return NULL;
+        if (view->slots[i].key == id) return pos < view->count ? &view->rows[pos] : NULL;
+    }
+    return NULL;
+}
+
+// Copies the row with id into out: 1, 0 if there is none, -1 once student_db has exited
+int cms_shm_get(CmsShm* shm, int id, CmsShmRow* out) {
+    CmsShmView view;
+    const CmsShmRow* r;
+    do {
+        if (cms_shm_begin(shm, &view) != 0) return -1;
+        r = cms_shm_lookup(&view, id);
+        if (r) memcpy(out, r, sizeof *out);
+    } while (!cms_shm_end(shm, &view));
+    if (!r) return 0;
+    out->name[CMS_SHM_TEXT - 1] = '\0';
+    out->programme[CMS_SHM_TEXT - 1] = '\0';
+    return 1;
+}
+
+#else
+
+CmsShm* cms_shm_open(const char* name) {
+    (void)name;
+    return NULL;
+}
+
+void cms_shm_close(CmsShm* shm) {
+    (void)shm;
+}
+
+int cms_shm_begin(CmsShm* shm, CmsShmView* view) {
+    (void)shm;
+    (void)view;
+    return -1;
+}
+
+int cms_shm_end(CmsShm* shm, const CmsShmView* view) {
+    (void)shm;
+    (void)view;
+    return 0;
+}
+
+const CmsShmRow* cms_shm_lookup(const CmsShmView* view, int id) {
+    (void)view;
+    (void)id;
+    return NULL;
+}
+
+int cms_shm_get(CmsShm* shm, int id, CmsShmRow* out) {
+    (void)shm;
+    (void)id;
+    (void)out;
+    return -1;
+}
+
+#endif
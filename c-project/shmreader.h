@@ -0,0 +1,79 @@
+/*
+ *This is the header of the shared-memory reader library (shmreader.c).
+ *student_db --export-shm [name] publishes the table into a POSIX shared-memory
+ *segment (see shmexport.c); other local programs include this header, compile
+ *shmreader.c with their own code and read the rows in place:
+ *
+ *  CmsShm* shm = cms_shm_open("/student_db");
+ *  CmsShmView v;
+ *  double sum;
+ *  do {                                        // repeated if the table changed meanwhile
+ *      if (cms_shm_begin(shm, &v) != 0) break; // student_db has exited
+ *      sum = 0;
+ *      for (int i = 0; i < v.count; i++) sum += v.rows[i].mark;
+ *  } while (!cms_shm_end(shm, &v));
+ *
+ *Values read between cms_shm_begin and cms_shm_end may be half-written; only use
+ *them once cms_shm_end has returned 1. It does not depend on student_db.h.
+*/
+
+#ifndef SHMREADER_H
+#define SHMREADER_H
+
+#include <stdatomic.h>
+
+#define CMS_SHM_MAGIC "CMSSHM01"
+#define CMS_SHM_VERSION 1
+#define CMS_SHM_TEXT 40     // name and programme bytes, with the terminating '\0'
+#define CMS_SHM_NAME "/student_db"
+
+typedef struct { // the fixed StudentRecord layout (88 bytes)
+    int id;
+    char name[CMS_SHM_TEXT];
+    char programme[CMS_SHM_TEXT];
+    float mark;
+} CmsShmRow;
+
+typedef struct { // ID index: open addressing, linear probing from cms_shm_slot()
+    int key;
+    int pos;     // row of key, -1 for an empty slot
+} CmsShmSlot;
+
+typedef struct {
+    char magic[8];
+    unsigned int version;         // CMS_SHM_VERSION of the layout below
+    unsigned int rowSize;         // sizeof(CmsShmRow)
+    atomic_ullong seq;            // odd while student_db changes the segment
+    atomic_int live;              // 0 once student_db has exited
+    int slotBits;                 // the index has 1 << slotBits slots
+    unsigned long long bytes;     // segment size, never shrinks
+    unsigned long long generation; // snapshot version of the rows
+    long long count;              // rows
+    long long rowsAt;             // offsets from the start of the segment
+    long long slotsAt;
+    char pad[56];
+} CmsShmHeader;                   // 128 bytes
+
+typedef struct CmsShm CmsShm;
+
+typedef struct { // one consistent read, from cms_shm_begin to cms_shm_end
+    unsigned long long seq;
+    unsigned long long generation;
+    int count;
+    const CmsShmRow* rows;        // count rows, in the table's order
+    const CmsShmSlot* slots;
+    int slotBits;
+} CmsShmView;
+
+static inline unsigned cms_shm_slot(int id, int slotBits) { // first slot probed for id
+    return (unsigned)((unsigned)id * 2654435761u) >> (32 - slotBits);
+}
+
+CmsShm* cms_shm_open(const char* name);
+void cms_shm_close(CmsShm* shm);
+int  cms_shm_begin(CmsShm* shm, CmsShmView* view);
+int  cms_shm_end(CmsShm* shm, const CmsShmView* view);
+const CmsShmRow* cms_shm_lookup(const CmsShmView* view, int id);
+int  cms_shm_get(CmsShm* shm, int id, CmsShmRow* out);
+
+#endif
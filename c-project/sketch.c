@@ -0,0 +1,347 @@
+/*
+ *This file contains the approximate statistics behind SUMMARY APPROX.
+ *The exact SUMMARY reads every row. These sketches are kept up to date by the
+ *changes themselves and use about 90 KB however large the table gets:
+ *  - mark quantiles: a KLL sketch (KLL_K). A reported quantile is within about
+ *    1.7% of the rows in rank, 99 times in 100. So the "median" ranks between
+ *    48.3% and 51.7% of the marks.
+ *  - distinct names and programmes: HyperLogLog, 2^HLL_BITS registers each.
+ *    The standard error is 1.04 / sqrt(4096) = 1.6%.
+ *  - top programmes: Count-Min (CM_DEPTH x CM_WIDTH counters) plus TOP_TRACK
+ *    candidates. A count is never low, and is too high by more than
+ *    e / CM_WIDTH = 0.27% of the rows at most 1.8% of the time.
+ *The row count and average are exact (a count and a running sum).
+ *
+ *The sketches are built from the table by the first SUMMARY APPROX, not at start-up.
+ *After that, audit_log() hands them every INSERT, UPDATE and DELETE, as it does for
+ *replicas. KLL and HyperLogLog cannot forget a value, so a delete or overwritten value
+ *stays in them as stale. The next SUMMARY APPROX rebuilds them with one pass over the
+ *table once the stale values exceed 1/STALE_SHARE of the rows (3.1%). Until then each
+ *stale row can move a quantile's rank by one more row and add at most one distinct
+ *name and programme, so the bounds above widen by the stale share, which SUMMARY
+ *APPROX prints with them. It also rebuilds after
+ *OPEN, a reloading REFRESH, ROLLBACK or a fresh copy from the primary. Inside a
+ *transaction they include its uncommitted changes.
+*/
+
+#define _CRT_SECURE_NO_WARNINGS
+#include "student_db.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define KLL_K 200           // the top compactor's size; rank error ~ 1.7% at 99% confidence
+#define KLL_LEVELS 40       // values of weight up to 2^39, more than any table holds
+#define KLL_ROOM (2 * KLL_K + 4) // a level's items between compactions
+#define HLL_BITS 12
+#define HLL_SIZE (1 << HLL_BITS)
+#define CM_DEPTH 4
+#define CM_WIDTH 1024
+#define TOP_TRACK 16        // programmes followed as top candidates
+#define STALE_SHARE 32
+
+typedef struct {
+    float items[KLL_LEVELS][KLL_ROOM]; // level h holds values of weight 2^h
+    int len[KLL_LEVELS];
+    int levels;
+    unsigned long long random;  // picks which half a compaction keeps
+} Kll;
+
+typedef struct {
+    unsigned char reg[HLL_SIZE];
+} Hll;
+
+typedef struct {
+    char programme[MAX_TEXT_LEN + 1];
+    long long rows; // Count-Min estimate when it was last seen
+} TopEntry;
+
+typedef struct {
+    Kll marks;
+    Hll names;
+    Hll programmes;
+    int counts[CM_DEPTH][CM_WIDTH];
+    TopEntry top[TOP_TRACK];
+    int topCount;
+    long long rows;
+    double markSum;
+    long long stale;   // deleted or overwritten values still inside marks, names or programmes
+    int valid;
+} Sketches;
+
+static Sketches* sk = NULL; // allocated by the first SUMMARY APPROX
+
+static unsigned long long text_hash(const char* s) { // FNV-1a, then a 64-bit finalizer so every bit mixes
+    unsigned long long h = 0xcbf29ce484222325ull;
+    for (; *s; s++) h = (h ^ (unsigned char)*s) * 0x100000001b3ull;
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdull;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ull;
+    return h ^ (h >> 33);
+}
+
+static int cmp_float(const void* a, const void* b) {
+    float x = *(const float*)a, y = *(const float*)b;
+    return (x > y) - (x < y);
+}
+
+// KLL (Karnin, Lang, Liberty): each level is a buffer. When one fills, it is sorted
+// and every other value moves up a level with twice the weight. Capacities shrink by
+// 2/3 per level below the top, so the sketch holds about 3 * KLL_K values.
+static int kll_capacity(const Kll* s, int h) {
+    double cap = KLL_K;
+    for (int d = s->levels - 1 - h; d > 0; d--) cap *= 2.0 / 3.0;
+    return cap < 2 ? 2 : (int)cap + 1;
+}
+
+static void kll_compact(Kll* s, int h) { // half of level h goes to h + 1
+    float* v = s->items[h];
+    int n = s->len[h];
+    qsort(v, (size_t)n, sizeof *v, cmp_float);
+    s->random ^= s->random << 13;
+    s->random ^= s->random >> 7;
+    s->random ^= s->random << 17;
+    int keep = n % 2; // an odd value out stays here
+    int offset = (int)(s->random & 1);
+    for (int i = keep + offset; i < n; i += 2) s->items[h + 1][s->len[h + 1]++] = v[i];
+    s->len[h] = keep;
+}
+
+static void kll_add(Kll* s, float v) {
+    s->items[0][s->len[0]++] = v;
+    for (int h = 0; h < s->levels; h++) {
+        if (s->len[h] < kll_capacity(s, h)) continue;
+        if (h + 1 == s->levels) {
+            if (s->levels == KLL_LEVELS) { // never reached by a real table: drop the newest instead
+                s->len[h]--;
+                return;
+            }
+            s->levels++;
+        }
+        kll_compact(s, h);
+    }
+}
+
+typedef struct {
+    float value;
+    long long weight;
+} Weighted;
+
+static int cmp_weighted(const void* a, const void* b) {
+    return cmp_float(&((const Weighted*)a)->value, &((const Weighted*)b)->value);
+}
+
+static void kll_quantiles(const Kll* s, const double* q, int nq, float* out) { // q ascending
+    int n = 0;
+    long long total = 0;
+    for (int h = 0; h < s->levels; h++) n += s->len[h];
+    Weighted* all = malloc((size_t)(n ? n : 1) * sizeof *all);
+    if (!all) {
+        for (int i = 0; i < nq; i++) out[i] = 0;
+        return;
+    }
+    n = 0;
+    for (int h = 0; h < s->levels; h++) {
+        for (int i = 0; i < s->len[h]; i++) {
+            all[n].value = s->items[h][i];
+            all[n++].weight = 1ll << h;
+            total += 1ll << h;
+        }
+    }
+    qsort(all, (size_t)n, sizeof *all, cmp_weighted);
+    long long seen = 0;
+    int j = 0;
+    for (int i = 0; i < nq; i++) {
+        while (j < n - 1 && seen + all[j].weight <= q[i] * (double)total) seen += all[j++].weight;
+        out[i] = n ? all[j].value : 0;
+    }
+    free(all);
+}
+
+// HyperLogLog (Flajolet et al.): the first HLL_BITS bits of the hash pick a register,
+// which keeps the longest run of leading zeros seen in the rest
+static void hll_add(Hll* s, unsigned long long h) { // h = text_hash() of the value
+    unsigned long long rest = h << HLL_BITS;
+    unsigned char rank = 1;
+    while (rank <= 64 - HLL_BITS && !(rest & (1ull << 63))) {
+        rank++;
+        rest <<= 1;
+    }
+    unsigned char* r = &s->reg[h >> (64 - HLL_BITS)];
+    if (rank > *r) *r = rank;
+}
+
+static double ln(double x) { // natural log for x >= 1, so the build needs no -lm
+    int halvings = 0;
+    while (x >= 2) {
+        x /= 2;
+        halvings++;
+    }
+    double y = (x - 1) / (x + 1), y2 = y * y, term = y, sum = 0; // ln x = 2 atanh y
+    for (int k = 1; k < 40; k += 2) {
+        sum += term / k;
+        term *= y2;
+    }
+    return 2 * sum + halvings * 0.69314718055994531;
+}
+
+static long long hll_estimate(const Hll* s) {
+    double m = HLL_SIZE, sum = 0;
+    int zeros = 0;
+    for (int i = 0; i < HLL_SIZE; i++) {
+        sum += 1.0 / (double)(1ull << s->reg[i]);
+        zeros += s->reg[i] == 0;
+    }
+    double e = 0.7213 / (1 + 1.079 / m) * m * m / sum;
+    if (e <= 2.5 * m && zeros > 0) e = m * ln(m / zeros); // few values: count the empty registers instead
+    return (long long)(e + 0.5);
+}
+
+// Count-Min (Cormode, Muthukrishnan): CM_DEPTH rows of counters, one per hash; the
+// smallest of a programme's counters is its estimate
+static long long cm_add(unsigned long long h, int delta) { // h = text_hash() of the programme, returns its new estimate
+    unsigned h1 = (unsigned)h, h2 = (unsigned)(h >> 32) | 1;
+    long long least = -1;
+    for (int d = 0; d < CM_DEPTH; d++) {
+        int* c = &sk->counts[d][(h1 + (unsigned)d * h2) % CM_WIDTH];
+        *c += delta;
+        if (least < 0 || *c < least) least = *c;
+    }
+    return least;
+}
+
+static void top_seen(const char* programme, long long rows) { // keep the TOP_TRACK largest estimates
+    int least = 0;
+    for (int i = 0; i < sk->topCount; i++) {
+        if (strcmp(sk->top[i].programme, programme) == 0) {
+            sk->top[i].rows = rows;
+            return;
+        }
+        if (sk->top[i].rows < sk->top[least].rows) least = i;
+    }
+    if (sk->topCount < TOP_TRACK) least = sk->topCount++;
+    else if (rows <= sk->top[least].rows) return;
+    snprintf(sk->top[least].programme, sizeof sk->top[least].programme, "%s", programme);
+    sk->top[least].rows = rows;
+}
+
+static void add_row(const StudentRecord* r) {
+    kll_add(&sk->marks, r->mark);
+    unsigned long long h = text_hash(r->programme);
+    hll_add(&sk->names, text_hash(r->name));
+    hll_add(&sk->programmes, h);
+    top_seen(r->programme, cm_add(h, 1));
+    sk->rows++;
+    sk->markSum += r->mark;
+}
+
+static void remove_row(const StudentRecord* r) { // Count-Min and the sum can subtract, the rest goes stale
+    top_seen(r->programme, cm_add(text_hash(r->programme), -1));
+    sk->rows--;
+    sk->markSum -= r->mark;
+    sk->stale++;
+}
+
+static void rebuild(void) { // from the command thread's table, so it matches what the changes report
+    lazy_fetch_all(); // names are needed
+    memset(sk, 0, sizeof *sk);
+    sk->marks.levels = 1;
+    sk->marks.random = 88172645463325252ull;
+    for (int i = 0; i < recordCount; i++) {
+        if (!txn_row_deleted(i)) add_row(&records[i]);
+    }
+    sk->valid = 1;
+}
+
+void sketch_reset(void) { // the whole table was replaced
+    if (sk) sk->valid = 0;
+}
+
+void sketch_record(const char* op, const StudentRecord* before, const StudentRecord* after, const char* status) {
+    if (!sk || !sk->valid) return;
+    if (strcmp(op, "OPEN") == 0 || strcmp(op, "ROLLBACK") == 0 ||
+        (strcmp(op, "REFRESH") == 0 && strcmp(status, "SUCCESS") != 0)) { // anything but appended rows
+        sk->valid = 0;
+        return;
+    }
+    if (strcmp(status, "SUCCESS") != 0) return;
+    if (strcmp(op, "INSERT") == 0 && after) {
+        add_row(after);
+    }
+    else if (strcmp(op, "DELETE") == 0 && before) {
+        remove_row(before);
+    }
+    else if (strcmp(op, "UPDATE") == 0 && before && after) {
+        remove_row(before);
+        add_row(after);
+    }
+}
+
+// 0, or -1 when the table is empty or the sketches cannot be allocated
+int db_summary_approx(ApproxSummary* out) {
+    static const double q[APPROX_QUANTILES] = { 0.10, 0.25, 0.50, 0.75, 0.90 };
+    if (!sk) sk = calloc(1, sizeof *sk);
+    if (!sk) return -1;
+    if (!sk->valid || sk->stale * STALE_SHARE > sk->rows) rebuild();
+    if (sk->rows <= 0) return -1;
+
+    memset(out, 0, sizeof *out);
+    out->count = sk->rows;
+    out->average = sk->markSum / (double)sk->rows;
+    kll_quantiles(&sk->marks, q, APPROX_QUANTILES, out->quantiles);
+    out->distinctNames = hll_estimate(&sk->names);
+    out->distinctProgrammes = hll_estimate(&sk->programmes);
+
+    TopEntry top[TOP_TRACK];
+    int n = 0;
+    for (int i = 0; i < sk->topCount; i++) { // fresh estimates, largest first
+        top[n] = sk->top[i];
+        top[n].rows = cm_add(text_hash(top[n].programme), 0);
+        if (top[n].rows <= 0) continue;
+        int j = n++;
+        while (j > 0 && top[j - 1].rows < top[j].rows) {
+            TopEntry t = top[j];
+            top[j] = top[j - 1];
+            top[j - 1] = t;
+            j--;
+        }
+    }
+    for (int i = 0; i < n && i < APPROX_TOP; i++) {
+        memcpy(out->topProgramme[i], top[i].programme, sizeof out->topProgramme[i]);
+        out->topRows[i] = top[i].rows;
+    }
+    out->topCount = n < APPROX_TOP ? n : APPROX_TOP;
+    out->stale = sk->stale;
+    out->bytes = sizeof *sk;
+    return 0;
+}
+
+void showSummaryApprox(void) {
+    ApproxSummary st;
+
+    if (recordCount == 0 && !repl_is_follower()) {
+        printf("No records loaded. Opening database...\n");
+        openDatabase();
+    }
+    if (db_summary_approx(&st) != 0) {
+        printf("Still no records found.\n");
+        return;
+    }
+
+    printf("\n=== Approximate Summary ===\n");
+    printf("Total students: %lld\n", st.count);
+    printf("Average mark: %.2f\n", st.average);
+    double staleShare = 100.0 * (double)st.stale / (double)st.count; // deleted or overwritten values still counted
+    printf("Mark percentiles (rank within ~%.1f%%): 10th %.1f, 25th %.1f, median %.1f, 75th %.1f, 90th %.1f\n",
+        1.7 + staleShare, st.quantiles[0], st.quantiles[1], st.quantiles[2], st.quantiles[3], st.quantiles[4]);
+    printf("Distinct names: ~%lld (+/- 1.6%%, and up to %lld too many from stale values)\n", st.distinctNames, st.stale);
+    printf("Distinct programmes: ~%lld (+/- 1.6%%, and up to %lld too many from stale values)\n", st.distinctProgrammes, st.stale);
+    printf("Top programmes (never under, at most ~%lld over):\n", st.count * 27 / 10000 + 1);
+    for (int i = 0; i < st.topCount; i++) {
+        printf("  %-24s ~%lld\n", st.topProgramme[i], st.topRows[i]);
+    }
+    printf("Sketch memory: %.1f KB, %lld stale value(s) since the last rebuild (%.1f%% of the rows, rebuilt past %.1f%%)\n",
+        st.bytes / 1024.0, st.stale, staleShare, 100.0 / STALE_SHARE);
+
+    audit_log("SUMMARY", NULL, NULL, "SUCCESS(APPROX)");
+}
@@ -0,0 +1,340 @@
+/*
+ *This file contains the snapshot functionality.
+ *Readers (QUERY, SUMMARY) work on an immutable, reference-counted version of
+ *the table and its index, so they can run on other threads while the command
+ *loop keeps mutating records[]. After every mutation the writer publishes the
+ *next version copy-on-write: unchanged chunks of rows and an unchanged index
+ *are shared with the previous version instead of being copied.
+ *INSERT and UPDATE say which row they changed (snapshot_publish_rows), so only that
+ *row's chunk is looked at and copied. Rows appended since the index was last cloned
+ *go to a small "recent" table of their own, copied on each append; once it would
+ *hold more than about sqrt(rows) keys, the next version clones the full index again.
+ *So an INSERT costs O(sqrt(rows)) amortised instead of a copy of the whole index.
+ *A reader takes its reference through a hazard slot of its own thread: it writes
+ *the version it is about to pin there and checks it is still current. Before the
+ *writer drops the previous version it waits only for slots that still show that
+ *version, so readers that started after the publish never hold it up.
+*/
+
+
+#include "student_db.h"
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define SNAP_CHUNK 64 // rows per copy-on-write chunk
+#define RECENT_MIN 64 // appended keys kept apart from the index before sqrt(rows) is the limit
+#define HAZARD_SLOTS 64 // reader threads with a slot of their own, the rest share overflow
+
+typedef struct {
+    atomic_int refs;
+    int count;
+    StudentRecord rows[SNAP_CHUNK];
+} SnapChunk;
+
+typedef struct {
+    atomic_int refs;
+    IdIndex index;
+    StaticIndex* layout; // INDEX STATIC: the Eytzinger layout, and index holds only rows added since
+    int rows;            // rows the index covers, from the start; the ones after are in the recent table
+} SnapIndex;
+
+struct DbSnapshot {
+    atomic_int refs;
+    unsigned long version;
+    int count;
+    int nchunks;
+    SnapChunk** chunks;
+    SnapIndex* index;
+    SnapIndex* recent; // rows index->rows .. count-1, NULL when there are none
+    void* strings;   // arena generation the rows point into (arena.c), NULL with fixed arrays
+};
+
+static _Atomic(DbSnapshot*) current = NULL;
+static _Atomic(DbSnapshot*) hazards[HAZARD_SLOTS]; // the version a reader is pinning, NULL when none
+static atomic_int slotTaken[HAZARD_SLOTS];
+static atomic_int overflow = 0; // readers without a slot between loading current and taking a reference
+static pthread_key_t slotKey;
+static pthread_once_t slotOnce = PTHREAD_ONCE_INIT;
+static _Thread_local int mySlot = -1; // -1: not claimed yet, HAZARD_SLOTS: none was free
+
+static void free_slot(void* slot) { // thread exit, so short-lived save threads give theirs back
+    atomic_store((atomic_int*)slot, 0);
+}
+
+static void make_slot_key(void) {
+    pthread_key_create(&slotKey, free_slot);
+}
+
+static int claim_slot(void) {
+    pthread_once(&slotOnce, make_slot_key);
+    for (int i = 0; i < HAZARD_SLOTS; i++) {
+        int expected = 0;
+        if (atomic_compare_exchange_strong(&slotTaken[i], &expected, 1)) {
+            pthread_setspecific(slotKey, (void*)&slotTaken[i]);
+            return i;
+        }
+    }
+    return HAZARD_SLOTS;
+}
+
+static void wait_for_readers(const DbSnapshot* prev) { // readers that may have loaded prev but not pinned it
+    for (int i = 0; i < HAZARD_SLOTS; i++) {
+        while (atomic_load(&hazards[i]) == prev) sched_yield(); // the reader is a few instructions from done
+    }
+    while (atomic_load(&overflow) != 0) sched_yield();
+}
+
+static void chunk_release(SnapChunk* c) {
+    if (atomic_fetch_sub(&c->refs, 1) == 1) free(c);
+}
+
+static void index_release(SnapIndex* x) {
+    if (atomic_fetch_sub(&x->refs, 1) == 1) {
+        idindex_free(&x->index);
+        static_index_release(x->layout);
+        free(x);
+    }
+}
+
+static int same_ids(const StudentRecord* a, const StudentRecord* b, int n) {
+    for (int i = 0; i < n; i++) {
+        if (a[i].id != b[i].id) return 0;
+    }
+    return 1;
+}
+
+static SnapIndex* index_new(void) { // a clone of the command loop's index, NULL if out of memory
+    SnapIndex* x = calloc(1, sizeof *x);
+    if (!x) return NULL;
+    atomic_init(&x->refs, 1);
+    x->rows = recordCount;
+    x->layout = index_static_share();
+    if (index_clone(&x->index) != 0) { // the command loop keeps its index in step with records[]
+        static_index_release(x->layout);
+        x->layout = NULL;
+        idindex_build(&x->index, records, recordCount);
+    }
+    return x;
+}
+
+static SnapIndex* recent_with(const SnapIndex* old, int from, int count) { // old plus records[from..count-1]
+    SnapIndex* x = calloc(1, sizeof *x);
+    if (!x) return NULL;
+    atomic_init(&x->refs, 1);
+    if (old && idindex_copy(&x->index, &old->index) != 0) {
+        free(x);
+        return NULL;
+    }
+    for (int i = from; i < count; i++) {
+        if (records[i].id != 0) idindex_put(&x->index, records[i].id, i); // 0 is found by the scan, as ever
+    }
+    if (x->index.dropped) {
+        idindex_free(&x->index);
+        free(x);
+        return NULL;
+    }
+    return x;
+}
+
+static int recent_fits(int keys, int rows) {
+    return keys <= RECENT_MIN || (long long)keys * keys <= rows;
+}
+
+void snapshot_publish(void) {
+    snapshot_publish_rows(0, recordCount - 1);
+}
+
+// Publishes records[] as the next version, where only rows first..last may differ from the
+// current one: the rest are the same rows at the same positions. Rows appended or removed
+// at the end must be inside the range. snapshot_publish() passes the whole table.
+void snapshot_publish_rows(int first, int last) {
+    TRACE_START(t0);
+    DbSnapshot* prev = atomic_load(&current); // only the writer swaps current
+    DbSnapshot* next = calloc(1, sizeof *next);
+    if (!next) return;
+
+    next->nchunks = (recordCount + SNAP_CHUNK - 1) / SNAP_CHUNK;
+    next->chunks = calloc(next->nchunks ? next->nchunks : 1, sizeof *next->chunks);
+    if (!next->chunks) {
+        free(next);
+        return;
+    }
+    atomic_init(&next->refs, 1); // the reference held by current
+    next->strings = arena_pin();
+    next->version = prev ? prev->version + 1 : 1;
+    next->count = recordCount;
+
+    int moved = !prev || recordCount < prev->count; // an id left the position the index has for it
+    for (int c = 0; c < next->nchunks; c++) {
+        const StudentRecord* src = &records[c * SNAP_CHUNK];
+        int n = recordCount - c * SNAP_CHUNK;
+        if (n > SNAP_CHUNK) n = SNAP_CHUNK;
+        int dirty = c * SNAP_CHUNK <= last && c * SNAP_CHUNK + n > first;
+
+        SnapChunk* old = (prev && c < prev->nchunks) ? prev->chunks[c] : NULL;
+        if (old && old->count == n && (!dirty || memcmp(old->rows, src, (size_t)n * sizeof *src) == 0)) {
+            atomic_fetch_add(&old->refs, 1);
+            next->chunks[c] = old;
+            continue;
+        }
+        if (old && !same_ids(old->rows, src, old->count < n ? old->count : n)) moved = 1;
+
+        SnapChunk* copy = malloc(sizeof *copy);
+        if (!copy) {
+            next->nchunks = c;
+            snapshot_release(next);
+            return;
+        }
+        atomic_init(&copy->refs, 1);
+        copy->count = n;
+        memcpy(copy->rows, src, (size_t)n * sizeof *src);
+        next->chunks[c] = copy;
+    }
+
+    StaticIndex* layout = index_static_share();
+    int keep = !moved && prev->index && prev->index->layout == layout; // positions in prev's index are still valid
+    static_index_release(layout);
+    int recentKeys = keep ? recordCount - prev->index->rows : 0;
+    if (keep && (recordCount == prev->count || recent_fits(recentKeys, recordCount))) {
+        atomic_fetch_add(&prev->index->refs, 1);
+        next->index = prev->index;
+        if (recordCount == prev->count) { // nothing appended
+            next->recent = prev->recent;
+            if (next->recent) atomic_fetch_add(&next->recent->refs, 1);
+        }
+        else if (!(next->recent = recent_with(prev->recent, prev->count, recordCount))) {
+            index_release(next->index);
+            next->index = index_new();
+        }
+    }
+    else next->index = index_new();
+
+    atomic_store(&current, next);
+    if (prev) {
+        wait_for_readers(prev);
+        snapshot_release(prev);
+    }
+    TRACE_STOP("snapshot.publish", t0);
+    shm_export_publish(); // other processes see the same version (shmexport.c)
+}
+
+DbSnapshot* snapshot_acquire(void) {
+    if (mySlot < 0) mySlot = claim_slot();
+    DbSnapshot* snap;
+    if (mySlot == HAZARD_SLOTS) {
+        atomic_fetch_add(&overflow, 1);
+        snap = atomic_load(&current);
+        if (snap) atomic_fetch_add(&snap->refs, 1);
+        atomic_fetch_sub(&overflow, 1);
+        return snap;
+    }
+    do { // once the slot shows a version that is still current, the writer cannot drop it under us
+        snap = atomic_load(&current);
+        atomic_store(&hazards[mySlot], snap);
+    } while (atomic_load(&current) != snap);
+    if (snap) atomic_fetch_add(&snap->refs, 1);
+    atomic_store(&hazards[mySlot], NULL);
+    return snap;
+}
+
+void snapshot_release(DbSnapshot* snap) {
+    if (!snap) return;
+    if (atomic_fetch_sub(&snap->refs, 1) != 1) return;
+    for (int c = 0; c < snap->nchunks; c++) chunk_release(snap->chunks[c]);
+    if (snap->index) index_release(snap->index);
+    if (snap->recent) index_release(snap->recent);
+    arena_unpin(snap->strings);
+    free(snap->chunks);
+    free(snap);
+}
+
+int snapshot_count(const DbSnapshot* snap) {
+    return snap ? snap->count : 0;
+}
+
+unsigned long snapshot_version(const DbSnapshot* snap) {
+    return snap ? snap->version : 0;
+}
+
+const StudentRecord* snapshot_row(const DbSnapshot* snap, int i) {
+    if (!snap || i < 0 || i >= snap->count) return NULL;
+    return &snap->chunks[i / SNAP_CHUNK]->rows[i % SNAP_CHUNK];
+}
+
+static int find_rest(const DbSnapshot* snap, int id, int* pos) { // the places other than the hash index
+    return static_index_get(snap->index->layout, id, pos) || (snap->recent && idindex_get(&snap->recent->index, id, pos));
+}
+
+const StudentRecord* snapshot_find(const DbSnapshot* snap, int id) {
+    int pos;
+    if (!snap) return NULL;
+    if (snap->index && (idindex_get(&snap->index->index, id, &pos) || find_rest(snap, id, &pos))) {
+        return snapshot_row(snap, pos);
+    }
+    if (snap->index && id != 0) return NULL; // the index holds every other id
+    for (int i = 0; i < snap->count; i++) { // ids the index cannot hold (0), or no index at all
+        const StudentRecord* r = snapshot_row(snap, i);
+        if (r->id == id) return r;
+    }
+    return NULL;
+}
+
+// The first row at or after from that may differ from prev: rows in chunks the two versions
+// share are skipped, so a caller copying changes visits only the chunks that were copied.
+int snapshot_next_change(const DbSnapshot* prev, const DbSnapshot* snap, int from) {
+    if (!snap) return 0;
+    for (int c = from / SNAP_CHUNK; c < snap->nchunks; c++) {
+        if (!prev || c >= prev->nchunks || prev->chunks[c] != snap->chunks[c]) {
+            return from > c * SNAP_CHUNK ? from : c * SNAP_CHUNK;
+        }
+    }
+    return snap->count;
+}
+
+// A hash index of every row into out, positions matching snapshot_row(): 0, or -1 if snap has
+// none, its IDs are in the static layout (INDEX STATIC), or out of memory
+int snapshot_index_copy(const DbSnapshot* snap, IdIndex* out) {
+    if (!snap || !snap->index || snap->index->layout || idindex_copy(out, &snap->index->index) != 0) return -1;
+    for (int i = snap->index->rows; i < snap->count; i++) {
+        int id = snapshot_row(snap, i)->id;
+        if (id != 0) idindex_put(out, id, i);
+    }
+    return out->dropped ? -1 : 0;
+}
+
+// 1 when every row of a still has its ID in b, at the same position; b may have more rows
+// after them. Versions share an index only while rows are appended or changed in place.
+int snapshot_ids_kept(const DbSnapshot* a, const DbSnapshot* b) {
+    return a && b && a->index && a->index == b->index;
+}
+
+// Batch form of snapshot_find: out[i] is the row for ids[i] or NULL, in input order.
+// Positions come from idindex_get_batch (then the static layout and the recent table
+// for the IDs the hash table does not hold); each row found is prefetched so the
+// caller's pass over out[] does not stall on them one by one. Returns rows found.
+#define FIND_WINDOW 256
+
+int snapshot_find_batch(const DbSnapshot* snap, const int* ids, int n, const StudentRecord** out) {
+    int pos[FIND_WINDOW];
+    int found = 0;
+
+    for (int start = 0; start < n; start += FIND_WINDOW) {
+        int m = n - start < FIND_WINDOW ? n - start : FIND_WINDOW;
+        if (snap && snap->index) idindex_get_batch(&snap->index->index, ids + start, m, pos);
+        for (int k = 0; k < m; k++) {
+            const StudentRecord* r;
+            if (!snap || !snap->index || ids[start + k] == 0) r = snapshot_find(snap, ids[start + k]);
+            else if (pos[k] >= 0 || find_rest(snap, ids[start + k], &pos[k])) r = snapshot_row(snap, pos[k]);
+            else r = NULL;
+            if (r) {
+                CMS_PREFETCH(r);
+                found++;
+            }
+            out[start + k] = r;
+        }
+    }
+    return found;
+}
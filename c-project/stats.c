@@ -0,0 +1,149 @@
+/*
+ *This file contains the operation statistics (STATS command).
+ *Every command dispatch and the file I/O paths record their latency into a
+ *log-linear histogram (16 sub-buckets per power of two, about 6% precision), so
+ *percentiles cost a fixed 6 KB per operation no matter how many calls are made.
+ *Build with -DCMS_NO_STATS to compile the timing calls out entirely.
+*/
+
+#define _CRT_SECURE_NO_WARNINGS
+#include "student_db.h"
+
+#ifndef CMS_NO_STATS
+
+#define SUB_BITS 4
+#define SUB_COUNT (1 << SUB_BITS)
+#define MAX_MSB 47                                            // ~39 hours in ns
+#define N_BUCKETS (SUB_COUNT + (MAX_MSB - SUB_BITS + 1) * SUB_COUNT)
+
+typedef struct {
+    unsigned long long count;
+    unsigned long long total;
+    unsigned long long min;
+    unsigned long long max;
+    unsigned long long buckets[N_BUCKETS];
+} Histogram;
+
+static const char* statNames[STAT_COUNT] = {
+    "OPEN", "SHOWALL", "INSERT", "QUERY", "UPDATE", "DELETE", "SAVE", "SORT", "SUMMARY", "JOIN",
+    "io.open", "io.save", "io.audit", "repl.lag"
+};
+
+static Histogram hist[STAT_COUNT];
+
+static int msb_of(unsigned long long v) {
+#if defined(__GNUC__)
+    return 63 - __builtin_clzll(v);
+#else
+    int m = 0;
+    while (v >>= 1) m++;
+    return m;
+#endif
+}
+
+static int bucket_of(unsigned long long ns) {
+    if (ns < SUB_COUNT) return (int)ns; // exact below 16 ns
+    int m = msb_of(ns);
+    if (m > MAX_MSB) return N_BUCKETS - 1;
+    return SUB_COUNT + (m - SUB_BITS) * SUB_COUNT + (int)((ns >> (m - SUB_BITS)) - SUB_COUNT);
+}
+
+static unsigned long long bucket_high(int b) { // largest value that lands in bucket b
+    if (b < SUB_COUNT) return (unsigned long long)b;
+    int m = (b - SUB_COUNT) / SUB_COUNT + SUB_BITS;
+    unsigned long long sub = (unsigned long long)((b - SUB_COUNT) % SUB_COUNT + SUB_COUNT);
+    return ((sub + 1) << (m - SUB_BITS)) - 1;
+}
+
+static unsigned long long percentile(const Histogram* h, double p) {
+    unsigned long long rank = (unsigned long long)(p * (double)h->count + 0.5);
+    unsigned long long seen = 0;
+    if (rank < 1) rank = 1;
+    for (int b = 0; b < N_BUCKETS; b++) {
+        seen += h->buckets[b];
+        if (seen >= rank) {
+            unsigned long long v = bucket_high(b);
+            return v < h->max ? v : h->max;
+        }
+    }
+    return h->max;
+}
+
+void stats_record(StatId id, unsigned long long ns) {
+    Histogram* h = &hist[id];
+    if (h->count == 0 || ns < h->min) h->min = ns;
+    if (ns > h->max) h->max = ns;
+    h->count++;
+    h->total += ns;
+    h->buckets[bucket_of(ns)]++;
+}
+
+void stats_show(void) {
+    printf("\n=== Operation Statistics (microseconds) ===\n");
+    printf("%-10s %10s %10s %10s %10s %10s %10s\n", "Operation", "Count", "Mean", "p50", "p90", "p99", "Max");
+    for (int i = 0; i < STAT_COUNT; i++) {
+        const Histogram* h = &hist[i];
+        if (h->count == 0) continue;
+        printf("%-10s %10llu %10.1f %10.1f %10.1f %10.1f %10.1f\n", statNames[i], h->count,
+            (double)h->total / (double)h->count / 1000.0,
+            percentile(h, 0.50) / 1000.0, percentile(h, 0.90) / 1000.0,
+            percentile(h, 0.99) / 1000.0, h->max / 1000.0);
+    }
+    printf("(INSERT, QUERY, UPDATE, DELETE and SORT time the operation, not the prompts before it)\n");
+}
+
+int stats_get(StatId id, StatSummary* out) { // 0 when nothing was recorded
+    const Histogram* h = &hist[id];
+    if (h->count == 0) return 0;
+    out->name = statNames[id];
+    out->count = h->count;
+    out->meanNs = h->total / h->count;
+    out->p50Ns = percentile(h, 0.50);
+    out->p99Ns = percentile(h, 0.99);
+    out->maxNs = h->max;
+    return 1;
+}
+
+int stats_dump_json(const char* path) {
+    FILE* fp = fopen(path, "w");
+    int first = 1;
+    if (fp == NULL) return -1;
+
+    fprintf(fp, "{\"stats\":[");
+    for (int i = 0; i < STAT_COUNT; i++) {
+        const Histogram* h = &hist[i];
+        if (h->count == 0) continue;
+        fprintf(fp, "%s\n  {\"name\":\"%s\",\"count\":%llu,\"mean_ns\":%.1f,\"min_ns\":%llu,"
+            "\"p50_ns\":%llu,\"p90_ns\":%llu,\"p99_ns\":%llu,\"p999_ns\":%llu,\"max_ns\":%llu}",
+            first ? "" : ",", statNames[i], h->count, (double)h->total / (double)h->count, h->min,
+            percentile(h, 0.50), percentile(h, 0.90), percentile(h, 0.99), percentile(h, 0.999), h->max);
+        first = 0;
+    }
+    fprintf(fp, "\n]}\n");
+    fclose(fp);
+    return 0;
+}
+
+#else
+
+void stats_record(StatId id, unsigned long long ns) {
+    (void)id;
+    (void)ns;
+}
+
+void stats_show(void) {
+    printf("Statistics were compiled out (built with CMS_NO_STATS).\n");
+}
+
+int stats_get(StatId id, StatSummary* out) {
+    (void)id;
+    (void)out;
+    return 0;
+}
+
+int stats_dump_json(const char* path) {
+    (void)path;
+    return 0;
+}
+
+#endif
@@ -7,37 +7,385 @@
 #define STUDENT_DB_H
 
 #include <stdio.h>
+#include <stdatomic.h>
 
-#define MAX_RECORDS 100
-#define MAX_NAME_LEN 40
+#define INITIAL_RECORDS 100 // records[] grows beyond this on demand
+#define MAX_SHARDS 64       // --shards N, one dirty bit each
+#define MAX_SORT_KEYS 4     // columns in one SORT BY
+#define APPROX_QUANTILES 5  // mark percentiles of SUMMARY APPROX: 10, 25, 50, 75, 90
+#define APPROX_TOP 5        // programmes listed by SUMMARY APPROX
+#define PROBE_BUCKETS 8     // INDEX STATS histogram: 1, 2, 3-4, 5-8, ... 65+ probes
+#define MAX_TABLES 8        // tables ATTACH can add next to STUDENTS
+#define MAX_TABLE_NAME 32
+#define MAX_NAME_LEN 40     // name and programme arrays of the fixed layout
 #define MAX_PROG_LEN 40
+#ifdef CMS_STRING_ARENA
+#define MAX_TEXT_LEN 200    // longest name or programme kept; the arena only stores the bytes used
+#define MAX_LINE_LEN 512    // one row of the text file
+#else
+#define MAX_TEXT_LEN 39     // MAX_NAME_LEN - 1, written out for the sscanf widths in 1open.c
+#define MAX_LINE_LEN 256
+#endif
 #define FILENAME "Sample-CMS.txt"
+#define FILENAME_COMPRESSED "Sample-CMS.cmsz" // SAVE COMPRESSED; OPEN reads it while it is newer than FILENAME
+
+#if defined(__GNUC__)
+#define CMS_PREFETCH(p) __builtin_prefetch(p)
+#else
+#define CMS_PREFETCH(p) ((void)(p))
+#endif
 
+#ifdef CMS_STRING_ARENA
+typedef struct { // the strings live in arena.c; set them with rec_set_name/rec_set_programme
+    int id;
+    float mark;   // next to id, so the row has no padding (24 bytes)
+    const char* name;
+    const char* programme;
+} StudentRecord;
+#else
 typedef struct {
     int id;
     char name[MAX_NAME_LEN];
     char programme[MAX_PROG_LEN];
     float mark;
 } StudentRecord;
+#endif
+
+typedef struct {
+    int key;
+    int pos;
+} IndexSlot;
+
+typedef struct { // open-addressing table, ID -> array position
+    IndexSlot* slots;
+    signed char* ctrl; // one control byte per slot, only used by -DCMS_SWISS_INDEX builds
+    int size;
+    int used;
+    int grows;    // times the table was resized
+    int dropped;  // keys it could not store since it was last built (out of memory)
+} IdIndex;
+
+typedef struct { // INDEX STATS, see index.c
+    int size;
+    int used;
+    long long probes[PROBE_BUCKETS]; // keys by probes needed to find them (slots, or 16-slot groups in the Swiss table)
+    int maxProbe;
+    double meanProbe;
+    double expectedProbe;  // mean for well-mixed IDs at this load (linear probing), 0 when not known
+    int tombstones;        // always 0: DELETE rebuilds the index rather than marking slots
+    int rebuilds;          // full builds of the command loop's index (OPEN, DELETE, SORT, COMMIT...)
+    int grows;
+    int dropped;
+    int staticKeys;        // INDEX STATIC: IDs in the Eytzinger array
+} IndexStats;
+
+typedef enum {       // what SAVE writes
+    FORMAT_TEXT,       // the tab-separated text file
+    FORMAT_COMPRESSED, // the block format of compress.c
+    FORMAT_TEXT_INDEX  // the text file plus the ID index next to it (<file>.idx)
+} SaveFormat;
+
+typedef struct {
+    int count;
+    float average;
+    float highest;
+    float lowest;
+    char highName[MAX_TEXT_LEN + 1];
+    char lowName[MAX_TEXT_LEN + 1];
+} SummaryStats;
+
+typedef struct { // SUMMARY APPROX, see sketch.c for the error bounds
+    long long count;
+    double average;
+    float quantiles[APPROX_QUANTILES];
+    long long distinctNames;
+    long long distinctProgrammes;
+    char topProgramme[APPROX_TOP][MAX_TEXT_LEN + 1];
+    long long topRows[APPROX_TOP];
+    int topCount;
+    long long stale;    // removed values the sketches still hold, until their next rebuild
+    size_t bytes;       // sketch memory, the same for any table size
+} ApproxSummary;
+
+typedef enum { SORT_ID, SORT_NAME, SORT_PROGRAMME, SORT_MARK } SortField;
+
+typedef struct { // one column of SORT BY, see 8sort.c
+    SortField field;
+    int desc;
+} SortKey;
+
+typedef struct { // how SORT BY columns are packed into one binary key (8sort.c)
+    SortKey keys[MAX_SORT_KEYS];
+    size_t widths[MAX_SORT_KEYS];
+    int count;
+    size_t width;   // bytes per key: the columns, zero padding, then an 8-byte sequence number
+} SortLayout;
+
+typedef struct { // what --sort-file did (extsort.c)
+    long long rows;
+    int runs;       // sorted runs spilled to files; 0 when the file fit the budget
+    int passes;     // merge passes over them
+} SortFileResult;
+
+typedef struct { // one side of a JOIN result row (join.c)
+    const StudentRecord* student; // a STUDENTS row, or NULL
+    const char* columns;          // else an attached table's columns after the ID, tab-separated
+} JoinCols;
+
+typedef void (*JoinEmit)(void* ctx, int id, JoinCols left, JoinCols right);
+
+typedef struct { // an attached table, see TABLES
+    const char* name;
+    const char* path;
+    int rows;
+    int columns;  // besides the ID
+} TableInfo;
+
+typedef enum { SAVE_IDLE, SAVE_RUNNING, SAVE_DONE, SAVE_FAILED } SaveState;
+
+typedef enum {             // outcome of REFRESH (refresh.c)
+    REFRESH_APPENDED,        // only the rows appended since OPEN were read (maybe none)
+    REFRESH_RELOADED,        // the file was replaced, truncated or rewritten: full OPEN
+    REFRESH_BUSY,            // a SAVE is replacing the file or a transaction is open
+    REFRESH_UNSUPPORTED,     // --mmap and --shards have no single file to follow
+    REFRESH_FAILED
+} RefreshResult;
+
+typedef struct { // progress of the background SAVE
+    int state;
+    long rowsWritten;
+    long rowsTotal;
+    unsigned long version;  // snapshot version being written
+    double seconds;
+} SaveStatus;
 
-// Global database declarations (defined in main.c)
-extern StudentRecord records[MAX_RECORDS];
+typedef struct DbSnapshot DbSnapshot; // immutable, reference-counted table version
+typedef struct StrPool StrPool; // strings of one arena generation, or of one loader thread
+
+typedef struct { // MEMORY, see arena.c
+    int arena;           // 0 in fixed-array builds, the rest is then 0 too
+    int blocks;
+    int compactions;
+    long long reserved;  // bytes of the blocks
+    long long used;      // bytes stored in them
+    long long garbage;   // of those, no longer referenced by a row
+} ArenaUsage;
+
+typedef enum { // operations timed by stats.c
+    STAT_OPEN, STAT_SHOWALL, STAT_INSERT, STAT_QUERY, STAT_UPDATE,
+    STAT_DELETE, STAT_SAVE, STAT_SORT, STAT_SUMMARY, STAT_JOIN,
+    STAT_IO_OPEN, STAT_IO_SAVE, STAT_IO_AUDIT,
+    STAT_REPL_LAG, // replica: primary's change to applied here
+    STAT_COUNT
+} StatId;
+
+typedef struct { // one row of STATS, in nanoseconds
+    const char* name;
+    unsigned long long count;
+    unsigned long long meanNs;
+    unsigned long long p50Ns;
+    unsigned long long p99Ns;
+    unsigned long long maxNs;
+} StatSummary;
+
+// latency instrumentation, compiled out with -DCMS_NO_STATS
+#ifndef CMS_NO_STATS
+#define STATS_START(t) unsigned long long t = clock_ns()
+#define STATS_STOP(id, t) stats_record((id), clock_ns() - (t))
+#define TRACE_START(t) unsigned long long t = trace_enabled() ? clock_ns() : 0
+#define TRACE_STOP(name, t) do { if (t) trace_span((name), (t)); } while (0)
+#else
+#define STATS_START(t) ((void)0)
+#define STATS_STOP(id, t) ((void)0)
+#define TRACE_START(t) ((void)0)
+#define TRACE_STOP(name, t) ((void)0)
+#endif
+
+// Global database declarations (defined in db.c)
+extern StudentRecord* records;
 extern int recordCount;
+extern int recordCapacity;
+
+int db_reserve(int count);
+const char* storage_path(void);
+int storage_open(void);
+int storage_save(SaveFormat format);
+unsigned long long clock_ns(void);
+unsigned long long line_checksum(unsigned long long sum, const char* line);
 
 // functions for student database management
 void openDatabase(void);
 void showAll(void);
 void insertRecord(void);
 void queryRecord(void);
+void queryMany(const char* ids);
 void updateRecord(void);
 void deleteRecord(void);
 void saveDatabase(void);
 void sortRecords(void);
 void showSummary(void);
+void showSummaryApprox(void);
+void saveCompressed(void);
+void saveWithIndex(void);
+void showSaveStatus(void);
+void showMemory(void);
+void read_field(char* text);
+
+// non-interactive cores of the operations above (shared by the menu and the server)
+int  db_open(const char* path);
+int  db_parse_row(const char* line, StudentRecord* rec, StrPool* pool);
+int  db_load_row(const StudentRecord* rec);
+int  db_save(const char* path, SaveFormat format);
+int  db_save_background(const char* path, SaveFormat format);
+void db_save_poll(void);
+void db_save_wait(void);
+void db_save_status(SaveStatus* out);
+int  db_find_pos(int id);
+int  db_insert(const StudentRecord* rec);
+int  db_update(int id, const char* name, const char* programme, float mark);
+int  db_delete(int id);
+void db_sort(int byId, int desc);
+int  db_sort_by(const SortKey* keys, int count);
+int  db_parse_sort(const char* spec, SortKey* keys);
+void sort_layout(SortLayout* l, const SortKey* keys, int count, const StudentRecord* rows, int n);
+void sort_encode(const SortLayout* l, unsigned char* key, const StudentRecord* r, unsigned long long seq);
+int  sort_keys(const unsigned char* keys, size_t width, int n, unsigned* order);
+int  db_sort_file(const char* in, const char* out, const SortKey* keys, int count, size_t budget, SortFileResult* res);
+int  db_summary(SummaryStats* out, int ownTxn);
+int  db_summary_approx(ApproxSummary* out);
+
+// statistics functions
+void stats_record(StatId id, unsigned long long ns);
+void stats_show(void);
+int  stats_get(StatId id, StatSummary* out);
+int  stats_dump_json(const char* path);
+
+// session timeline in Chrome trace-event format (trace.c)
+int  trace_open(const char* path);
+int  trace_enabled(void);
+void trace_thread(const char* name);
+void trace_span(const char* name, unsigned long long startNs);
+int  trace_close(void);
+
+// compressed snapshot format (compress.c)
+int cmsz_write(FILE* fp, const DbSnapshot* snap, atomic_long* progress);
+int cmsz_is_compressed(FILE* fp);
+int cmsz_read(FILE* fp);
+
+// string storage for names and programmes (arena.c)
+void rec_set_name(StudentRecord* rec, const char* s, StrPool* pool);
+void rec_set_programme(StudentRecord* rec, const char* s, StrPool* pool);
+StrPool* pool_new(void);
+void arena_adopt(StrPool* pool);
+void* arena_pin(void);
+void arena_unpin(void* gen);
+void arena_reset(void);
+void arena_forget(const StudentRecord* old, const StudentRecord* now);
+int  arena_compact(void);
+void arena_maybe_compact(void);
+void arena_usage(ArenaUsage* out);
+
+// lazy loading (lazy.c)
+void lazy_configure(int on);
+int  lazy_enabled(void);
+int  lazy_open(const char* path);
+int  lazy_pending(void);
+void lazy_fetch(const int* ids, int n);
+void lazy_fetch_row(int pos);
+void lazy_fetch_all(void);
+void lazy_close(void);
+
+// following rows appended to the text file (refresh.c)
+void refresh_mark(FILE* fp, const char* path);
+void refresh_saved(const char* path);
+void refresh_forget(void);
+RefreshResult db_refresh(int* rows);
+void refreshDatabase(void);
+int  refresh_watch(const char* path);
+int  refresh_fd(void);
+void refresh_poll(void);
+void refresh_close(void);
+
+// approximate statistics kept by the changes (sketch.c)
+void sketch_record(const char* op, const StudentRecord* before, const StudentRecord* after, const char* status);
+void sketch_reset(void);
+
+// sharded text storage (shard.c)
+void shard_configure(int count);
+int  shard_count(void);
+int  shard_of(int id);
+void shard_touch(int id);
+void shard_touch_all(void);
+int  shard_pending(void);
+unsigned long long shard_take_dirty(void);
+void shard_restore_dirty(unsigned long long mask);
+void shard_path(char* out, size_t n, const char* base, int shard);
+int  shard_write_manifest(const char* base);
+void shard_saved(const char* base);
+int  shard_open(const char* base);
+
+// memory-mapped storage engine (mmapstore.c)
+void mstore_configure(const char* path);
+int  mstore_enabled(void);
+int  mstore_active(void);
+int  mstore_reserve(int count);
+int  mstore_open(void);
+int  mstore_sync(void);
+void mstore_close(void);
+
+// attached tables and JOIN (join.c)
+int  db_attach(const char* path, const char* name, TableInfo* out);
+int  db_detach(const char* name);
+int  db_tables(TableInfo* out, int max);
+const char* db_table_columns(const char* name);
+long long db_join(const char* left, const char* right, JoinEmit emit, void* ctx);
+void attachTable(void);
+void detachTable(const char* args);
+void showTables(void);
+void joinTables(const char* args);
+
+// shared-memory export for other processes (shmexport.c, read with shmreader.c)
+void shm_export_configure(const char* name);
+int  shm_export_enabled(void);
+int  shm_export_open(void);
+void shm_export_publish(void);
+void shm_export_close(void);
+
+// transactions (txn.c)
+int  txn_active(void);
+int  txn_begin(void);
+int  txn_commit(void);
+int  txn_rollback(void);
+int  txn_log_insert(int pos);
+int  txn_log_update(int pos, const StudentRecord* before);
+int  txn_log_delete(int pos);
+int  txn_row_deleted(int pos);
+const StudentRecord* txn_find(int id);
+void beginTransaction(void);
+void commitTransaction(void);
+void rollbackTransaction(void);
+
+// server mode (server.c)
+int server_run(const char* socketPath);
+
+// log-shipping replication (repl.c)
+int  repl_listen(const char* socketPath);
+int  repl_follow(const char* socketPath);
+int  repl_is_follower(void);
+int  repl_fd(void);
+void repl_poll(void);
+void repl_record(const char* op, const StudentRecord* before, const StudentRecord* after, const char* status);
+void repl_begin_group(void);
+void repl_end_group(int committed);
+int  repl_status(char* buf, size_t n);
+void repl_show(void);
+void repl_close(void);
 
 // audit functions
 void audit_open(void);
 void audit_close(void);
+void audit_begin_group(void);
+void audit_end_group(int committed);
 void audit_log(const char* op,
                const StudentRecord* before_opt,
                const StudentRecord* after_opt,
@@ -46,7 +394,47 @@ void audit_log(const char* op,
 // fastlookup index functions
 void index_build(const StudentRecord* recs, int count);
 int  index_get(int id, int* out_pos);
+void index_get_batch(const int* ids, int n, int* out_pos);
 void index_put(int id, int pos);
 void index_rebuild(const StudentRecord* recs, int count);
+void idindex_build(IdIndex* ix, const StudentRecord* recs, int count);
+int  idindex_get(const IdIndex* ix, int id, int* out_pos);
+void idindex_get_batch(const IdIndex* ix, const int* ids, int n, int* out_pos);
+void idindex_put(IdIndex* ix, int id, int pos);
+void idindex_free(IdIndex* ix);
+void idindex_set_max_load(int percent);
+int  idindex_copy(IdIndex* dst, const IdIndex* src);
+int  idindex_write(const IdIndex* ix, const char* path, int rows, unsigned long long checksum);
+int  index_clone(IdIndex* out);
+typedef struct StaticIndex StaticIndex; // INDEX STATIC's Eytzinger layout, immutable and reference-counted
+StaticIndex* index_static_share(void);
+int  static_index_get(const StaticIndex* s, int id, int* out_pos);
+void static_index_release(StaticIndex* s);
+int  index_load_file(const char* path, int rows, unsigned long long checksum);
+const IdIndex* index_table(void);
+int  index_adopt(const char* kind, int size, int used, const void* image, long long bytes, int rows);
+void index_seal(const StudentRecord* recs, int count);
+void index_set_static(int on, const StudentRecord* recs, int count);
+void index_memory(long long* hashBytes, long long* staticBytes);
+void index_show(void);
+void index_stats(IndexStats* out);
+void index_show_stats(void);
+int  index_complete(void);
+void idindex_stats(const IdIndex* ix, IndexStats* out);
+const char* idindex_kind(void);
+
+// snapshot functions (readers never block, the command loop is the only writer)
+void snapshot_publish(void);
+void snapshot_publish_rows(int first, int last);
+DbSnapshot* snapshot_acquire(void);
+void snapshot_release(DbSnapshot* snap);
+int  snapshot_count(const DbSnapshot* snap);
+unsigned long snapshot_version(const DbSnapshot* snap);
+const StudentRecord* snapshot_row(const DbSnapshot* snap, int i);
+const StudentRecord* snapshot_find(const DbSnapshot* snap, int id);
+int  snapshot_find_batch(const DbSnapshot* snap, const int* ids, int n, const StudentRecord** out);
+int  snapshot_index_copy(const DbSnapshot* snap, IdIndex* out);
+int  snapshot_ids_kept(const DbSnapshot* a, const DbSnapshot* b);
+int  snapshot_next_change(const DbSnapshot* prev, const DbSnapshot* snap, int from);
 
 #endif
@@ -0,0 +1,171 @@
+/*
+ *This file contains the session timeline (student_db --trace [file]).
+ *Every command and its main phases (parsing, index builds, the sort, file writes,
+ *audit flushes, snapshot publishing) are recorded as spans with a start time and a
+ *duration. On exit they are written as Chrome trace-event JSON, which
+ *chrome://tracing, Perfetto or speedscope open as a timeline with one row per thread.
+ *Each thread appends to its own buffer, so recording takes no lock. A buffer
+ *holds at most TRACE_MAX_EVENTS spans; later ones are counted and dropped.
+ *Without --trace a span costs one test of a flag. -DCMS_NO_STATS compiles
+ *the spans out with the other timings.
+*/
+
+#define _CRT_SECURE_NO_WARNINGS
+#include "student_db.h"
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef CMS_NO_STATS
+
+#include <pthread.h>
+
+#define TRACE_MAX_EVENTS (1 << 20) // per thread, 40 MB at most
+#define TRACE_NAME_LEN 24
+
+typedef struct {
+    char name[TRACE_NAME_LEN];
+    unsigned long long start;
+    unsigned long long dur;
+} TraceEvent;
+
+typedef struct TraceBuf {
+    struct TraceBuf* next;
+    int tid;
+    char thread[TRACE_NAME_LEN];
+    TraceEvent* events;
+    int count;
+    int cap;
+    long long dropped;
+} TraceBuf;
+
+static int tracing = 0;
+static char tracePath[260];
+static unsigned long long origin;
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER; // guards the list of buffers
+static TraceBuf* buffers = NULL;
+static int nextTid = 1;
+static _Thread_local TraceBuf* mine = NULL;
+
+static void copy_name(char* dst, const char* src) { // kept JSON-safe without escaping
+    int i = 0;
+    for (; src[i] && i < TRACE_NAME_LEN - 1; i++) {
+        unsigned char c = (unsigned char)src[i];
+        dst[i] = (c < 0x20 || c == '"' || c == '\\' || c >= 0x7f) ? '_' : (char)c;
+    }
+    dst[i] = '\0';
+}
+
+static TraceBuf* my_buffer(void) {
+    if (mine) return mine;
+    TraceBuf* b = calloc(1, sizeof *b);
+    if (!b) return NULL;
+    pthread_mutex_lock(&lock);
+    b->tid = nextTid++;
+    snprintf(b->thread, sizeof b->thread, "thread %d", b->tid);
+    b->next = buffers;
+    buffers = b;
+    pthread_mutex_unlock(&lock);
+    mine = b;
+    return b;
+}
+
+int trace_open(const char* path) { // call before any other thread starts
+    snprintf(tracePath, sizeof tracePath, "%s", path);
+    origin = clock_ns();
+    tracing = 1;
+    trace_thread("main");
+    return 0;
+}
+
+int trace_enabled(void) {
+    return tracing;
+}
+
+void trace_thread(const char* name) { // names the calling thread's row in the viewer
+    TraceBuf* b;
+    if (!tracing || (b = my_buffer()) == NULL) return;
+    copy_name(b->thread, name);
+}
+
+void trace_span(const char* name, unsigned long long startNs) { // from startNs until now
+    unsigned long long now = clock_ns();
+    TraceBuf* b;
+    if (!tracing || (b = my_buffer()) == NULL) return;
+    if (b->count == b->cap) {
+        int cap = b->cap ? b->cap * 2 : 1024;
+        TraceEvent* grown = cap <= TRACE_MAX_EVENTS ? realloc(b->events, (size_t)cap * sizeof *grown) : NULL;
+        if (!grown) {
+            b->dropped++;
+            return;
+        }
+        b->events = grown;
+        b->cap = cap;
+    }
+    TraceEvent* e = &b->events[b->count++];
+    copy_name(e->name, name);
+    e->start = startNs > origin ? startNs - origin : 0;
+    e->dur = now > startNs ? now - startNs : 0;
+}
+
+// Writes the trace file; every other thread must have finished. Returns spans written or -1.
+int trace_close(void) {
+    if (!tracing) return 0;
+    tracing = 0;
+    FILE* fp = fopen(tracePath, "w");
+    long long written = 0, dropped = 0;
+    pthread_mutex_lock(&lock);
+    TraceBuf* list = buffers;
+    buffers = NULL;
+    pthread_mutex_unlock(&lock);
+    mine = NULL;
+
+    if (fp) fprintf(fp, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+    for (TraceBuf* b = list; b; b = b->next) {
+        if (fp) {
+            fprintf(fp, "%s{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"%s\"}}",
+                b == list ? "" : ",\n", b->tid, b->thread);
+            for (int i = 0; i < b->count; i++) { // ts and dur in microseconds
+                const TraceEvent* e = &b->events[i];
+                fprintf(fp, ",\n{\"ph\":\"X\",\"name\":\"%s\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}",
+                    e->name, b->tid, e->start / 1000.0, e->dur / 1000.0);
+            }
+        }
+        written += b->count;
+        dropped += b->dropped;
+    }
+    while (list) {
+        TraceBuf* next = list->next;
+        free(list->events);
+        free(list);
+        list = next;
+    }
+    if (fp == NULL) return -1;
+    fprintf(fp, "\n],\"otherData\":{\"dropped_spans\":%lld}}\n", dropped);
+    return fclose(fp) == 0 ? (int)written : -1;
+}
+
+#else
+
+int trace_open(const char* path) {
+    (void)path;
+    return -1;
+}
+
+int trace_enabled(void) {
+    return 0;
+}
+
+void trace_thread(const char* name) {
+    (void)name;
+}
+
+void trace_span(const char* name, unsigned long long startNs) {
+    (void)name;
+    (void)startNs;
+}
+
+int trace_close(void) {
+    return 0;
+}
+
+#endif
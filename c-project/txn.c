@@ -0,0 +1,158 @@
+/*
+ *This file contains transactions (BEGIN / COMMIT / ROLLBACK).
+ *Between BEGIN and COMMIT, INSERT/UPDATE/DELETE change records[] and the command
+ *loop's index as usual, but:
+ *  - every change is written to an undo log (the row position and its old image)
+ *  - DELETE only marks the row; the rows are removed together at COMMIT with
+ *    one pass over the array and one index rebuild
+ *  - no snapshot is published, so other readers and SAVE keep seeing the last commit;
+ *    the session that owns the transaction reads records[] (txn_find) and sees its own changes
+ *  - audit entries are buffered and written as one group with a single flush
+ *ROLLBACK walks the undo log backwards; positions never move inside a transaction,
+ *so every entry still points at the row it changed.
+*/
+
+#define _CRT_SECURE_NO_WARNINGS
+#include "student_db.h"
+#include <stdlib.h>
+
+typedef struct {
+    char op; // 'I', 'U' or 'D'
+    int pos;
+    StudentRecord before;
+} UndoEntry;
+
+static int active = 0;
+static UndoEntry* undo = NULL;
+static int undoCount = 0;
+static int undoCapacity = 0;
+static IdIndex deletedRows; // key pos + 1 (0 is the empty key) of rows deleted in this transaction
+
+int txn_active(void) {
+    return active;
+}
+
+static int log_entry(char op, int pos, const StudentRecord* before) {
+    if (undoCount == undoCapacity) {
+        int capacity = undoCapacity ? undoCapacity * 2 : 64;
+        UndoEntry* grown = realloc(undo, (size_t)capacity * sizeof *grown);
+        if (!grown) return -1;
+        undo = grown;
+        undoCapacity = capacity;
+    }
+    undo[undoCount].op = op;
+    undo[undoCount].pos = pos;
+    if (before) undo[undoCount].before = *before;
+    undoCount++;
+    return 0;
+}
+
+int txn_log_insert(int pos) {
+    return log_entry('I', pos, NULL);
+}
+
+int txn_log_update(int pos, const StudentRecord* before) {
+    return log_entry('U', pos, before);
+}
+
+int txn_log_delete(int pos) {
+    if (log_entry('D', pos, NULL) != 0) return -1;
+    idindex_put(&deletedRows, pos + 1, pos);
+    return 0;
+}
+
+int txn_row_deleted(int pos) {
+    return active && deletedRows.used > 0 && idindex_get(&deletedRows, pos + 1, NULL);
+}
+
+const StudentRecord* txn_find(int id) { // the transaction's own view: its uncommitted rows, NULL if id is not there
+    int pos = db_find_pos(id);
+    return pos >= 0 ? &records[pos] : NULL;
+}
+
+static void finish(void) {
+    active = 0;
+    undoCount = 0;
+    idindex_free(&deletedRows);
+}
+
+int txn_begin(void) { // -1 if a transaction is already open
+    if (active) return -1;
+    lazy_fetch_all(); // queries inside see the last commit, which must hold every row
+    active = 1;
+    undoCount = 0;
+    audit_begin_group();
+    return 0;
+}
+
+int txn_commit(void) { // changes made visible, returns how many, -1 without BEGIN
+    if (!active) return -1;
+    int changes = undoCount;
+
+    if (deletedRows.used > 0) { // remove every deleted row in one pass
+        int kept = 0;
+        for (int i = 0; i < recordCount; i++) {
+            if (idindex_get(&deletedRows, i + 1, NULL)) { // only now is the row gone (a ROLLBACK keeps it)
+                shard_touch(records[i].id);
+                arena_forget(&records[i], NULL);
+                continue;
+            }
+            records[kept] = records[i];
+            kept = kept + 1;
+        }
+        recordCount = kept;
+        index_rebuild(records, recordCount);
+    }
+    finish();
+    if (changes > 0) snapshot_publish();
+    audit_end_group(1);
+    arena_maybe_compact(); // strings replaced or deleted in the transaction may be garbage now
+    return changes;
+}
+
+int txn_rollback(void) { // undoes every change, returns how many, -1 without BEGIN
+    if (!active) return -1;
+    int changes = undoCount;
+    int inserted = 0;
+
+    for (int k = undoCount - 1; k >= 0; k--) {
+        if (undo[k].op == 'U') {
+            records[undo[k].pos] = undo[k].before;
+        }
+        else if (undo[k].op == 'I') { // inserts append, so the newest is always last
+            recordCount = undo[k].pos;
+            inserted = 1;
+        }
+        // 'D' only marked the row, clearing the marks below restores it
+    }
+    if (inserted) index_rebuild(records, recordCount); // drop the inserted IDs
+    finish();
+    audit_end_group(0);
+    return changes;
+}
+
+void beginTransaction(void) {
+    if (txn_begin() != 0) {
+        printf("A transaction is already open. COMMIT or ROLLBACK it first.\n");
+        return;
+    }
+    printf("Transaction started. Changes stay private until COMMIT.\n");
+}
+
+void commitTransaction(void) {
+    int changes = txn_commit();
+    if (changes < 0) {
+        printf("No transaction is open. Use BEGIN first.\n");
+        return;
+    }
+    printf("Committed %d change(s).\n", changes);
+}
+
+void rollbackTransaction(void) {
+    int changes = txn_rollback();
+    if (changes < 0) {
+        printf("No transaction is open. Use BEGIN first.\n");
+        return;
+    }
+    printf("Rolled back %d change(s).\n", changes);
+}